@@ -0,0 +1,235 @@
+/* bench/bench-fstab.c
+   What mount(2) saves per call by creating its fstab directly instead of
+   through a synthetic argv and argp_parse.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argp.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <hurd/paths.h>
+#include "../sutils/fstab.h"
+#include "bench.h"
+
+#define SEARCH_FMTS _HURD "%sfs\0" _HURD "%s"
+
+/* The fstab the old path read; _PATH_MNTTAB in the library. */
+#define BENCH_FSTAB BENCH_RUN_DIR "/fstab"
+
+static const struct argp_child children[] = { {&bench_argp}, {0} };
+
+static const struct argp argp =
+    { NULL, NULL, NULL,
+      "Measure how mount(2) created its fstab before and after it stopped"
+      " going through argp: \"argv\" builds an argv of the device and mount"
+      " point, parses it with the fstab_argp child parser and calls"
+      " fstab_argp_create, which reads an fstab of --entries entries;"
+      " \"direct\" creates the fstab as mount does now.",
+      children };
+
+/* The old path, as it was in mount.c.  */
+
+static struct fstab_argp_params fstab_params;
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct fstab_argp_params *params = state->input;
+    switch(key)
+    {
+    case ARGP_KEY_INIT:
+        state->child_inputs[0] = params; /* Pass down fstab_argp parser. */
+        break;
+    }
+  return 0;
+}
+
+static const struct argp_option argv_opts[] =
+{
+    {0, 0}
+};
+
+static const struct argp_child argv_kids[] =
+    { { &fstab_argp, 0,
+        "Filesystem selection (if no explicit filesystem arguments given):", 2 },
+      { 0 } };
+
+static struct argp argv_argp = { argv_opts, parse_opt, NULL, NULL, argv_kids };
+
+/* Add a string to an argv-like array of strings. */
+static error_t
+add_to_argv(char ***out_argv, size_t *out_argc, const char *str)
+{
+    char  **mnt_argv = *out_argv;
+    size_t  mnt_argc = *out_argc;
+
+    /* Fill argv[0] with "" to simulate program call in an actual argv. */
+    if(!out_argv || !mnt_argc)
+    {
+        mnt_argv = malloc(sizeof(char*));
+        if(!mnt_argv)
+            return ENOMEM;
+        mnt_argv[0] = malloc(sizeof(""));
+        if(!mnt_argv[0])
+            return ENOMEM;
+        strcpy(mnt_argv[0], "");
+        mnt_argc++;
+    }
+
+    mnt_argc++;
+    char **check = realloc(mnt_argv, mnt_argc * sizeof(char*));
+    if(!check)
+        return ENOMEM;
+    mnt_argv = check;
+    mnt_argv[mnt_argc - 1] = strdup(str);
+    if(!mnt_argv[mnt_argc - 1])
+        return ENOMEM;
+
+    *out_argc = mnt_argc;
+    *out_argv = mnt_argv;
+    return 0;
+}
+
+/* Free FSTAB and its fstypes, as mount_fstab_free does. */
+static void
+fstab_free_all(struct fstab *fstab)
+{
+    struct fstypes *types = fstab->types;
+
+    fstab_free(fstab);
+    while(types->entries)
+    {
+        struct fstype *type = types->entries;
+        types->entries = type->next;
+        free(type->name);
+        free(type->program);
+        free(type);
+    }
+    free(types->program_search_fmts);
+    free(types);
+}
+
+/* The fstab of the old mount(2).  It read _PATH_MNTTAB; this reads
+   BENCH_FSTAB, which takes one more argument. */
+static struct fstab *
+fstab_by_argv(const char *device, const char *mountpoint)
+{
+    error_t        err      = 0;
+    char         **mnt_argv = NULL;
+    size_t         mnt_argc = 0;
+    struct fstab  *fstab    = NULL;
+
+    err = add_to_argv(&mnt_argv, &mnt_argc, "--fstab=" BENCH_FSTAB);
+    if(!err)
+        err = add_to_argv(&mnt_argv, &mnt_argc, device);
+    if(!err)
+        err = add_to_argv(&mnt_argv, &mnt_argc, mountpoint);
+    if(!err)
+        err = argp_parse(&argv_argp, mnt_argc, mnt_argv, 0, 0,
+                         &fstab_params);
+    if(err)
+        bench_fail(err, "argp_parse");
+
+    /* fstab_path points into the argv, so it is freed after.  mount(2)
+       freed it before, which was only safe as it passed no --fstab. */
+    fstab = fstab_argp_create(&fstab_params, SEARCH_FMTS,
+                              sizeof(SEARCH_FMTS));
+    for(size_t i = 0; i < mnt_argc; i++)
+        free(mnt_argv[i]);
+    free(mnt_argv);
+    free(fstab_params.names);
+    free(fstab_params.types);
+    free(fstab_params.exclude);
+    if(!fstab)
+        bench_fail(EINVAL, "fstab_argp_create");
+    return fstab;
+}
+
+/* The fstab of mount(2) now, as mount_fstab_create makes it. */
+static struct fstab *
+fstab_direct(void)
+{
+    error_t         err;
+    struct fstypes *types = NULL;
+    struct fstab   *fstab = NULL;
+
+    err = fstypes_create(SEARCH_FMTS, sizeof(SEARCH_FMTS), &types);
+    if(!err)
+        err = fstab_create(types, &fstab);
+    if(err)
+        bench_fail(err, "fstab_create");
+    return fstab;
+}
+
+static void
+write_fstab(size_t entries)
+{
+    FILE *file = fopen(BENCH_FSTAB, "w");
+
+    if(!file)
+        bench_fail(errno, BENCH_FSTAB);
+    for(size_t i = 0; i < entries; i++)
+        fprintf(file, "/dev/hd%zus1 /srv/vol%zu ext2fs defaults 0 2\n", i, i);
+    if(fclose(file) == EOF)
+        bench_fail(errno, BENCH_FSTAB);
+}
+
+static void
+run(size_t size)
+{
+    struct bench_samples samples;
+    uint64_t             start;
+
+    bench_reset();
+    write_fstab(size);
+    bench_samples_init(&samples, bench_calls);
+
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        start = bench_now();
+        fstab_free_all(fstab_by_argv("/dev/bench", "/bench/m"));
+        bench_sample(&samples, start);
+    }
+    bench_report("fstab", "argv", size, &samples);
+
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        start = bench_now();
+        fstab_free_all(fstab_direct());
+        bench_sample(&samples, start);
+    }
+    bench_report("fstab", "direct", size, &samples);
+
+    bench_samples_free(&samples);
+}
+
+int
+main(int argc, char **argv)
+{
+    static size_t entries[] = { 0, 10, 100, 1000 };
+
+    bench_entries  = entries;
+    bench_nentries = sizeof(entries) / sizeof(*entries);
+    bench_calls    = 2000;
+    argp_parse(&argp, argc, argv, 0, NULL, NULL);
+    for(size_t i = 0; i < bench_nentries; i++)
+        run(bench_entries[i]);
+    return 0;
+}
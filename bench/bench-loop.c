@@ -0,0 +1,228 @@
+/* bench/bench-loop.c
+   Read throughput of an ext2 image mounted with the loop option against
+   the same image behind a storeio translator set up by hand.  Unlike the
+   other benchmarks this one runs real translators, so it only builds on
+   the Hurd.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argp.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#define BUF_SIZE (64 * 1024)
+
+static unsigned long image_mib = 64;
+static unsigned long rounds    = 5;
+static const char   *dir       = "run/loop";
+
+static const struct argp_option options[] =
+{
+    {"size",   's', "MIB", 0, "Size of the image (default 64)", 0},
+    {"rounds", 'n', "N",   0, "Mounts to read the image through (default 5)",
+     0},
+    {"dir",    'd', "DIR", 0, "Where to put the image and the mount points"
+     " (default run/loop)", 0},
+    {0}
+};
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    unsigned long *val = (key == 's') ? &image_mib : &rounds;
+    char          *end;
+
+    switch(key)
+    {
+    case 's':
+    case 'n':
+        errno = 0;
+        *val  = strtoul(arg, &end, 10);
+        if(errno || (end == arg) || *end || !*val)
+            argp_error(state, "%s: not a positive number", arg);
+        return 0;
+    case 'd':
+        dir = arg;
+        return 0;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+}
+
+static const struct argp argp =
+    { options, parse_opt, NULL,
+      "Measure reading a file that fills half of an ext2 image of --size"
+      " MiB: \"loop\" mounts the image with the loop option, \"storeio\""
+      " mounts a node with /hurd/storeio on the image, as was needed before."
+      "  Each of --rounds mounts starts a new translator, so nothing is"
+      " cached from the last one.  Needs mke2fs and settrans." };
+
+static char image[PATH_MAX], dev[PATH_MAX], mnt[PATH_MAX], file[PATH_MAX];
+
+static uint64_t
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+run_command(const char *fmt, ...)
+{
+    char    cmd[3 * PATH_MAX];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(cmd, sizeof(cmd), fmt, ap);
+    va_end(ap);
+    if(system(cmd) != 0)
+        error(1, 0, "%s: failed", cmd);
+}
+
+/* Make the image, with a file of zeros filling half of it. */
+static void
+make_image(void)
+{
+    char     *buf = calloc(1, BUF_SIZE);
+    int       fd;
+    uint64_t  left = (uint64_t) image_mib * 1024 * 1024 / 2;
+
+    if(!buf)
+        error(1, ENOMEM, "buffer");
+    run_command("mkdir -p '%s' '%s'", dir, mnt);
+    run_command("mke2fs -q -F -t ext2 '%s' %luM", image, image_mib);
+
+    if(mount(image, mnt, "ext2", 0, "loop") < 0)
+        error(1, errno, "mount %s", image);
+    fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        error(1, errno, "%s", file);
+    while(left)
+    {
+        ssize_t n = write(fd, buf, (left < BUF_SIZE) ? left : BUF_SIZE);
+        if(n <= 0)
+            error(1, errno, "write %s", file);
+        left -= n;
+    }
+    if((fsync(fd) < 0) || (close(fd) < 0))
+        error(1, errno, "%s", file);
+    if(umount2(mnt, 0) < 0)
+        error(1, errno, "umount2 %s", mnt);
+    free(buf);
+}
+
+/* Read FILE through a new mount of SOURCE with OPTS, and return the time
+   it took in nanoseconds. */
+static uint64_t
+read_through(const char *source, const char *opts, uint64_t *bytes)
+{
+    static char buf[BUF_SIZE];
+    uint64_t    start;
+    ssize_t     n;
+    int         fd;
+
+    if(mount(source, mnt, "ext2", MS_RDONLY, opts) < 0)
+        error(1, errno, "mount %s", source);
+    *bytes = 0;
+    start  = now();
+    fd     = open(file, O_RDONLY);
+    if(fd < 0)
+        error(1, errno, "%s", file);
+    while((n = read(fd, buf, sizeof(buf))) > 0)
+        *bytes += n;
+    if(n < 0)
+        error(1, errno, "read %s", file);
+    close(fd);
+    start = now() - start;
+    if(umount2(mnt, 0) < 0)
+        error(1, errno, "umount2 %s", mnt);
+    return start;
+}
+
+static int
+compare(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Print one JSON object for the NS of the rounds reading BYTES each. */
+static void
+report(const char *op, uint64_t *ns, uint64_t bytes)
+{
+    uint64_t total = 0;
+
+    qsort(ns, rounds, sizeof(*ns), compare);
+    for(unsigned long i = 0; i < rounds; i++)
+        total += ns[i];
+    printf("{\"bench\":\"loop\",\"op\":\"%s\",\"image_mib\":%lu,"
+           "\"rounds\":%lu,\"bytes\":%llu,\"mib_per_sec\":%.1f,"
+           "\"mean_ns\":%llu,\"p50_ns\":%llu,\"max_ns\":%llu}\n",
+           op, image_mib, rounds, (unsigned long long) bytes,
+           (double) bytes * rounds / (1024 * 1024) / ((double) total / 1e9),
+           (unsigned long long) (total / rounds),
+           (unsigned long long) ns[rounds / 2],
+           (unsigned long long) ns[rounds - 1]);
+    fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+    uint64_t *ns;
+    uint64_t  bytes = 0;
+
+    argp_parse(&argp, argc, argv, 0, NULL, NULL);
+    snprintf(image, sizeof(image), "%s/image", dir);
+    snprintf(dev, sizeof(dev), "%s/dev", dir);
+    snprintf(mnt, sizeof(mnt), "%s/mnt", dir);
+    snprintf(file, sizeof(file), "%s/mnt/data", dir);
+    ns = calloc(rounds, sizeof(*ns));
+    if(!ns)
+        error(1, ENOMEM, "samples");
+
+    make_image();
+
+    for(unsigned long i = 0; i < rounds; i++)
+        ns[i] = read_through(image, "loop", &bytes);
+    report("loop", ns, bytes);
+
+    run_command("settrans -ac '%s' /hurd/storeio '%s'", dev, image);
+    for(unsigned long i = 0; i < rounds; i++)
+        ns[i] = read_through(dev, "", &bytes);
+    report("storeio", ns, bytes);
+    run_command("settrans -fg '%s'", dev);
+
+    unlink(image);
+    free(ns);
+    return 0;
+}
@@ -0,0 +1,184 @@
+/* bench/bench-map.c
+   What a reader of the mount table pays through the binary map against
+   parsing the text of the mtab.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argp.h>
+#include <errno.h>
+#include <mntent.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/mount.h>
+#include "bench.h"
+
+/* How long the library is given to publish the map, in milliseconds. */
+#define PUBLISH_WAIT 10000
+
+static const struct argp_child children[] = { {&bench_argp}, {0} };
+
+static const struct argp argp =
+    { NULL, NULL, NULL,
+      "Measure reading every entry of a mount table of --entries entries:"
+      " \"text\" parses the mtab with getmntent, \"map-open\" opens the"
+      " binary map, reads it and closes it, as a new reader would, and"
+      " \"map-read\" reads a map kept open once the table changed.",
+      children };
+
+/* Wait until the library published the table with N entries, and return
+   it open. */
+static struct mount_map *
+wait_map(size_t n)
+{
+    struct timespec ts = { 0, 1000 * 1000 };
+
+    for(long ms = 0; ms < PUBLISH_WAIT; ms++)
+    {
+        struct mount_map    *map = mount_map_open();
+        const struct mntent *entries;
+        size_t               count;
+
+        if(map && (mount_map_read(map, &entries, &count) == 0)
+           && (count == n))
+            return map;
+        mount_map_close(map);
+        nanosleep(&ts, NULL);
+    }
+    bench_fail(ETIMEDOUT, "mount_map_open");
+    return NULL;
+}
+
+/* Wait until the table in MAP is no longer at generation GEN, nor being
+   written. */
+static void
+wait_generation(struct mount_map *map, unsigned long long gen)
+{
+    struct timespec ts = { 0, 100 * 1000 };
+
+    for(long i = 0; i < PUBLISH_WAIT * 10; i++)
+    {
+        unsigned long long now = mount_map_generation(map);
+
+        if((now != gen) && !(now & 1))
+            return;
+        nanosleep(&ts, NULL);
+    }
+    bench_fail(ETIMEDOUT, "mount_map_generation");
+}
+
+/* Mount or unmount the extra filesystem, which changes the table, and
+   return how many entries it has now. */
+static size_t
+toggle(size_t size, size_t i)
+{
+    if(i & 1)
+    {
+        if(umount2("/bench/map", 0) < 0)
+            bench_fail(errno, "umount2");
+        return size;
+    }
+    if(mount("/dev/map", "/bench/map", "ext2", 0, "") < 0)
+        bench_fail(errno, "mount");
+    return size + 1;
+}
+
+static void
+run(size_t size)
+{
+    struct bench_samples  samples;
+    struct mount_map     *map;
+    uint64_t              start;
+    size_t                n;
+
+    bench_reset();
+    bench_write_mtab(size);
+    bench_samples_init(&samples, bench_calls);
+    n   = toggle(size, 0);
+    map = wait_map(n);
+
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        FILE          *file;
+        struct mntent *mnt;
+        size_t         count = 0;
+
+        start = bench_now();
+        file  = setmntent(BENCH_MTAB, "r");
+        if(!file)
+            bench_fail(errno, BENCH_MTAB);
+        while((mnt = getmntent(file)))
+            count++;
+        endmntent(file);
+        bench_sample(&samples, start);
+        if(count != size)
+            bench_fail(EINVAL, BENCH_MTAB);
+    }
+    bench_report("map", "text", size, &samples);
+
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        struct mount_map    *m;
+        const struct mntent *entries;
+        size_t               count;
+
+        start = bench_now();
+        m = mount_map_open();
+        if(!m || (mount_map_read(m, &entries, &count) < 0))
+            bench_fail(errno, "mount_map_read");
+        mount_map_close(m);
+        bench_sample(&samples, start);
+        if(count != n)
+            bench_fail(EINVAL, "mount_map_read");
+    }
+    bench_report("map", "map-open", size, &samples);
+
+    /* Only the read is timed; the change and its publishing are not. */
+    for(size_t i = 1; i <= bench_calls; i++)
+    {
+        unsigned long long   gen   = mount_map_generation(map);
+        const struct mntent *entries;
+        size_t               count = 0;
+
+        n = toggle(size, i);
+        while(count != n)
+        {
+            wait_generation(map, gen);
+            start = bench_now();
+            if(mount_map_read(map, &entries, &count) < 0)
+                bench_fail(errno, "mount_map_read");
+            if(count == n)
+                bench_sample(&samples, start);
+            gen = mount_map_generation(map);
+        }
+    }
+    bench_report("map", "map-read", size, &samples);
+
+    mount_map_close(map);
+    if((n > size) && (umount2("/bench/map", 0) < 0))
+        bench_fail(errno, "umount2");
+    bench_samples_free(&samples);
+}
+
+int
+main(int argc, char **argv)
+{
+    argp_parse(&argp, argc, argv, 0, NULL, NULL);
+    for(size_t i = 0; i < bench_nentries; i++)
+        run(bench_entries[i]);
+    return 0;
+}
@@ -0,0 +1,97 @@
+/* bench/bench-mount.c
+   Latency and throughput of mount, remount, bind mounts and umount2
+   against mount tables of growing size.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argp.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mount.h>
+#include "bench.h"
+
+/* Mount points the calls rotate through, so that each mount finds its
+   target free without waiting on the one before. */
+#define TARGETS 16
+
+static const struct argp_child children[] = { {&bench_argp}, {0} };
+
+static const struct argp argp =
+    { NULL, NULL, NULL,
+      "Measure mount(2) and umount2(2) against the stand-in RPCs.",
+      children };
+
+/* Run CALL and add its latency to SAMPLES; exit if it fails. */
+#define TIMED(samples, what, call)                                          \
+    do                                                                      \
+    {                                                                       \
+        uint64_t start_ = bench_now();                                      \
+        if((call) < 0)                                                      \
+            bench_fail(errno, what);                                        \
+        bench_sample(samples, start_);                                      \
+    } while(0)
+
+static void
+run(size_t size)
+{
+    static const char *const ops[] = { "mount", "remount", "umount2", "bind",
+                                       "umount2-bind" };
+    struct bench_samples     samples[5];
+    char                     target[TARGETS][32];
+    uint64_t                 start;
+
+    bench_reset();
+    bench_write_mtab(size);
+    for(size_t i = 0; i < TARGETS; i++)
+        snprintf(target[i], sizeof(target[i]), "/bench/m%zu", i);
+    for(size_t op = 0; op < 5; op++)
+        bench_samples_init(&samples[op], bench_calls);
+
+    start = bench_now();
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        const char    *t     = target[i % TARGETS];
+        unsigned long  flags = MS_REMOUNT | ((i & 1) ? 0 : MS_RDONLY);
+
+        TIMED(&samples[0], "mount", mount("/dev/bench", t, "ext2", 0, ""));
+        TIMED(&samples[1], "remount", mount(NULL, t, NULL, flags, NULL));
+        TIMED(&samples[2], "umount2", umount2(t, 0));
+        TIMED(&samples[3], "bind",
+              mount("/srv/vol1", t, "none", MS_BIND, NULL));
+        TIMED(&samples[4], "umount2", umount2(t, 0));
+    }
+    /* The operations run interleaved, so the throughput of each is taken
+       from its own latencies. */
+    for(size_t op = 0; op < 5; op++)
+    {
+        bench_report("mount", ops[op], size, &samples[op]);
+        bench_samples_free(&samples[op]);
+    }
+    fprintf(stderr, "bench-mount: %zu entries: %zu cycles in %.3f s\n",
+            size, bench_calls, (bench_now() - start) / 1e9);
+}
+
+int
+main(int argc, char **argv)
+{
+    argp_parse(&argp, argc, argv, 0, NULL, NULL);
+    for(size_t i = 0; i < bench_nentries; i++)
+        run(bench_entries[i]);
+    return 0;
+}
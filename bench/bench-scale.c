@@ -0,0 +1,178 @@
+/* bench/bench-scale.c
+   Throughput of mount and umount2 called from a growing number of threads
+   at once.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argp.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* Mount points of each thread. */
+#define TARGETS 4
+
+/* The latency of every RPC unless given, so that the threads have
+   something to overlap. */
+#define DEFAULT_LATENCY 50000
+
+#define OPT_THREADS 't'
+
+static const struct argp_option options[] =
+{
+    {"threads", OPT_THREADS, "N,...", 0,
+     "Numbers of threads to measure with (default 1, 2, 4 and so on up to"
+     " the number of processors)", 0},
+    {0}
+};
+
+static size_t *threads;
+static size_t  nthreads;
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    switch(key)
+    {
+    case OPT_THREADS:
+        if(bench_parse_sizes(arg, &threads, &nthreads))
+            argp_error(state, "%s: not a list of numbers", arg);
+        for(size_t i = 0; i < nthreads; i++)
+            if(!threads[i])
+                argp_error(state, "%s: not a list of numbers", arg);
+        return 0;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+}
+
+static const struct argp_child children[] = { {&bench_argp}, {0} };
+
+static const struct argp argp =
+    { options, parse_opt, NULL,
+      "Measure the throughput of mount(2) followed by umount2(2) from"
+      " --threads threads at once, each on mount points of its own, against"
+      " a table of --entries entries.  Every RPC takes 50us unless a latency"
+      " is given.",
+      children };
+
+struct worker
+{
+    pthread_t            thread;
+    size_t               id;
+    struct bench_samples samples;
+};
+
+static pthread_barrier_t start_barrier;
+
+static void *
+work(void *arg)
+{
+    struct worker *w = arg;
+    char           target[TARGETS][64];
+
+    for(size_t i = 0; i < TARGETS; i++)
+        snprintf(target[i], sizeof(target[i]), "/scale/t%zu/m%zu", w->id, i);
+
+    pthread_barrier_wait(&start_barrier);
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        const char *t     = target[i % TARGETS];
+        uint64_t    start = bench_now();
+
+        if(mount("/dev/scale", t, "ext2", 0, "") < 0)
+            bench_fail(errno, "mount");
+        if(umount2(t, 0) < 0)
+            bench_fail(errno, "umount2");
+        bench_sample(&w->samples, start);
+    }
+    return NULL;
+}
+
+static void
+run(size_t size, size_t n)
+{
+    struct worker        *workers = calloc(n, sizeof(*workers));
+    struct bench_samples  samples;
+    uint64_t              start;
+
+    if(!workers)
+        bench_fail(ENOMEM, "workers");
+    bench_reset();
+    bench_write_mtab(size);
+    bench_samples_init(&samples, n * bench_calls);
+    pthread_barrier_init(&start_barrier, NULL, n + 1);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        workers[i].id = i;
+        bench_samples_init(&workers[i].samples, bench_calls);
+        if(pthread_create(&workers[i].thread, NULL, work, &workers[i]))
+            bench_fail(errno, "pthread_create");
+    }
+    pthread_barrier_wait(&start_barrier);
+    start = bench_now();
+    for(size_t i = 0; i < n; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        bench_samples_merge(&samples, &workers[i].samples);
+        bench_samples_free(&workers[i].samples);
+    }
+    samples.elapsed = bench_now() - start;
+    samples.threads = n;
+    bench_report("scale", "mount+umount2", size, &samples);
+
+    pthread_barrier_destroy(&start_barrier);
+    bench_samples_free(&samples);
+    free(workers);
+}
+
+int
+main(int argc, char **argv)
+{
+    static size_t entries[] = { 1000 };
+    long          cpus      = sysconf(_SC_NPROCESSORS_ONLN);
+
+    bench_entries  = entries;
+    bench_nentries = 1;
+    for(int call = 0; call < STAND_IN_CALLS; call++)
+        bench_set_latency(call, DEFAULT_LATENCY);
+    argp_parse(&argp, argc, argv, 0, NULL, NULL);
+
+    if(!threads)
+    {
+        /* One for each power of two below CPUS, and CPUS. */
+        threads = malloc(sizeof(*threads) * (CHAR_BIT * sizeof(long) + 1));
+        if(!threads)
+            bench_fail(ENOMEM, "threads");
+        for(size_t n = 1; n < (size_t) cpus; n *= 2)
+            threads[nthreads++] = n;
+        threads[nthreads++] = (cpus > 0) ? cpus : 1;
+    }
+
+    for(size_t i = 0; i < bench_nentries; i++)
+        for(size_t j = 0; j < nthreads; j++)
+            run(bench_entries[i], threads[j]);
+    return 0;
+}
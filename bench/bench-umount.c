@@ -0,0 +1,92 @@
+/* bench/bench-umount.c
+   Latency of umount2 against the size of the mount table, with the cached
+   table and with one that must be parsed again.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argp.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/mount.h>
+#include "bench.h"
+
+static const struct argp_child children[] = { {&bench_argp}, {0} };
+
+static const struct argp argp =
+    { NULL, NULL, NULL,
+      "Measure umount2(2) against the size of the mount table: \"umount2\""
+      " after our own mount, \"umount2-mtab-changed\" after _PATH_MOUNTED"
+      " was rewritten, so the table is parsed again, and \"umount2-einval\""
+      " on a directory that is not mounted, which only looks it up in the"
+      " cached table.",
+      children };
+
+static void
+run(size_t size)
+{
+    struct bench_samples samples;
+    uint64_t             start;
+
+    bench_reset();
+    bench_write_mtab(size);
+    bench_samples_init(&samples, bench_calls);
+
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        if(mount("/dev/bench", "/bench/m", "ext2", 0, "") < 0)
+            bench_fail(errno, "mount");
+        start = bench_now();
+        if(umount2("/bench/m", 0) < 0)
+            bench_fail(errno, "umount2");
+        bench_sample(&samples, start);
+    }
+    bench_report("umount", "umount2", size, &samples);
+
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        if(mount("/dev/bench", "/bench/m", "ext2", 0, "") < 0)
+            bench_fail(errno, "mount");
+        /* Someone else changed the table; we can no longer trust ours. */
+        bench_write_mtab(size);
+        start = bench_now();
+        if(umount2("/bench/m", 0) < 0)
+            bench_fail(errno, "umount2");
+        bench_sample(&samples, start);
+    }
+    bench_report("umount", "umount2-mtab-changed", size, &samples);
+
+    for(size_t i = 0; i < bench_calls; i++)
+    {
+        start = bench_now();
+        if((umount2("/bench/none", 0) == 0) || (errno != EINVAL))
+            bench_fail(errno, "umount2 of /bench/none");
+        bench_sample(&samples, start);
+    }
+    bench_report("umount", "umount2-einval", size, &samples);
+
+    bench_samples_free(&samples);
+}
+
+int
+main(int argc, char **argv)
+{
+    argp_parse(&argp, argc, argv, 0, NULL, NULL);
+    for(size_t i = 0; i < bench_nentries; i++)
+        run(bench_entries[i]);
+    return 0;
+}
@@ -0,0 +1,320 @@
+/* bench/bench.c
+   Timing, reporting and set-up shared by the mount(2) benchmarks and
+   tests.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "stand-in.h"
+
+#define OPT_ENTRIES 'e'
+#define OPT_CALLS   'n'
+/* Option keys of the latencies, past any character. */
+#define OPT_LATENCY 0x100
+
+static const struct argp_option options[] =
+{
+    {"entries", OPT_ENTRIES, "N,...", 0,
+     "Sizes of the table to measure against", 0},
+    {"calls", OPT_CALLS, "N", 0,
+     "Calls of each operation per table size", 0},
+    {0}
+};
+
+static const struct argp_option latency_options[] =
+{
+    {"latency", OPT_LATENCY + STAND_IN_CALLS, "NS", 0,
+     "Set the latency of every RPC below to NS nanoseconds", 0},
+    {"lookup-latency", OPT_LATENCY + STAND_IN_LOOKUP, "NS", 0,
+     "Latency of file_name_lookup", 0},
+    {"start-latency", OPT_LATENCY + STAND_IN_START, "NS", 0,
+     "Latency of fshelp_start_translator_long", 0},
+    {"settrans-latency", OPT_LATENCY + STAND_IN_SET_TRANSLATOR, "NS", 0,
+     "Latency of file_set_translator", 0},
+    {"goaway-latency", OPT_LATENCY + STAND_IN_GOAWAY, "NS", 0,
+     "Latency of fsys_goaway", 0},
+    {"fsys-latency", OPT_LATENCY + STAND_IN_FSYS, "NS", 0,
+     "Latency of fs_fsys", 0},
+    {"fstype-latency", OPT_LATENCY + STAND_IN_FSTYPE, "NS", 0,
+     "Latency of fs_type", 0},
+    {"rpc-latency", OPT_LATENCY + STAND_IN_RPC, "NS", 0,
+     "Latency of the other RPCs", 0},
+    {0}
+};
+
+/* What was set, for the reports. */
+static unsigned long latency[STAND_IN_CALLS];
+
+static const char *const latency_names[STAND_IN_CALLS] =
+    { "lookup", "start", "settrans", "goaway", "fsys", "fstype", "rpc" };
+
+void
+bench_set_latency(int call, unsigned long ns)
+{
+    latency[call] = ns;
+    stand_in_set_latency(call, ns);
+}
+
+static error_t
+parse_latency(int key, char *arg, struct argp_state *state)
+{
+    char          *end;
+    unsigned long  ns;
+
+    switch(key)
+    {
+    case ARGP_KEY_INIT:
+        /* Sleep for no longer than asked. */
+        prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+        return 0;
+    default:
+        if((key < OPT_LATENCY) || (key > OPT_LATENCY + STAND_IN_CALLS))
+            return ARGP_ERR_UNKNOWN;
+        errno = 0;
+        ns    = strtoul(arg, &end, 10);
+        if(errno || *end || (end == arg))
+            argp_error(state, "%s: not a number of nanoseconds", arg);
+        for(int call = 0; call < STAND_IN_CALLS; call++)
+            if((key == OPT_LATENCY + STAND_IN_CALLS)
+               || (key == OPT_LATENCY + call))
+                bench_set_latency(call, ns);
+        return 0;
+    }
+}
+
+static const struct argp latency_argp = { latency_options, parse_latency };
+
+static size_t default_entries[] = { 10, 100, 1000, 10000, 100000 };
+
+size_t *bench_entries  = default_entries;
+size_t  bench_nentries = sizeof(default_entries) / sizeof(*default_entries);
+size_t  bench_calls    = 200;
+
+static error_t
+parse_opt(int key, char *arg, struct argp_state *state)
+{
+    char *end;
+
+    switch(key)
+    {
+    case OPT_ENTRIES:
+        if(bench_parse_sizes(arg, &bench_entries, &bench_nentries))
+            argp_error(state, "%s: not a list of sizes", arg);
+        return 0;
+    case OPT_CALLS:
+        bench_calls = strtoul(arg, &end, 10);
+        if(*end || (end == arg) || !bench_calls)
+            argp_error(state, "%s: not a number of calls", arg);
+        return 0;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+}
+
+static const struct argp_child children[] =
+    { {&latency_argp, 0, "Latencies of the stand-in RPCs, in nanoseconds:",
+       0},
+      {0} };
+
+const struct argp bench_argp = { options, parse_opt, NULL, NULL, children };
+
+uint64_t
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+bench_fail(int err, const char *what)
+{
+    error(1, err, "%s", what);
+    abort();
+}
+
+void
+bench_samples_init(struct bench_samples *samples, size_t size)
+{
+    samples->ns = malloc(size * sizeof(*samples->ns));
+    if(!samples->ns)
+        bench_fail(ENOMEM, "samples");
+    samples->n       = 0;
+    samples->size    = size;
+    samples->elapsed = 0;
+    samples->threads = 0;
+}
+
+void
+bench_sample(struct bench_samples *samples, uint64_t start)
+{
+    uint64_t ns = bench_now() - start;
+
+    if(samples->n < samples->size)
+        samples->ns[samples->n++] = ns;
+}
+
+static int
+sample_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Return the Pth percentile of the sorted samples. */
+static uint64_t
+percentile(const struct bench_samples *samples, unsigned p)
+{
+    size_t i = (samples->n * p + 99) / 100;
+
+    return samples->ns[i ? i - 1 : 0];
+}
+
+void
+bench_report(const char *bench, const char *op, size_t entries,
+             struct bench_samples *samples)
+{
+    uint64_t total = 0;
+    uint64_t elapsed;
+
+    if(!samples->n)
+        return;
+    qsort(samples->ns, samples->n, sizeof(*samples->ns), sample_cmp);
+    for(size_t i = 0; i < samples->n; i++)
+        total += samples->ns[i];
+    elapsed = samples->elapsed ?: total;
+
+    printf("{\"bench\":\"%s\",\"op\":\"%s\",\"entries\":%zu,\"calls\":%zu,"
+           "\"ops_per_sec\":%.1f,\"mean_ns\":%llu,\"p50_ns\":%llu,"
+           "\"p99_ns\":%llu,\"max_ns\":%llu",
+           bench, op, entries, samples->n,
+           elapsed ? samples->n * 1e9 / elapsed : 0.0,
+           (unsigned long long) (total / samples->n),
+           (unsigned long long) percentile(samples, 50),
+           (unsigned long long) percentile(samples, 99),
+           (unsigned long long) samples->ns[samples->n - 1]);
+    if(samples->threads)
+        printf(",\"threads\":%zu", samples->threads);
+    for(int call = 0; call < STAND_IN_CALLS; call++)
+        printf(",\"%s_latency_ns\":%lu", latency_names[call], latency[call]);
+    printf("}\n");
+    fflush(stdout);
+
+    samples->n       = 0;
+    samples->elapsed = 0;
+}
+
+void
+bench_samples_merge(struct bench_samples *samples,
+                    struct bench_samples *from)
+{
+    size_t n = from->n;
+
+    if(n > samples->size - samples->n)
+        n = samples->size - samples->n;
+    memcpy(samples->ns + samples->n, from->ns, n * sizeof(*from->ns));
+    samples->n += n;
+    from->n     = 0;
+}
+
+void
+bench_samples_free(struct bench_samples *samples)
+{
+    free(samples->ns);
+    samples->ns = NULL;
+}
+
+int
+bench_parse_sizes(const char *arg, size_t **sizes, size_t *n)
+{
+    size_t      count = 1;
+    const char *p;
+
+    for(p = arg; *p; p++)
+        if(*p == ',')
+            count++;
+    *sizes = malloc(count * sizeof(**sizes));
+    if(!*sizes)
+        return ENOMEM;
+
+    *n = 0;
+    for(p = arg; *n < count; p++)
+    {
+        char *end;
+
+        errno = 0;
+        (*sizes)[*n] = strtoul(p, &end, 10);
+        if(errno || (end == p) || (*end && (*end != ',')))
+        {
+            free(*sizes);
+            return EINVAL;
+        }
+        (*n)++;
+        p = end;
+        if(!*p)
+            break;
+    }
+    return 0;
+}
+
+void
+bench_reset(void)
+{
+    DIR           *dir;
+    struct dirent *ent;
+
+    if((mkdir(BENCH_RUN_DIR, 0755) < 0) && (errno != EEXIST))
+        bench_fail(errno, BENCH_RUN_DIR);
+    dir = opendir(BENCH_RUN_DIR);
+    if(!dir)
+        bench_fail(errno, BENCH_RUN_DIR);
+    while((ent = readdir(dir)))
+        if(ent->d_name[0] != '.')
+            unlinkat(dirfd(dir), ent->d_name, 0);
+    closedir(dir);
+}
+
+void
+bench_write_mtab(size_t entries)
+{
+    FILE *file = fopen(BENCH_MTAB ".tmp", "w");
+
+    if(!file)
+        bench_fail(errno, BENCH_MTAB ".tmp");
+    for(size_t i = 0; i < entries; i++)
+        fprintf(file, "/dev/hd%zus1 /srv/vol%zu ext2fs rw 0 0\n", i, i);
+    if(fclose(file) == EOF)
+        bench_fail(errno, BENCH_MTAB ".tmp");
+    /* A new file, so that the library sees a new stamp even within one
+       tick of the clock. */
+    if(rename(BENCH_MTAB ".tmp", BENCH_MTAB) < 0)
+        bench_fail(errno, BENCH_MTAB);
+}
@@ -0,0 +1,97 @@
+/* bench/bench.h
+   Timing, reporting and set-up shared by the mount(2) benchmarks and
+   tests.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <argp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Where the library keeps its files in the benchmarks: the Makefile points
+   _PATH_MOUNTED into it. */
+#define BENCH_RUN_DIR "run"
+#define BENCH_MTAB    BENCH_RUN_DIR "/mtab"
+
+/* Latencies of the timed calls of one operation. */
+struct bench_samples
+{
+    uint64_t *ns;
+    size_t    n;
+    size_t    size;
+    uint64_t  elapsed;          /* Wall time of the whole run. */
+    size_t    threads;          /* Callers taking them, if more than one. */
+};
+
+/* Parser of the options every benchmark takes: the sizes of the mount
+   table in BENCH_ENTRIES, the calls of each operation in BENCH_CALLS and
+   the latency of each stand-in call.  Add it as a child of the program's
+   parser.  A program may set these before parsing to change their
+   defaults, 10 to 100k entries and 200 calls. */
+extern const struct argp bench_argp;
+
+extern size_t *bench_entries;
+extern size_t  bench_nentries;
+extern size_t  bench_calls;
+
+/* Make each CALL of the stand-ins take NS nanoseconds, as the latency
+   options do.  A program may call it before parsing to change the
+   default of 0. */
+void bench_set_latency(int call, unsigned long ns);
+
+/* Return the time in nanoseconds on the monotonic clock. */
+uint64_t bench_now(void);
+
+/* Make SAMPLES hold up to SIZE latencies.  Exits on failure. */
+void bench_samples_init(struct bench_samples *samples, size_t size);
+
+/* Add the latency of one call made at START, now over. */
+void bench_sample(struct bench_samples *samples, uint64_t start);
+
+/* Write one JSON line for the samples of OP in BENCH on a table of
+   ENTRIES entries, and empty SAMPLES for the next.  ELAPSED in SAMPLES
+   must be set for the throughput, or it is taken as the sum of the
+   samples. */
+void bench_report(const char *bench, const char *op, size_t entries,
+                  struct bench_samples *samples);
+
+/* Add the samples of FROM to SAMPLES, and empty FROM. */
+void bench_samples_merge(struct bench_samples *samples,
+                         struct bench_samples *from);
+
+void bench_samples_free(struct bench_samples *samples);
+
+/* Parse the comma-separated list of sizes in ARG into a new *SIZES of *N
+   elements.  Returns EINVAL if one is not a number. */
+int bench_parse_sizes(const char *arg, size_t **sizes, size_t *n);
+
+/* Empty BENCH_RUN_DIR of what the library wrote, making it if needed.
+   Exits on failure. */
+void bench_reset(void);
+
+/* Replace _PATH_MOUNTED with a table of ENTRIES mounts that are not ours,
+   as other mount programs would have written it.  Exits on failure. */
+void bench_write_mtab(size_t entries);
+
+/* Print the message of ERR for WHAT and exit. */
+void bench_fail(int err, const char *what) __attribute__ ((noreturn));
+
+#endif /* _BENCH_H */
@@ -0,0 +1,1725 @@
+/* bench/stand-in.c
+   In-process stand-ins for the Mach, Hurd and sutils calls of the mount(2)
+   library, so that it can be measured and tested on Linux.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argz.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mntent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <hurd.h>
+#include <hurd/fshelp.h>
+#include <hurd/paths.h>
+#include <mach/notify.h>
+#include "../sutils/fstab.h"
+#include "stand-in.h"
+
+/* The namespace is a table of nodes by canonical path, each with the
+   active translator and passive translator set on it.  Nodes are never
+   removed; their port names are NODE_BASE plus their index.  Translators
+   are slots named CONTROL_BASE plus their index, with a count of the send
+   rights to their control port: a slot is reused once its translator is
+   dead and no right to it is left, as Mach reuses a dead name.  Other
+   names are not tracked.  One lock covers everything; the latency of a
+   call is spent before taking it.
+
+   Nodes have a mode and owner, and so does the root of each translator,
+   named ROOT_BASE plus its index: it takes those of the node it was
+   started on, as tmpfs does. */
+
+#define NODE_BASE           0x00100000U
+#define ROOT_BASE           0x08000000U
+#define CONTROL_BASE        0x10000000U
+#define RECEIVE_BASE        0x20000000U
+
+/* Dead-name notifications waiting to be received. */
+#define NOTIFY_QUEUE        4096
+
+/* What _HURD holds, for fs_type. */
+static const char *const stand_in_programs[] =
+    { _HURD "ext2fs", _HURD "tmpfs", _HURD "iso9660fs", _HURD "fatfs",
+      _HURD "nfs", _HURD "ufs", _HURD "firmlink", _HURD "storeio", NULL };
+
+struct node
+{
+    char         *path;
+    mach_port_t   active;       /* Control port, or MACH_PORT_NULL. */
+    char         *passive;
+    size_t        passive_len;
+    mode_t        mode;
+    uid_t         uid;
+    gid_t         gid;
+    size_t        hash_next;    /* Index plus one, or 0. */
+};
+
+struct translator
+{
+    bool          used;
+    bool          alive;
+    bool          busy;
+    int           refs;         /* Send rights to the control port. */
+    size_t        node;         /* Index plus one of the node it is
+                                   attached to, or 0. */
+    char         *argz;
+    size_t        argz_len;
+    mach_port_t   notify;       /* For its dead-name notification. */
+    mode_t        root_mode;
+    uid_t         root_uid;
+    gid_t         root_gid;
+    unsigned long set_options;  /* Calls of fsys_set_options. */
+    char         *options;      /* What the last one sent. */
+    size_t        options_len;
+    size_t        free_next;    /* Index plus one, or 0. */
+};
+
+static pthread_mutex_t     stand_in_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t      stand_in_notified = PTHREAD_COND_INITIALIZER;
+static unsigned long       stand_in_latency[STAND_IN_CALLS];
+static unsigned long       stand_in_counts[STAND_IN_CALLS];
+
+static struct node        *nodes;
+static size_t              nnodes, nodes_size;
+static size_t             *node_hash;
+static size_t              node_hash_size;
+
+static struct translator  *translators;
+static size_t              ntranslators, translators_size;
+static size_t              translator_free;
+static size_t              translators_running;
+static size_t              translators_used;
+/* Filesystems synced, by fsys_syncfs or on going away. */
+static unsigned long       translators_synced;
+
+static mach_port_t         receive_next = RECEIVE_BASE;
+
+static struct
+{
+    mach_port_t receiver;
+    mach_port_t name;
+}                          notify_queue[NOTIFY_QUEUE];
+static size_t              notify_head, notify_count;
+
+void
+stand_in_set_latency(enum stand_in_call call, unsigned long ns)
+{
+    __atomic_store_n(&stand_in_latency[call], ns, __ATOMIC_RELAXED);
+}
+
+unsigned long
+stand_in_count(enum stand_in_call call)
+{
+    return __atomic_load_n(&stand_in_counts[call], __ATOMIC_RELAXED);
+}
+
+/* Count CALL and spend its latency. */
+static void
+stand_in_call(enum stand_in_call call)
+{
+    unsigned long   ns = __atomic_load_n(&stand_in_latency[call],
+                                         __ATOMIC_RELAXED);
+    struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+
+    __atomic_fetch_add(&stand_in_counts[call], 1, __ATOMIC_RELAXED);
+    if(ns)
+        while(clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts) == EINTR)
+            ;
+}
+
+static size_t
+path_hash(const char *path)
+{
+    size_t h = 5381;
+
+    while(*path)
+        h = h * 33 + (unsigned char) *path++;
+    return h;
+}
+
+/* Put the canonical form of PATH in BUF: absolute, taken from the working
+   directory if relative, without `.', `..' or repeated slashes. */
+static error_t
+path_canon(const char *path, char *buf)
+{
+    size_t len = 0;
+
+    if(!path || !*path)
+        return ENOENT;
+    if(*path != '/')
+    {
+        if(!getcwd(buf, PATH_MAX))
+            return errno;
+        len = strlen(buf);
+        if(len == 1)
+            len = 0;
+    }
+
+    while(*path)
+    {
+        const char *end = strchrnul(path, '/');
+        size_t      n   = end - path;
+
+        if((n == 0) || ((n == 1) && (path[0] == '.')))
+            ;
+        else if((n == 2) && (path[0] == '.') && (path[1] == '.'))
+        {
+            while(len && (buf[len - 1] != '/'))
+                len--;
+            if(len)
+                len--;
+        }
+        else
+        {
+            if(len + n + 2 > PATH_MAX)
+                return ENAMETOOLONG;
+            buf[len++] = '/';
+            memcpy(buf + len, path, n);
+            len += n;
+        }
+        path = *end ? end + 1 : end;
+    }
+    if(!len)
+        buf[len++] = '/';
+    buf[len] = '\0';
+    return 0;
+}
+
+/* Return the node for canonical PATH, making it if MAKE, or NULL.  Called
+   with stand_in_lock held. */
+static struct node *
+node_find(const char *path, bool make)
+{
+    size_t h = path_hash(path);
+
+    if(node_hash_size)
+        for(size_t i = node_hash[h % node_hash_size]; i;
+            i = nodes[i - 1].hash_next)
+            if(strcmp(nodes[i - 1].path, path) == 0)
+                return &nodes[i - 1];
+    if(!make)
+        return NULL;
+
+    if(nnodes == nodes_size)
+    {
+        size_t       size = nodes_size ? 2 * nodes_size : 64;
+        struct node *n    = realloc(nodes, size * sizeof(*n));
+
+        if(!n)
+            return NULL;
+        nodes      = n;
+        nodes_size = size;
+    }
+    if(nnodes >= node_hash_size)
+    {
+        size_t  size = node_hash_size ? 2 * node_hash_size : 64;
+        size_t *hash = calloc(size, sizeof(*hash));
+
+        if(!hash)
+            return NULL;
+        for(size_t i = 0; i < nnodes; i++)
+        {
+            size_t b = path_hash(nodes[i].path) % size;
+
+            nodes[i].hash_next = hash[b];
+            hash[b] = i + 1;
+        }
+        free(node_hash);
+        node_hash      = hash;
+        node_hash_size = size;
+    }
+
+    memset(&nodes[nnodes], 0, sizeof(nodes[nnodes]));
+    nodes[nnodes].path = strdup(path);
+    if(!nodes[nnodes].path)
+        return NULL;
+    nodes[nnodes].mode = S_IFDIR | 0755;
+    nodes[nnodes].hash_next = node_hash[h % node_hash_size];
+    node_hash[h % node_hash_size] = nnodes + 1;
+    return &nodes[nnodes++];
+}
+
+/* Return the node named NAME, or NULL.  Called with stand_in_lock
+   held. */
+static struct node *
+node_port(mach_port_t name)
+{
+    if((name < NODE_BASE) || (name - NODE_BASE >= nnodes))
+        return NULL;
+    return &nodes[name - NODE_BASE];
+}
+
+/* Return the translator whose control port is NAME, or NULL.  Called with
+   stand_in_lock held. */
+static struct translator *
+translator_port(mach_port_t name)
+{
+    if((name < CONTROL_BASE) || (name - CONTROL_BASE >= ntranslators)
+       || !translators[name - CONTROL_BASE].used)
+        return NULL;
+    return &translators[name - CONTROL_BASE];
+}
+
+/* Return the running translator whose root is NAME, or NULL.  Called
+   with stand_in_lock held. */
+static struct translator *
+translator_root(mach_port_t name)
+{
+    struct translator *t;
+
+    if(name < ROOT_BASE)
+        return NULL;
+    t = translator_port(name - ROOT_BASE + CONTROL_BASE);
+    return (t && t->alive) ? t : NULL;
+}
+
+static mach_port_t
+translator_name(const struct translator *t)
+{
+    return CONTROL_BASE + (t - translators);
+}
+
+/* Return the translator running on NODE, or NULL.  Called with
+   stand_in_lock held. */
+static struct translator *
+node_active(const struct node *node)
+{
+    struct translator *t = translator_port(node->active);
+
+    return (t && t->alive) ? t : NULL;
+}
+
+/* Start a translator running ARGZ, with one right to its control port.
+   Called with stand_in_lock held. */
+static struct translator *
+translator_start(const char *argz, size_t argz_len)
+{
+    struct translator *t;
+
+    if(translator_free)
+    {
+        t = &translators[translator_free - 1];
+        translator_free = t->free_next;
+    }
+    else
+    {
+        if(ntranslators == translators_size)
+        {
+            size_t             size = translators_size
+                                      ? 2 * translators_size : 64;
+            struct translator *n    = realloc(translators,
+                                              size * sizeof(*n));
+
+            if(!n)
+                return NULL;
+            translators      = n;
+            translators_size = size;
+        }
+        t = &translators[ntranslators++];
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->argz = malloc(argz_len ?: 1);
+    if(!t->argz)
+    {
+        t->free_next    = translator_free;
+        translator_free = t - translators + 1;
+        return NULL;
+    }
+    memcpy(t->argz, argz, argz_len);
+    t->argz_len = argz_len;
+    t->used     = true;
+    t->alive    = true;
+    t->refs     = 1;
+    translators_running++;
+    translators_used++;
+    return t;
+}
+
+/* Drop DELTA rights to T's control port, and its slot once it is dead and
+   none is left.  Called with stand_in_lock held. */
+static void
+translator_refs(struct translator *t, int delta)
+{
+    t->refs += delta;
+    if((t->refs > 0) || t->alive)
+        return;
+    t->used         = false;
+    t->free_next    = translator_free;
+    translator_free = t - translators + 1;
+    translators_used--;
+}
+
+/* Take T off the node it is attached to.  Called with stand_in_lock
+   held. */
+static void
+translator_detach(struct translator *t)
+{
+    struct node *node = t->node ? &nodes[t->node - 1] : NULL;
+
+    t->node = 0;
+    if(node && (node->active == translator_name(t)))
+    {
+        node->active = MACH_PORT_NULL;
+        translator_refs(t, -1);
+    }
+}
+
+/* Make T go away, as asked with FLAGS.  Called with stand_in_lock
+   held. */
+static error_t
+translator_goaway(struct translator *t, int flags)
+{
+    if(t->busy && !(flags & FSYS_GOAWAY_FORCE))
+        return EBUSY;
+    if(!(flags & FSYS_GOAWAY_NOSYNC))
+        translators_synced++;
+
+    translator_detach(t);
+    t->alive = false;
+    free(t->argz);
+    t->argz     = NULL;
+    t->argz_len = 0;
+    free(t->options);
+    t->options     = NULL;
+    t->options_len = 0;
+    translators_running--;
+
+    /* Its control port is a dead name now; the notification holds a
+       reference of its own. */
+    if(t->notify && (notify_count < NOTIFY_QUEUE))
+    {
+        size_t i = (notify_head + notify_count++) % NOTIFY_QUEUE;
+
+        notify_queue[i].receiver = t->notify;
+        notify_queue[i].name     = translator_name(t);
+        t->refs++;
+        pthread_cond_broadcast(&stand_in_notified);
+    }
+    t->notify = MACH_PORT_NULL;
+    translator_refs(t, 0);
+    return 0;
+}
+
+/* Attach T to NODE, which takes a right of its own.  Called with
+   stand_in_lock held. */
+static void
+translator_attach(struct translator *t, struct node *node)
+{
+    node->active = translator_name(t);
+    t->node      = node - nodes + 1;
+    t->refs++;
+}
+
+/* Move the translators set on the nodes below the node at index FROM to
+   the same places below the one at index TO, as the nodes of a filesystem
+   go wherever it is attached.  Nodes may be made, so pointers to nodes do
+   not survive it.  Called with stand_in_lock held. */
+static void
+node_move_below(size_t from, size_t to)
+{
+    size_t end      = nnodes;
+    size_t from_len = strlen(nodes[from].path);
+
+    for(size_t i = 0; i < end; i++)
+    {
+        const char        *path = nodes[i].path;
+        char              *dest;
+        struct node       *d;
+        struct translator *t;
+
+        if((strncmp(path, nodes[from].path, from_len) != 0)
+           || (path[from_len] != '/'))
+            continue;
+        if(asprintf(&dest, "%s%s", nodes[to].path, path + from_len) < 0)
+            continue;
+        d = node_find(dest, true);
+        free(dest);
+        if(!d)
+            continue;
+        t = node_active(&nodes[i]);
+        if(t)
+        {
+            translator_detach(t);
+            translator_attach(t, d);
+        }
+        free(d->passive);
+        d->passive           = nodes[i].passive;
+        d->passive_len       = nodes[i].passive_len;
+        nodes[i].passive     = NULL;
+        nodes[i].passive_len = 0;
+    }
+}
+
+/* Mach. */
+
+mach_port_t
+mach_task_self(void)
+{
+    return 1;
+}
+
+error_t
+mach_port_allocate(task_t task, mach_port_right_t right, mach_port_t *name)
+{
+    pthread_mutex_lock(&stand_in_lock);
+    *name = receive_next++;
+    pthread_mutex_unlock(&stand_in_lock);
+    return 0;
+}
+
+error_t
+mach_port_mod_refs(task_t task, mach_port_t name, mach_port_right_t right,
+                   int delta)
+{
+    struct translator *t;
+
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_port(name);
+    if(t)
+        translator_refs(t, delta);
+    pthread_mutex_unlock(&stand_in_lock);
+    return 0;
+}
+
+error_t
+mach_port_deallocate(task_t task, mach_port_t name)
+{
+    if(name < CONTROL_BASE)
+        return 0;
+    return mach_port_mod_refs(task, name, MACH_PORT_RIGHT_SEND, -1);
+}
+
+error_t
+mach_port_type(task_t task, mach_port_t name, mach_port_type_t *type)
+{
+    error_t            err = 0;
+    struct translator *t;
+
+    pthread_mutex_lock(&stand_in_lock);
+    if((name >= CONTROL_BASE) && (name < RECEIVE_BASE))
+    {
+        t = translator_port(name);
+        if(!t)
+            err = EINVAL;
+        else
+            *type = t->alive ? MACH_PORT_TYPE_SEND
+                             : MACH_PORT_TYPE_DEAD_NAME;
+    }
+    else
+        *type = (name >= RECEIVE_BASE) ? MACH_PORT_TYPE_RECEIVE
+                                       : MACH_PORT_TYPE_SEND;
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+mach_port_request_notification(task_t task, mach_port_t name,
+                               mach_msg_id_t id, unsigned int sync,
+                               mach_port_t notify,
+                               mach_msg_type_name_t notify_type,
+                               mach_port_t *previous)
+{
+    error_t            err = 0;
+    struct translator *t;
+
+    *previous = MACH_PORT_NULL;
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_port(name);
+    if(!t)
+        err = EINVAL;
+    else if(!t->alive)
+        err = EINVAL;
+    else
+        t->notify = notify;
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+/* Only receives dead-name notifications, waiting for as long as it
+   takes. */
+mach_msg_return_t
+mach_msg(mach_msg_header_t *msg, mach_msg_option_t option,
+         mach_msg_size_t send_size, mach_msg_size_t rcv_size,
+         mach_port_t rcv_name, mach_msg_timeout_t timeout,
+         mach_port_t notify)
+{
+    mach_dead_name_notification_t *dead = (void *) msg;
+
+    if(!(option & MACH_RCV_MSG) || (rcv_size < sizeof(*dead)))
+        return MACH_RCV_INVALID_NAME;
+
+    pthread_mutex_lock(&stand_in_lock);
+    for(;;)
+    {
+        for(size_t i = 0; i < notify_count; i++)
+        {
+            size_t slot = (notify_head + i) % NOTIFY_QUEUE;
+
+            if(notify_queue[slot].receiver != rcv_name)
+                continue;
+            memset(dead, 0, sizeof(*dead));
+            dead->not_header.msgh_id         = MACH_NOTIFY_DEAD_NAME;
+            dead->not_header.msgh_local_port = rcv_name;
+            dead->not_header.msgh_size       = sizeof(*dead);
+            dead->not_port                   = notify_queue[slot].name;
+            /* Close the gap. */
+            for(size_t j = i; j + 1 < notify_count; j++)
+                notify_queue[(notify_head + j) % NOTIFY_QUEUE] =
+                    notify_queue[(notify_head + j + 1) % NOTIFY_QUEUE];
+            notify_count--;
+            pthread_mutex_unlock(&stand_in_lock);
+            return MACH_MSG_SUCCESS;
+        }
+        pthread_cond_wait(&stand_in_notified, &stand_in_lock);
+    }
+}
+
+error_t
+vm_deallocate(task_t task, vm_address_t address, vm_size_t size)
+{
+    free((void *) address);
+    return 0;
+}
+
+/* Hurd. */
+
+mach_port_t
+getcwdir(void)
+{
+    return MACH_PORT_NULL;
+}
+
+mach_port_t
+getcrdir(void)
+{
+    return MACH_PORT_NULL;
+}
+
+mach_port_t
+getauth(void)
+{
+    return MACH_PORT_NULL;
+}
+
+file_t
+file_name_lookup(const char *file, int flags, mode_t mode)
+{
+    char         path[PATH_MAX];
+    error_t      err;
+    struct node *node = NULL;
+
+    stand_in_call(STAND_IN_LOOKUP);
+    err = path_canon(file, path);
+    if(err)
+    {
+        errno = err;
+        return MACH_PORT_NULL;
+    }
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_find(path, true);
+    if(node && !(flags & O_NOTRANS) && node->passive_len
+       && !node_active(node))
+    {
+        /* Start the passive translator, as the filesystem holding the
+           node would on a lookup through it. */
+        struct translator *t = translator_start(node->passive,
+                                                node->passive_len);
+
+        if(t)
+        {
+            translator_attach(t, node);
+            translator_refs(t, -1);
+        }
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+
+    if(!node)
+    {
+        errno = ENOMEM;
+        return MACH_PORT_NULL;
+    }
+    return NODE_BASE + (node - nodes);
+}
+
+error_t
+fshelp_start_translator_long(fshelp_open_fn_t underlying_open_fn,
+                             void *cookie, char *name, char *argz,
+                             int argz_len, mach_port_t *fds,
+                             mach_msg_type_name_t fds_type, int fds_len,
+                             mach_port_t *ports,
+                             mach_msg_type_name_t ports_type, int ports_len,
+                             int *ints, int ints_len, uid_t owner_uid,
+                             int timeout, fsys_t *control)
+{
+    error_t               err  = 0;
+    file_t                node = MACH_PORT_NULL;
+    mach_msg_type_name_t  type;
+    struct translator    *t;
+    bool                  found = false;
+
+    stand_in_call(STAND_IN_START);
+
+    for(size_t i = 0; stand_in_programs[i]; i++)
+        if(strcmp(stand_in_programs[i], name) == 0)
+            found = true;
+    if(!found)
+        return ENOENT;
+
+    err = (*underlying_open_fn)(O_RDWR, &node, &type, MACH_PORT_NULL, cookie);
+    if(err)
+        return err;
+
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_start(argz, argz_len);
+    if(t)
+    {
+        struct node *under = node_port(node);
+
+        if(under)
+        {
+            t->root_mode = under->mode;
+            t->root_uid  = under->uid;
+            t->root_gid  = under->gid;
+        }
+        *control = translator_name(t);
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return t ? 0 : ENOMEM;
+}
+
+error_t
+file_set_translator(file_t file, int passive_flags, int active_flags,
+                    int goaway_flags, const char *passive, size_t passive_len,
+                    mach_port_t active, mach_msg_type_name_t active_type)
+{
+    error_t            err  = 0;
+    struct node       *node;
+    struct translator *cur;
+    struct translator *new  = NULL;
+    char              *copy = NULL;
+
+    stand_in_call(STAND_IN_SET_TRANSLATOR);
+
+    if((passive_flags & FS_TRANS_SET) && passive_len)
+    {
+        copy = malloc(passive_len);
+        if(!copy)
+            return ENOMEM;
+        memcpy(copy, passive, passive_len);
+    }
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_port(file);
+    if(!node)
+    {
+        err = EINVAL;
+        goto end_set;
+    }
+    cur = node_active(node);
+    if(active != MACH_PORT_NULL)
+    {
+        new = translator_port(active);
+        if(!new || !new->alive)
+        {
+            err = EINVAL;
+            goto end_set;
+        }
+    }
+
+    if(((passive_flags & FS_TRANS_SET) && (passive_flags & FS_TRANS_EXCL)
+        && node->passive_len)
+       || ((active_flags & FS_TRANS_SET) && (active_flags & FS_TRANS_EXCL)
+           && cur))
+    {
+        err = EBUSY;
+        goto end_set;
+    }
+
+    if(active_flags & FS_TRANS_SET)
+    {
+        if(cur && (cur != new))
+        {
+            if(active_flags & FS_TRANS_ORPHAN)
+                translator_detach(cur);
+            else
+            {
+                err = translator_goaway(cur, goaway_flags);
+                if(err)
+                    goto end_set;
+            }
+        }
+        if(new && (cur != new))
+        {
+            size_t old = new->node;
+
+            /* Attached to one node at a time; moving it takes it off the
+               old one without telling it, and what is mounted on its
+               nodes goes with it. */
+            translator_detach(new);
+            translator_attach(new, node);
+            if(old)
+            {
+                size_t i = node - nodes;
+
+                node_move_below(old - 1, i);
+                node = &nodes[i];
+            }
+        }
+    }
+
+    if(passive_flags & FS_TRANS_SET)
+    {
+        free(node->passive);
+        node->passive     = copy;
+        node->passive_len = copy ? passive_len : 0;
+        copy              = NULL;
+    }
+
+end_set:
+    pthread_mutex_unlock(&stand_in_lock);
+    free(copy);
+    return err;
+}
+
+/* Copy the LEN bytes at DATA to *BUF, which is allocated anew if its
+   *BUF_LEN bytes are too few, as an RPC returning out-of-line data does. */
+static error_t
+stand_in_reply(const char *data, size_t len, char **buf, size_t *buf_len)
+{
+    if(len > *buf_len)
+    {
+        *buf = malloc(len);
+        if(!*buf)
+            return ENOMEM;
+    }
+    memcpy(*buf, data, len);
+    *buf_len = len;
+    return 0;
+}
+
+error_t
+file_get_translator(file_t file, char **trans, size_t *trans_len)
+{
+    error_t      err = 0;
+    struct node *node;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_port(file);
+    if(!node)
+        err = EINVAL;
+    else if(!node->passive_len)
+        err = EINVAL;
+    else
+        err = stand_in_reply(node->passive, node->passive_len, trans,
+                             trans_len);
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+file_get_translator_cntl(file_t file, fsys_t *control)
+{
+    error_t            err = 0;
+    struct node       *node;
+    struct translator *t   = NULL;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_port(file);
+    if(!node)
+        err = EINVAL;
+    else if(!(t = node_active(node)))
+        err = ENXIO;
+    else
+    {
+        t->refs++;
+        *control = translator_name(t);
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+/* Point *MODE, *UID and *GID at the mode and owner of FILE, a node or
+   the root of a translator.  Called with stand_in_lock held. */
+static error_t
+file_owner(file_t file, mode_t **mode, uid_t **uid, gid_t **gid)
+{
+    struct node       *node = node_port(file);
+    struct translator *t    = translator_root(file);
+
+    if(node)
+    {
+        *mode = &node->mode;
+        *uid  = &node->uid;
+        *gid  = &node->gid;
+    }
+    else if(t)
+    {
+        *mode = &t->root_mode;
+        *uid  = &t->root_uid;
+        *gid  = &t->root_gid;
+    }
+    else
+        return EINVAL;
+    return 0;
+}
+
+error_t
+io_stat(io_t io, struct stat *st)
+{
+    error_t  err;
+    mode_t  *mode;
+    uid_t   *uid;
+    gid_t   *gid;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    err = file_owner(io, &mode, &uid, &gid);
+    if(!err)
+    {
+        memset(st, 0, sizeof(*st));
+        st->st_mode = *mode;
+        st->st_uid  = *uid;
+        st->st_gid  = *gid;
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+file_chmod(file_t file, mode_t mode)
+{
+    error_t  err;
+    mode_t  *cur;
+    uid_t   *uid;
+    gid_t   *gid;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    err = file_owner(file, &cur, &uid, &gid);
+    if(!err && geteuid() && (geteuid() != *uid))
+        err = EPERM;
+    if(!err)
+        *cur = (*cur & S_IFMT) | (mode & ~S_IFMT);
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+file_chown(file_t file, uid_t uid, gid_t gid)
+{
+    error_t  err;
+    mode_t  *mode;
+    uid_t   *cur_uid;
+    gid_t   *cur_gid;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    err = file_owner(file, &mode, &cur_uid, &cur_gid);
+    if(!err && geteuid())
+        err = EPERM;
+    if(!err)
+    {
+        if(uid != (uid_t) -1)
+            *cur_uid = uid;
+        if(gid != (gid_t) -1)
+            *cur_gid = gid;
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+fsys_getroot(fsys_t fsys, mach_port_t dotdot,
+             mach_msg_type_name_t dotdot_type, idarray_t uids,
+             mach_msg_type_number_t nuids, idarray_t gids,
+             mach_msg_type_number_t ngids, int flags, retry_type *retry,
+             string_t retry_name, file_t *file)
+{
+    error_t            err = 0;
+    struct translator *t;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_port(fsys);
+    if(!t || !t->alive)
+        err = MACH_SEND_INVALID_DEST;
+    else
+    {
+        *retry        = FS_RETRY_NORMAL;
+        retry_name[0] = '\0';
+        *file         = ROOT_BASE + (t - translators);
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+fsys_goaway(fsys_t fsys, int flags)
+{
+    error_t            err = 0;
+    struct translator *t;
+
+    stand_in_call(STAND_IN_GOAWAY);
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_port(fsys);
+    if(!t || !t->alive)
+        err = MACH_SEND_INVALID_DEST;
+    else
+        err = translator_goaway(t, flags);
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+fsys_syncfs(fsys_t fsys, int wait, int do_children)
+{
+    error_t            err = 0;
+    struct translator *t;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_port(fsys);
+    if(!t || !t->alive)
+        err = MACH_SEND_INVALID_DEST;
+    else
+        translators_synced++;
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+error_t
+fsys_get_options(fsys_t fsys, char **options, size_t *options_len)
+{
+    error_t            err = 0;
+    struct translator *t;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_port(fsys);
+    if(!t || !t->alive)
+        err = MACH_SEND_INVALID_DEST;
+    else
+        err = stand_in_reply(t->argz, t->argz_len, options, options_len);
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+/* Return the name of the option switch SW stands for, of length *LEN: the
+   part before any `=', with the two forms of the read-only and sync
+   switches taken as one. */
+static const char *
+switch_key(const char *sw, size_t *len)
+{
+    static const char *const rw[] =
+        { "--readonly", "--ro", "-r", "--writable", "--rw", "-w", NULL };
+    static const char *const sync[] =
+        { "--sync", "--no-sync", "-s", "-n", NULL };
+
+    for(size_t i = 0; rw[i]; i++)
+        if(strcmp(sw, rw[i]) == 0)
+        {
+            *len = 2;
+            return "rw";
+        }
+    for(size_t i = 0; sync[i]; i++)
+        if((strcmp(sw, sync[i]) == 0) || (strncmp(sw, "--sync=", 7) == 0))
+        {
+            *len = 4;
+            return "sync";
+        }
+    *len = strchrnul(sw, '=') - sw;
+    return sw;
+}
+
+static bool
+switch_same(const char *a, const char *b)
+{
+    size_t      alen, blen;
+    const char *akey = switch_key(a, &alen);
+    const char *bkey = switch_key(b, &blen);
+
+    return (alen == blen) && (memcmp(akey, bkey, alen) == 0);
+}
+
+/* The switches in OPTIONS replace those of the same name; the others are
+   added in front of the device, which stays last. */
+error_t
+fsys_set_options(fsys_t fsys, const char *options, size_t options_len,
+                 int do_children)
+{
+    error_t            err = 0;
+    struct translator *t;
+    char              *argz;
+    char              *out;
+    const char        *dev;
+
+    stand_in_call(STAND_IN_RPC);
+    pthread_mutex_lock(&stand_in_lock);
+    t = translator_port(fsys);
+    if(!t || !t->alive)
+    {
+        err = MACH_SEND_INVALID_DEST;
+        goto end_set_options;
+    }
+
+    argz = malloc(t->argz_len + options_len);
+    if(!argz)
+    {
+        err = ENOMEM;
+        goto end_set_options;
+    }
+    t->set_options++;
+    free(t->options);
+    t->options_len = 0;
+    t->options     = malloc(options_len ?: 1);
+    if(t->options)
+    {
+        memcpy(t->options, options, options_len);
+        t->options_len = options_len;
+    }
+    /* The program, then the switches that stay, then the new ones. */
+    dev = t->argz;
+    for(const char *p = t->argz; p < t->argz + t->argz_len;
+        p += strlen(p) + 1)
+        dev = p;
+    out = stpcpy(argz, t->argz) + 1;
+    for(const char *p = t->argz + strlen(t->argz) + 1; p < dev;
+        p += strlen(p) + 1)
+    {
+        bool replaced = false;
+
+        for(const char *o = options; o < options + options_len;
+            o += strlen(o) + 1)
+            if(switch_same(p, o))
+                replaced = true;
+        if(!replaced)
+            out = stpcpy(out, p) + 1;
+    }
+    memcpy(out, options, options_len);
+    out += options_len;
+    if(dev != t->argz)
+        out = stpcpy(out, dev) + 1;
+
+    free(t->argz);
+    t->argz     = argz;
+    t->argz_len = out - argz;
+
+end_set_options:
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+/* sutils. */
+
+error_t
+fstypes_create(const char *search_fmts, size_t search_fmts_len,
+               struct fstypes **types)
+{
+    struct fstypes *t = calloc(1, sizeof(*t));
+
+    if(!t)
+        return ENOMEM;
+    t->program_search_fmts = malloc(search_fmts_len ?: 1);
+    if(!t->program_search_fmts)
+    {
+        free(t);
+        return ENOMEM;
+    }
+    memcpy(t->program_search_fmts, search_fmts, search_fmts_len);
+    t->program_search_fmts_len = search_fmts_len;
+    *types = t;
+    return 0;
+}
+
+error_t
+fstypes_get(struct fstypes *types, const char *name, struct fstype **fstype)
+{
+    struct fstype *type;
+    const char    *fmts = types->program_search_fmts;
+    const char    *end  = fmts + types->program_search_fmts_len;
+
+    for(type = types->entries; type; type = type->next)
+        if(strcasecmp(type->name, name) == 0)
+        {
+            *fstype = type;
+            return 0;
+        }
+
+    type = calloc(1, sizeof(*type));
+    if(!type || !(type->name = strdup(name)))
+    {
+        free(type);
+        return ENOMEM;
+    }
+    for(const char *fmt = fmts; fmts && (fmt < end) && !type->program;
+        fmt += strlen(fmt) + 1)
+    {
+        char program[PATH_MAX];
+
+        snprintf(program, sizeof(program), fmt, name);
+        for(size_t i = 0; stand_in_programs[i]; i++)
+            if(strcmp(stand_in_programs[i], program) == 0)
+                type->program = strdup(program);
+    }
+    type->next     = types->entries;
+    types->entries = type;
+    *fstype        = type;
+    return 0;
+}
+
+error_t
+fstab_create(struct fstypes *types, struct fstab **fstab)
+{
+    struct fstab *f = calloc(1, sizeof(*f));
+
+    if(!f)
+        return ENOMEM;
+    f->types = types;
+    *fstab   = f;
+    return 0;
+}
+
+void
+fs_free(struct fs *fs)
+{
+    struct fstab *fstab = fs->fstab;
+
+    *fs->self = fs->next;
+    if(fs->next)
+        fs->next->self = fs->self;
+    else
+        fstab->tail = fs->self;
+    if(fstab->hash_size)
+    {
+        struct fs **prev = &fstab->hash[path_hash(fs->mntent.mnt_dir)
+                                        % fstab->hash_size];
+
+        while(*prev != fs)
+            prev = &(*prev)->hash_next;
+        *prev = fs->hash_next;
+    }
+    fstab->count--;
+    free(fs->storage);
+    free(fs);
+}
+
+void
+fstab_free(struct fstab *fstab)
+{
+    while(fstab->entries)
+        fs_free(fstab->entries);
+    free(fstab->hash);
+    free(fstab);
+}
+
+struct fs *
+fstab_find_mount(const struct fstab *fstab, const char *name)
+{
+    if(!fstab->hash_size)
+        return NULL;
+    for(struct fs *fs = fstab->hash[path_hash(name) % fstab->hash_size]; fs;
+        fs = fs->hash_next)
+        if(strcmp(fs->mntent.mnt_dir, name) == 0)
+            return fs;
+    return NULL;
+}
+
+struct fs *
+fstab_find_device(const struct fstab *fstab, const char *name)
+{
+    for(struct fs *fs = fstab->entries; fs; fs = fs->next)
+        if(strcmp(fs->mntent.mnt_fsname, name) == 0)
+            return fs;
+    return NULL;
+}
+
+/* Grow FSTAB's hash for one more entry. */
+static error_t
+fstab_hash_grow(struct fstab *fstab)
+{
+    size_t      size;
+    struct fs **hash;
+
+    if(fstab->count < fstab->hash_size)
+        return 0;
+    size = fstab->hash_size ? 2 * fstab->hash_size : 64;
+    hash = calloc(size, sizeof(*hash));
+    if(!hash)
+        return ENOMEM;
+    for(struct fs *fs = fstab->entries; fs; fs = fs->next)
+    {
+        struct fs **b = &hash[path_hash(fs->mntent.mnt_dir) % size];
+
+        fs->hash_next = *b;
+        *b = fs;
+    }
+    free(fstab->hash);
+    fstab->hash      = hash;
+    fstab->hash_size = size;
+    return 0;
+}
+
+/* Entries replace the one on the same mount point, or are added at the
+   end. */
+error_t
+fstab_add_mntent(struct fstab *fstab, const struct mntent *mntent,
+                 struct fs **result)
+{
+    const char *strs[4] =
+        { mntent->mnt_fsname ?: "", mntent->mnt_dir ?: "",
+          mntent->mnt_type ?: "", mntent->mnt_opts ?: "" };
+    size_t      lens[4];
+    size_t      total = 0;
+    struct fs  *fs    = fstab_find_mount(fstab, strs[1]);
+    char       *storage;
+    char       *p;
+
+    for(int i = 0; i < 4; i++)
+        total += lens[i] = strlen(strs[i]) + 1;
+    storage = malloc(total);
+    if(!storage)
+        return ENOMEM;
+    p = storage;
+    for(int i = 0; i < 4; i++)
+    {
+        memcpy(p, strs[i], lens[i]);
+        p += lens[i];
+    }
+
+    if(!fs)
+    {
+        struct fs **tail;
+        error_t     err = fstab_hash_grow(fstab);
+
+        if(!err && !(fs = calloc(1, sizeof(*fs))))
+            err = ENOMEM;
+        if(err)
+        {
+            free(storage);
+            return err;
+        }
+        tail      = fstab->tail ?: &fstab->entries;
+        fs->fstab = fstab;
+        fs->self  = tail;
+        *tail     = fs;
+        fstab->tail = &fs->next;
+        fstab->count++;
+    }
+    else
+    {
+        struct fs **prev = &fstab->hash[path_hash(fs->mntent.mnt_dir)
+                                        % fstab->hash_size];
+
+        while(*prev != fs)
+            prev = &(*prev)->hash_next;
+        *prev = fs->hash_next;
+        free(fs->storage);
+    }
+
+    fs->storage           = storage;
+    fs->mntent            = *mntent;
+    fs->mntent.mnt_fsname = storage;
+    fs->mntent.mnt_dir    = storage + lens[0];
+    fs->mntent.mnt_type   = storage + lens[0] + lens[1];
+    fs->mntent.mnt_opts   = storage + lens[0] + lens[1] + lens[2];
+    fs->type              = NULL;
+    fs->mounted           = MACH_PORT_NULL;
+    {
+        struct fs **b = &fstab->hash[path_hash(fs->mntent.mnt_dir)
+                                     % fstab->hash_size];
+
+        fs->hash_next = *b;
+        *b = fs;
+    }
+    if(result)
+        *result = fs;
+    return 0;
+}
+
+error_t
+fstab_read(struct fstab *fstab, const char *name)
+{
+    error_t        err  = 0;
+    FILE          *file = setmntent(name, "r");
+    struct mntent *mnt;
+
+    if(!file)
+        return errno;
+    while(!err && (mnt = getmntent(file)))
+        err = fstab_add_mntent(fstab, mnt, NULL);
+    endmntent(file);
+    return err;
+}
+
+error_t
+fs_type(struct fs *fs, struct fstype **type)
+{
+    error_t err = 0;
+
+    stand_in_call(STAND_IN_FSTYPE);
+    if(!fs->type)
+    {
+        if(strcmp(fs->mntent.mnt_type, "auto") == 0)
+            return EFTYPE;
+        err = fstypes_get(fs->fstab->types, fs->mntent.mnt_type, &fs->type);
+    }
+    if(!err)
+        *type = fs->type;
+    return err;
+}
+
+error_t
+fs_fsys(struct fs *fs, fsys_t *fsys)
+{
+    file_t  node;
+    error_t err;
+
+    stand_in_call(STAND_IN_FSYS);
+    node = file_name_lookup(fs->mntent.mnt_dir, O_NOTRANS, 0);
+    if(node == MACH_PORT_NULL)
+        return errno;
+    err = file_get_translator_cntl(node, fsys);
+    if(err == ENXIO)
+    {
+        *fsys = MACH_PORT_NULL;
+        err   = 0;
+    }
+    return err;
+}
+
+/* As sutils does, through the options of the running translator. */
+error_t
+fs_set_readonly(struct fs *fs, int readonly)
+{
+    static const char ro[] = "--readonly", rw[] = "--writable";
+    fsys_t            fsys;
+    error_t           err;
+
+    err = fs_fsys(fs, &fsys);
+    if(err || (fsys == MACH_PORT_NULL))
+        return err;
+    err = fsys_set_options(fsys, readonly ? ro : rw,
+                           readonly ? sizeof(ro) : sizeof(rw), 0);
+    if(!err)
+        fs->readonly = readonly;
+    mach_port_deallocate(mach_task_self(), fsys);
+    return err;
+}
+
+/* As sutils parses the filesystems named on the command line.  Only
+   bench-fstab uses it. */
+static const struct argp_option fstab_argp_opts[] =
+{
+    {"all", 'a', 0, 0, "Do all filesystems in " _PATH_MNTTAB, 0},
+    {"fstab", 'F', "FILE", 0, "File to use instead of " _PATH_MNTTAB, 0},
+    {"types", 't', "TYPE", 0, "Do only filesystems of given type(s)", 0},
+    {"exclude", 'x', "PATTERN", 0, "Exclude directories matching PATTERN",
+     0},
+    {0}
+};
+
+static error_t
+fstab_argp_parse(int key, char *arg, struct argp_state *state)
+{
+    struct fstab_argp_params *params = state->input;
+
+    switch(key)
+    {
+    case ARGP_KEY_INIT:
+        memset(params, 0, sizeof(*params));
+        return 0;
+    case 'a':
+        params->do_all = 1;
+        return 0;
+    case 'F':
+        params->fstab_path = arg;
+        return 0;
+    case 't':
+        return argz_add_sep(&params->types, &params->types_len, arg, ',');
+    case 'x':
+        return argz_add_sep(&params->exclude, &params->exclude_len, arg,
+                            ',');
+    case ARGP_KEY_ARG:
+        return argz_add(&params->names, &params->names_len, arg);
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+}
+
+const struct argp fstab_argp = { fstab_argp_opts, fstab_argp_parse };
+
+/* Read the fstab of PARAMS and keep the entries it names.  Unlike sutils,
+   names it does not list are skipped rather than fatal. */
+struct fstab *
+fstab_argp_create(struct fstab_argp_params *params,
+                  const char *default_search_fmts,
+                  size_t default_search_fmts_len)
+{
+    error_t         err;
+    struct fstypes *types;
+    struct fstab   *fstab = NULL;
+    struct fstab   *all;
+
+    if(params->program_search_fmts_len)
+        err = fstypes_create(params->program_search_fmts,
+                             params->program_search_fmts_len, &types);
+    else
+        err = fstypes_create(default_search_fmts, default_search_fmts_len,
+                             &types);
+    if(err)
+        return NULL;
+    err = fstab_create(types, &all);
+    if(err)
+        return NULL;
+    err = fstab_read(all, params->fstab_path ?: _PATH_MNTTAB);
+    if(err && (err != ENOENT))
+    {
+        fstab_free(all);
+        return NULL;
+    }
+    if(params->do_all || !params->names_len)
+        return all;
+
+    err = fstab_create(types, &fstab);
+    for(char *name = params->names; !err && name;
+        name = argz_next(params->names, params->names_len, name))
+    {
+        struct fs *fs = fstab_find_mount(all, name);
+
+        if(!fs)
+            fs = fstab_find_device(all, name);
+        if(fs)
+            err = fstab_add_mntent(fstab, &fs->mntent, NULL);
+    }
+    fstab_free(all);
+    if(err && fstab)
+    {
+        fstab_free(fstab);
+        fstab = NULL;
+    }
+    return fstab;
+}
+
+/* Control. */
+
+/* Return the node of DIR, or NULL.  Called with stand_in_lock held. */
+static struct node *
+node_dir(const char *dir)
+{
+    char path[PATH_MAX];
+
+    if(path_canon(dir, path))
+        return NULL;
+    return node_find(path, false);
+}
+
+/* Copy the LEN bytes at DATA to a new *ARGZ. */
+static bool
+stand_in_copy(const char *data, size_t len, char **argz, size_t *argz_len)
+{
+    if(!argz)
+        return true;
+    *argz = malloc(len ?: 1);
+    if(!*argz)
+        return false;
+    memcpy(*argz, data, len);
+    *argz_len = len;
+    return true;
+}
+
+bool
+stand_in_active(const char *dir, char **argz, size_t *argz_len)
+{
+    struct node       *node;
+    struct translator *t    = NULL;
+    bool               ok   = false;
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_dir(dir);
+    if(node && (t = node_active(node)))
+        ok = stand_in_copy(t->argz, t->argz_len, argz, argz_len);
+    pthread_mutex_unlock(&stand_in_lock);
+    return ok;
+}
+
+bool
+stand_in_passive(const char *dir, char **argz, size_t *argz_len)
+{
+    struct node *node;
+    bool         ok = false;
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_dir(dir);
+    if(node && node->passive_len)
+        ok = stand_in_copy(node->passive, node->passive_len, argz,
+                           argz_len);
+    pthread_mutex_unlock(&stand_in_lock);
+    return ok;
+}
+
+unsigned long
+stand_in_options(const char *dir, char **argz, size_t *argz_len)
+{
+    struct node       *node;
+    struct translator *t     = NULL;
+    unsigned long      calls = 0;
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_dir(dir);
+    if(node && (t = node_active(node)))
+    {
+        calls = t->set_options;
+        if(!stand_in_copy(t->options ?: "", t->options_len, argz,
+                          argz_len))
+            calls = 0;
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return calls;
+}
+
+int
+stand_in_set_busy(const char *dir, bool busy)
+{
+    struct node       *node;
+    struct translator *t   = NULL;
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_dir(dir);
+    if(node && (t = node_active(node)))
+        t->busy = busy;
+    pthread_mutex_unlock(&stand_in_lock);
+    return t ? 0 : ENXIO;
+}
+
+int
+stand_in_goaway(const char *dir, int flags)
+{
+    error_t            err = ENXIO;
+    struct node       *node;
+    struct translator *t;
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_dir(dir);
+    if(node && (t = node_active(node)))
+        err = translator_goaway(t, flags);
+    pthread_mutex_unlock(&stand_in_lock);
+    return err;
+}
+
+int
+stand_in_set_owner(const char *dir, mode_t mode, uid_t uid, gid_t gid)
+{
+    char         path[PATH_MAX];
+    error_t      err;
+    struct node *node = NULL;
+
+    err = path_canon(dir, path);
+    if(err)
+        return err;
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_find(path, true);
+    if(node)
+    {
+        node->mode = (node->mode & S_IFMT) | (mode & ~S_IFMT);
+        node->uid  = uid;
+        node->gid  = gid;
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return node ? 0 : ENOMEM;
+}
+
+int
+stand_in_root_owner(const char *dir, mode_t *mode, uid_t *uid, gid_t *gid)
+{
+    struct node       *node;
+    struct translator *t   = NULL;
+
+    pthread_mutex_lock(&stand_in_lock);
+    node = node_dir(dir);
+    if(node && (t = node_active(node)))
+    {
+        *mode = t->root_mode;
+        *uid  = t->root_uid;
+        *gid  = t->root_gid;
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return t ? 0 : ENXIO;
+}
+
+size_t
+stand_in_release(bool exit)
+{
+    size_t n = 0;
+
+    pthread_mutex_lock(&stand_in_lock);
+    for(size_t i = 0; i < ntranslators; i++)
+    {
+        struct translator *t = &translators[i];
+
+        if(!t->used || !t->alive || !t->busy)
+            continue;
+        t->busy = false;
+        if(exit)
+            translator_goaway(t, FSYS_GOAWAY_FORCE);
+        n++;
+    }
+    pthread_mutex_unlock(&stand_in_lock);
+    return n;
+}
+
+size_t
+stand_in_running(void)
+{
+    size_t n;
+
+    pthread_mutex_lock(&stand_in_lock);
+    n = translators_running;
+    pthread_mutex_unlock(&stand_in_lock);
+    return n;
+}
+
+size_t
+stand_in_ports(void)
+{
+    size_t n;
+
+    pthread_mutex_lock(&stand_in_lock);
+    n = translators_used;
+    pthread_mutex_unlock(&stand_in_lock);
+    return n;
+}
+
+unsigned long
+stand_in_syncs(void)
+{
+    unsigned long n;
+
+    pthread_mutex_lock(&stand_in_lock);
+    n = translators_synced;
+    pthread_mutex_unlock(&stand_in_lock);
+    return n;
+}
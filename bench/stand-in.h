@@ -0,0 +1,97 @@
+/* bench/stand-in.h
+   Control of the in-process stand-ins for the Mach and Hurd calls of the
+   mount(2) library.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef _STAND_IN_H
+#define _STAND_IN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* The calls whose latency can be set.  STAND_IN_RPC covers every RPC
+   that is not one of the others. */
+enum stand_in_call
+{
+    STAND_IN_LOOKUP,            /* file_name_lookup */
+    STAND_IN_START,             /* fshelp_start_translator_long */
+    STAND_IN_SET_TRANSLATOR,    /* file_set_translator */
+    STAND_IN_GOAWAY,            /* fsys_goaway */
+    STAND_IN_FSYS,              /* fs_fsys */
+    STAND_IN_FSTYPE,            /* fs_type */
+    STAND_IN_RPC,
+    STAND_IN_CALLS
+};
+
+/* Make each CALL take NS nanoseconds longer, spent asleep as the caller
+   of an RPC would be. */
+void stand_in_set_latency(enum stand_in_call call, unsigned long ns);
+
+/* Return how many times CALL was made. */
+unsigned long stand_in_count(enum stand_in_call call);
+
+/* Return whether a translator is running on DIR, and if ARGZ is not null,
+   set it to a copy of its command line, to be released with free. */
+bool stand_in_active(const char *dir, char **argz, size_t *argz_len);
+
+/* The same for the passive translator of DIR. */
+bool stand_in_passive(const char *dir, char **argz, size_t *argz_len);
+
+/* Return how many times the options of the translator running on DIR
+   were set, and if ARGZ is not null, set it to a copy of the last ones
+   sent, to be released with free.  Returns 0 if none is running there. */
+unsigned long stand_in_options(const char *dir, char **argz,
+                               size_t *argz_len);
+
+/* Make the translator on DIR refuse to go away without
+   FSYS_GOAWAY_FORCE while BUSY, as when its files are open.  Returns
+   ENXIO if none is running there. */
+int stand_in_set_busy(const char *dir, bool busy);
+
+/* Make the translator on DIR go away with FLAGS behind the library's
+   back, as `settrans -g' would. */
+int stand_in_goaway(const char *dir, int flags);
+
+/* Give the node of DIR MODE's permission bits, UID and GID. */
+int stand_in_set_owner(const char *dir, mode_t mode, uid_t uid, gid_t gid);
+
+/* Set *MODE, *UID and *GID to those of the root of the translator on DIR.
+   Returns ENXIO if none is running there. */
+int stand_in_root_owner(const char *dir, mode_t *mode, uid_t *uid,
+                        gid_t *gid);
+
+/* Let every busy translator, attached or not, go away when asked
+   (EXIT false), or make each go away on its own (EXIT true).  Returns how many
+   there were. */
+size_t stand_in_release(bool exit);
+
+/* Return how many translators are running. */
+size_t stand_in_running(void);
+
+/* Return how many control port names are in use, for translators running
+   or dead, which is how many the library still holds rights to once no
+   translator runs. */
+size_t stand_in_ports(void);
+
+/* Return how many times a filesystem was synced, with fsys_syncfs or by
+   going away without FSYS_GOAWAY_NOSYNC. */
+unsigned long stand_in_syncs(void);
+
+#endif /* _STAND_IN_H */
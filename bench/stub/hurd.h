@@ -0,0 +1,89 @@
+/* Stand-in for <hurd.h>: the Mach and Hurd types, constants and RPCs the
+   mount library uses, implemented by stand-in.c for a Linux build. */
+
+#ifndef _STAND_IN_HURD_H
+#define _STAND_IN_HURD_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <mach.h>
+
+typedef mach_port_t file_t;
+typedef mach_port_t fsys_t;
+typedef mach_port_t io_t;
+typedef mach_port_t auth_t;
+typedef mach_port_t process_t;
+typedef uid_t      *idarray_t;
+typedef char        string_t[1024];
+
+/* How fsys_getroot's reply is to be followed. */
+typedef enum
+{
+    FS_RETRY_NORMAL = 1,
+    FS_RETRY_REAUTH,
+    FS_RETRY_MAGICAL
+} retry_type;
+
+/* Hurd-only error numbers, with their Hurd values. */
+#define EFTYPE          1073741903
+
+/* Hurd-only flags of file_name_lookup. */
+#define O_NOTRANS       0x40000000
+
+/* Flags of file_set_translator. */
+#define FS_TRANS_FORCE  1
+#define FS_TRANS_EXCL   2
+#define FS_TRANS_SET    4
+#define FS_TRANS_ORPHAN 8
+
+/* Flags of fsys_goaway. */
+#define FSYS_GOAWAY_NOWAIT  1
+#define FSYS_GOAWAY_NOSYNC  2
+#define FSYS_GOAWAY_FORCE   4
+#define FSYS_GOAWAY_UNLINK  8
+#define FSYS_GOAWAY_RECURSE 16
+
+/* Indices of the initial ports and ints of a translator. */
+#define INIT_PORT_CWDIR     0
+#define INIT_PORT_CRDIR     1
+#define INIT_PORT_AUTH      2
+#define INIT_PORT_PROC      3
+#define INIT_PORT_CTTYID    4
+#define INIT_PORT_BOOTSTRAP 5
+#define INIT_PORT_MAX       6
+#define INIT_UMASK          0
+#define INIT_INT_MAX        5
+
+extern file_t file_name_lookup(const char *file, int flags, mode_t mode);
+extern mach_port_t getcwdir(void);
+extern mach_port_t getcrdir(void);
+extern mach_port_t getauth(void);
+
+extern error_t file_set_translator(file_t file, int passive_flags,
+                                   int active_flags, int goaway_flags,
+                                   const char *passive, size_t passive_len,
+                                   mach_port_t active,
+                                   mach_msg_type_name_t active_type);
+extern error_t file_get_translator(file_t file, char **trans,
+                                   size_t *trans_len);
+extern error_t file_get_translator_cntl(file_t file, fsys_t *control);
+extern error_t file_chmod(file_t file, mode_t mode);
+extern error_t file_chown(file_t file, uid_t uid, gid_t gid);
+extern error_t io_stat(io_t io, struct stat *st);
+
+extern error_t fsys_goaway(fsys_t fsys, int flags);
+extern error_t fsys_getroot(fsys_t fsys, mach_port_t dotdot,
+                            mach_msg_type_name_t dotdot_type,
+                            idarray_t uids, mach_msg_type_number_t nuids,
+                            idarray_t gids, mach_msg_type_number_t ngids,
+                            int flags, retry_type *retry,
+                            string_t retry_name, file_t *file);
+extern error_t fsys_syncfs(fsys_t fsys, int wait, int do_children);
+extern error_t fsys_set_options(fsys_t fsys, const char *options,
+                                size_t options_len, int do_children);
+extern error_t fsys_get_options(fsys_t fsys, char **options,
+                                size_t *options_len);
+
+#endif /* _STAND_IN_HURD_H */
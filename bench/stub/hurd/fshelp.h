@@ -0,0 +1,24 @@
+/* Stand-in for <hurd/fshelp.h>: only the translator starting the mount
+   library uses. */
+
+#ifndef _STAND_IN_HURD_FSHELP_H
+#define _STAND_IN_HURD_FSHELP_H
+
+#include <hurd.h>
+
+typedef error_t (*fshelp_open_fn_t)(int flags, file_t *node,
+                                    mach_msg_type_name_t *node_type,
+                                    task_t task, void *cookie);
+
+extern error_t fshelp_start_translator_long(fshelp_open_fn_t underlying_open_fn,
+                                            void *cookie, char *name,
+                                            char *argz, int argz_len,
+                                            mach_port_t *fds,
+                                            mach_msg_type_name_t fds_type,
+                                            int fds_len, mach_port_t *ports,
+                                            mach_msg_type_name_t ports_type,
+                                            int ports_len, int *ints,
+                                            int ints_len, uid_t owner_uid,
+                                            int timeout, fsys_t *control);
+
+#endif /* _STAND_IN_HURD_FSHELP_H */
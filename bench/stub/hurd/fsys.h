@@ -0,0 +1,9 @@
+/* Stand-in for <hurd/fsys.h>; the fsys RPCs are in the stand-in
+   <hurd.h>. */
+
+#ifndef _STAND_IN_HURD_FSYS_H
+#define _STAND_IN_HURD_FSYS_H
+
+#include <hurd.h>
+
+#endif /* _STAND_IN_HURD_FSYS_H */
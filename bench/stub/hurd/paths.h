@@ -0,0 +1,8 @@
+/* Stand-in for <hurd/paths.h>. */
+
+#ifndef _STAND_IN_HURD_PATHS_H
+#define _STAND_IN_HURD_PATHS_H
+
+#define _HURD "/hurd/"
+
+#endif /* _STAND_IN_HURD_PATHS_H */
@@ -0,0 +1,93 @@
+/* Stand-in for <mach.h>: port names are plain numbers, and the only
+   messages are the dead-name notifications of stand-in.c. */
+
+#ifndef _STAND_IN_MACH_H
+#define _STAND_IN_MACH_H
+
+#include <errno.h>
+#include <stddef.h>
+
+typedef unsigned int mach_port_t;
+typedef unsigned int mach_port_type_t;
+typedef unsigned int mach_port_right_t;
+typedef unsigned int mach_msg_type_name_t;
+typedef unsigned int mach_msg_type_number_t;
+typedef unsigned int mach_msg_size_t;
+typedef unsigned int mach_msg_timeout_t;
+typedef unsigned int mach_msg_option_t;
+typedef int          mach_msg_return_t;
+typedef int          mach_msg_id_t;
+typedef mach_port_t  task_t;
+typedef unsigned long vm_address_t;
+typedef unsigned long vm_size_t;
+typedef int          boolean_t;
+
+#define TRUE  1
+#define FALSE 0
+
+#define MACH_PORT_NULL          ((mach_port_t) 0)
+#define MACH_PORT_DEAD          ((mach_port_t) ~0)
+#define MACH_PORT_VALID(name) \
+    (((name) != MACH_PORT_NULL) && ((name) != MACH_PORT_DEAD))
+
+#define MACH_PORT_RIGHT_SEND      0
+#define MACH_PORT_RIGHT_RECEIVE   1
+#define MACH_PORT_RIGHT_SEND_ONCE 2
+#define MACH_PORT_RIGHT_DEAD_NAME 4
+
+#define MACH_PORT_TYPE_SEND       (1 << 16)
+#define MACH_PORT_TYPE_RECEIVE    (1 << 17)
+#define MACH_PORT_TYPE_DEAD_NAME  (1 << 20)
+
+#define MACH_MSG_TYPE_MOVE_SEND      17
+#define MACH_MSG_TYPE_MOVE_SEND_ONCE 18
+#define MACH_MSG_TYPE_COPY_SEND      19
+#define MACH_MSG_TYPE_MAKE_SEND      20
+#define MACH_MSG_TYPE_MAKE_SEND_ONCE 21
+
+#define MACH_MSG_SUCCESS          0
+#define MACH_SEND_INVALID_DEST    0x10000003
+#define MACH_RCV_INVALID_NAME     0x10004002
+#define MACH_RCV_MSG              2
+#define MACH_MSG_TIMEOUT_NONE     0
+
+typedef struct
+{
+    unsigned int  msgh_bits;
+    unsigned int  msgh_size;
+    mach_port_t   msgh_remote_port;
+    mach_port_t   msgh_local_port;
+    unsigned int  msgh_seqno;
+    mach_msg_id_t msgh_id;
+} mach_msg_header_t;
+
+typedef struct
+{
+    unsigned int msgt_bits;
+} mach_msg_type_t;
+
+extern mach_port_t mach_task_self(void);
+extern error_t mach_port_allocate(task_t task, mach_port_right_t right,
+                                  mach_port_t *name);
+extern error_t mach_port_deallocate(task_t task, mach_port_t name);
+extern error_t mach_port_mod_refs(task_t task, mach_port_t name,
+                                  mach_port_right_t right, int delta);
+extern error_t mach_port_type(task_t task, mach_port_t name,
+                              mach_port_type_t *type);
+extern error_t mach_port_request_notification(task_t task, mach_port_t name,
+                                              mach_msg_id_t id,
+                                              unsigned int sync,
+                                              mach_port_t notify,
+                                              mach_msg_type_name_t notify_type,
+                                              mach_port_t *previous);
+extern mach_msg_return_t mach_msg(mach_msg_header_t *msg,
+                                  mach_msg_option_t option,
+                                  mach_msg_size_t send_size,
+                                  mach_msg_size_t rcv_size,
+                                  mach_port_t rcv_name,
+                                  mach_msg_timeout_t timeout,
+                                  mach_port_t notify);
+extern error_t vm_deallocate(task_t task, vm_address_t address,
+                             vm_size_t size);
+
+#endif /* _STAND_IN_MACH_H */
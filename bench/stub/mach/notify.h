@@ -0,0 +1,18 @@
+/* Stand-in for <mach/notify.h>. */
+
+#ifndef _STAND_IN_MACH_NOTIFY_H
+#define _STAND_IN_MACH_NOTIFY_H
+
+#include <mach.h>
+
+#define MACH_NOTIFY_PORT_DELETED 0101
+#define MACH_NOTIFY_DEAD_NAME    0110
+
+typedef struct
+{
+    mach_msg_header_t not_header;
+    mach_msg_type_t   not_type;
+    mach_port_t       not_port;
+} mach_dead_name_notification_t;
+
+#endif /* _STAND_IN_MACH_NOTIFY_H */
@@ -0,0 +1,93 @@
+/* Stand-in for hurd/sutils/fstab.h, laid out like the real one.  The
+   stand-in keeps a hash of the entries by mount point as well, in the
+   fields marked private, so that reading a large table is not quadratic
+   in the benchmarks; the real fstab_add_mntent searches the list. */
+
+#ifndef _STAND_IN_FSTAB_H
+#define _STAND_IN_FSTAB_H
+
+#include <argp.h>
+#include <mntent.h>
+#include <hurd.h>
+
+struct fs
+{
+    struct fstab  *fstab;       /* Containing fstab. */
+    struct mntent  mntent;      /* Mount entry from fstab file. */
+    char          *storage;     /* Storage for strings in MNTENT. */
+    struct fstype *type;        /* Only set if fs_type called. */
+    int            readonly, flags;
+    file_t         mounted;     /* Only set if fs_mounted called. */
+    struct fs     *next, **self;
+    struct fs     *hash_next;   /* Private to the stand-in. */
+};
+
+struct fstab
+{
+    struct fs     *entries;
+    struct fstypes *types;
+    struct fs    **hash;        /* Private to the stand-in. */
+    size_t         hash_size;
+    size_t         count;
+    struct fs    **tail;
+};
+
+struct fstype
+{
+    char          *name;        /* Malloced. */
+    char          *program;     /* Malloced. */
+    struct fstype *next;
+};
+
+struct fstypes
+{
+    struct fstype *entries;
+    char          *program_search_fmts;
+    size_t         program_search_fmts_len;
+};
+
+extern error_t fstypes_create(const char *search_fmts,
+                              size_t search_fmts_len,
+                              struct fstypes **types);
+extern error_t fstypes_get(struct fstypes *types, const char *name,
+                           struct fstype **fstype);
+
+extern error_t fstab_create(struct fstypes *types, struct fstab **fstab);
+extern void fstab_free(struct fstab *fstab);
+extern error_t fstab_add_mntent(struct fstab *fstab,
+                                const struct mntent *mntent,
+                                struct fs **result);
+extern error_t fstab_read(struct fstab *fstab, const char *name);
+extern struct fs *fstab_find_device(const struct fstab *fstab,
+                                    const char *name);
+extern struct fs *fstab_find_mount(const struct fstab *fstab,
+                                   const char *name);
+
+extern error_t fs_type(struct fs *fs, struct fstype **type);
+extern error_t fs_fsys(struct fs *fs, fsys_t *fsys);
+extern error_t fs_set_readonly(struct fs *fs, int readonly);
+extern void fs_free(struct fs *fs);
+
+/* Only used by bench-fstab, to measure how mount(2) built its fstab
+   before it created it directly. */
+struct fstab_argp_params
+{
+    char   *fstab_path;
+    char   *program_search_fmts;
+    size_t  program_search_fmts_len;
+    int     do_all;
+    char   *types;
+    size_t  types_len;
+    char   *exclude;
+    size_t  exclude_len;
+    char   *names;
+    size_t  names_len;
+};
+
+extern const struct argp fstab_argp;
+
+extern struct fstab *fstab_argp_create(struct fstab_argp_params *params,
+                                       const char *default_search_fmts,
+                                       size_t default_search_fmts_len);
+
+#endif /* _STAND_IN_FSTAB_H */
@@ -0,0 +1,208 @@
+/* bench/test-alloc.c
+   Check that mount and umount2 in a steady state leave the heap as they
+   found it.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* Cycles run before measuring, to fill the caches and go through one
+   compaction of the journal, and measured. */
+#define WARMUP 500
+#define CYCLES 1000
+
+/* Bytes and blocks the program has allocated and not freed.  The malloc
+   of glibc may be replaced by defining it; these put the size asked for
+   in a header before each block, since what glibc rounds it up to varies
+   with how the block was carved. */
+static long heap_bytes, heap_blocks;
+
+struct heap_header
+{
+    void   *base;
+    size_t  size;
+};
+
+#define HEAP_ALIGN 16
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void  __libc_free(void *ptr);
+
+void *
+memalign(size_t align, size_t size)
+{
+    struct heap_header *header;
+    char               *base;
+
+    if(align < HEAP_ALIGN)
+        align = HEAP_ALIGN;
+    base = (align == HEAP_ALIGN) ? __libc_malloc(size + align)
+                                 : __libc_memalign(align, size + align);
+    if(!base)
+        return NULL;
+    header       = (struct heap_header *) (base + align) - 1;
+    header->base = base;
+    header->size = size;
+    __atomic_add_fetch(&heap_bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&heap_blocks, 1, __ATOMIC_RELAXED);
+    return base + align;
+}
+
+void
+free(void *ptr)
+{
+    struct heap_header *header = (struct heap_header *) ptr - 1;
+
+    if(!ptr)
+        return;
+    __atomic_sub_fetch(&heap_bytes, header->size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&heap_blocks, 1, __ATOMIC_RELAXED);
+    __libc_free(header->base);
+}
+
+void *
+malloc(size_t size)
+{
+    return memalign(HEAP_ALIGN, size);
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+    void *ptr;
+
+    if(size && (n > SIZE_MAX / size))
+        return NULL;
+    ptr = malloc(n * size);
+    if(ptr)
+        memset(ptr, 0, n * size);
+    return ptr;
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    void   *new;
+    size_t  old;
+
+    if(!ptr)
+        return malloc(size);
+    old = ((struct heap_header *) ptr - 1)->size;
+    new = malloc(size);
+    if(!new)
+        return NULL;
+    memcpy(new, ptr, (old < size) ? old : size);
+    free(ptr);
+    return new;
+}
+
+void *
+aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+int
+posix_memalign(void **ptr, size_t align, size_t size)
+{
+    *ptr = memalign(align, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+size_t
+malloc_usable_size(void *ptr)
+{
+    return ptr ? ((struct heap_header *) ptr - 1)->size : 0;
+}
+
+static void
+cycle(size_t i)
+{
+    unsigned long flags = MS_REMOUNT | ((i & 1) ? 0 : MS_RDONLY);
+
+    if(mount("/dev/test", "/test/m", "ext2", 0, "") < 0)
+        error(1, errno, "mount");
+    if(mount(NULL, "/test/m", NULL, flags, NULL) < 0)
+        error(1, errno, "remount");
+    if(umount2("/test/m", 0) < 0)
+        error(1, errno, "umount2");
+    if(mount("/srv/vol1", "/test/m", "none", MS_BIND, "ro") < 0)
+        error(1, errno, "bind");
+    if(umount2("/test/m", 0) < 0)
+        error(1, errno, "umount2 of the bind mount");
+}
+
+/* Give the threads of the library time to finish what the last cycle
+   left them: compacting the journal, forgetting dead translators. */
+static void
+settle(void)
+{
+    struct timespec ts = { 0, 200 * 1000 * 1000 };
+
+    nanosleep(&ts, NULL);
+}
+
+int
+main(void)
+{
+    long bytes, blocks;
+    int  status = 0;
+
+    bench_reset();
+    bench_write_mtab(100);
+
+    for(size_t i = 0; i < WARMUP; i++)
+        cycle(i);
+    settle();
+    bytes  = __atomic_load_n(&heap_bytes, __ATOMIC_RELAXED);
+    blocks = __atomic_load_n(&heap_blocks, __ATOMIC_RELAXED);
+    for(size_t i = 0; i < CYCLES; i++)
+        cycle(i);
+    settle();
+    bytes  = __atomic_load_n(&heap_bytes, __ATOMIC_RELAXED) - bytes;
+    blocks = __atomic_load_n(&heap_blocks, __ATOMIC_RELAXED) - blocks;
+
+    if(bytes || blocks)
+    {
+        error(0, 0, "%ld bytes in %ld blocks more in use after %d cycles",
+              bytes, blocks, CYCLES);
+        status = 1;
+    }
+    if(stand_in_running())
+    {
+        error(0, 0, "%zu translators left running", stand_in_running());
+        status = 1;
+    }
+    if(stand_in_ports())
+    {
+        error(0, 0, "%zu rights to control ports left", stand_in_ports());
+        status = 1;
+    }
+    return status;
+}
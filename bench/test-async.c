@@ -0,0 +1,179 @@
+/* bench/test-async.c
+   Check that asynchronous requests run in the order they were queued, that
+   only those still queued can be cancelled, and that a callback may ask
+   for the result of its own request.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* The workers of mount-async.c. */
+#define WORKERS 4
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* What a callback was given, and the order it was called in. */
+struct call
+{
+    const char *name;
+    bool        hold;           /* Block until released. */
+    int         calls;
+    int         err;
+    int         order;
+};
+
+/* Posted once for each holder to let go of its worker. */
+static sem_t release;
+/* Posted by each holder once its callback runs. */
+static sem_t held;
+static int   order;
+
+static void
+done(struct mount_async *req, int err, void *cookie)
+{
+    struct call *call = cookie;
+
+    call->calls++;
+    call->err   = err;
+    call->order = __atomic_add_fetch(&order, 1, __ATOMIC_SEQ_CST);
+    /* Done already, so neither blocks. */
+    CHECK(mount_async_status(req) == err,
+          "the status of %s in its callback is not its result", call->name);
+    CHECK(mount_async_wait(req) == err,
+          "waiting for %s in its callback did not give its result",
+          call->name);
+    if(call->hold)
+    {
+        sem_post(&held);
+        while(sem_wait(&release) < 0)
+            ;
+    }
+}
+
+static struct mount_async *
+start(struct call *call)
+{
+    char                dir[64];
+    struct mount_async *req;
+
+    snprintf(dir, sizeof(dir), "/async/%s", call->name);
+    req = mount_async("/dev/async", dir, "ext2", 0, "", done, call);
+    if(!req)
+        error(1, errno, "mount_async %s", dir);
+    return req;
+}
+
+int
+main(void)
+{
+    struct call         holders[WORKERS];
+    struct mount_async *hreqs[WORKERS];
+    struct call         a = { "a" }, b = { "b" }, c = { "c" };
+    struct mount_async *areq, *breq, *creq;
+    char                dir[64];
+
+    bench_reset();
+    bench_write_mtab(10);
+    sem_init(&release, 0, 0);
+    sem_init(&held, 0, 0);
+
+    /* Tie up every worker in a callback. */
+    for(int i = 0; i < WORKERS; i++)
+    {
+        char *name = strdup("h0");
+
+        name[1] += i;
+        holders[i] = (struct call) { name, true };
+        hreqs[i]   = start(&holders[i]);
+    }
+    for(int i = 0; i < WORKERS; i++)
+        while(sem_wait(&held) < 0)
+            ;
+    for(int i = 0; i < WORKERS; i++)
+    {
+        CHECK(holders[i].err == 0, "mounting %s failed: %s",
+              holders[i].name, strerror(holders[i].err));
+        /* Started, and finished, long ago. */
+        CHECK(mount_async_cancel(hreqs[i]) == EBUSY,
+              "%s was cancelled once started", holders[i].name);
+    }
+
+    /* So these wait in the queue. */
+    areq = start(&a);
+    breq = start(&b);
+    creq = start(&c);
+    CHECK(mount_async_status(areq) == EINPROGRESS, "a is not in progress");
+    CHECK(mount_async_cancel(breq) == 0, "b could not be cancelled");
+    CHECK(b.calls == 1 && b.err == ECANCELED,
+          "the callback of b was called %d times with %s", b.calls,
+          strerror(b.err));
+    CHECK(mount_async_wait(breq) == ECANCELED, "b was not cancelled");
+    CHECK(mount_async_cancel(breq) == EBUSY, "b was cancelled twice");
+    CHECK(!stand_in_active("/async/b", NULL, NULL), "b was mounted");
+
+    /* One worker takes what is queued, in order. */
+    sem_post(&release);
+    CHECK(mount_async_wait(creq) == 0, "mounting c failed");
+    CHECK(mount_async_wait(areq) == 0, "mounting a failed");
+    CHECK(a.calls == 1 && c.calls == 1, "the callbacks of a and c were "
+          "called %d and %d times", a.calls, c.calls);
+    CHECK(a.order < c.order, "c was done before a");
+    CHECK(stand_in_active("/async/a", NULL, NULL)
+          && stand_in_active("/async/c", NULL, NULL),
+          "a and c were not mounted");
+
+    for(int i = 1; i < WORKERS; i++)
+        sem_post(&release);
+    for(int i = 0; i < WORKERS; i++)
+    {
+        CHECK(mount_async_wait(hreqs[i]) == 0, "mounting %s failed",
+              holders[i].name);
+        mount_async_free(hreqs[i]);
+        snprintf(dir, sizeof(dir), "/async/%s", holders[i].name);
+        if(umount2(dir, 0) < 0)
+            error(1, errno, "umount2 %s", dir);
+        free((char *) holders[i].name);
+    }
+    mount_async_free(areq);
+    mount_async_free(breq);
+    mount_async_free(creq);
+    if((umount2("/async/a", 0) < 0) || (umount2("/async/c", 0) < 0))
+        error(1, errno, "umount2");
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/* bench/test-batch.c
+   Check that umount_batch syncs each filesystem once, before any goes
+   away, and reports the ones that would not go one by one.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+#define N     8
+/* Each sync is made to take this long, in nanoseconds. */
+#define SYNC  (2 * 1000 * 1000)
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static char        names[N][32];
+static const char *targets[N];
+
+static void
+mount_all(void)
+{
+    for(size_t i = 0; i < N; i++)
+        if(mount("/dev/batch", targets[i], "ext2", 0, "") < 0)
+            error(1, errno, "mount %s", targets[i]);
+}
+
+int
+main(void)
+{
+    struct umount_batch_times times;
+    int                       results[N];
+    unsigned long             syncs;
+
+    bench_reset();
+    bench_write_mtab(10);
+    for(size_t i = 0; i < N; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "/batch/%zu", i);
+        targets[i] = names[i];
+    }
+
+    /* One sync each, none of them again as it goes away. */
+    mount_all();
+    stand_in_set_latency(STAND_IN_RPC, SYNC);
+    syncs = stand_in_syncs();
+    CHECK(umount_batch(targets, N, 0, results, &times) == 0,
+          "umount_batch failed: %s", strerror(errno));
+    stand_in_set_latency(STAND_IN_RPC, 0);
+    CHECK(stand_in_syncs() - syncs == N, "%lu syncs for %d filesystems",
+          stand_in_syncs() - syncs, N);
+    for(size_t i = 0; i < N; i++)
+        CHECK(results[i] == 0, "%s failed: %s", targets[i],
+              strerror(results[i]));
+    CHECK(times.sync_ns >= SYNC, "the sync phase took %llu ns",
+          times.sync_ns);
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+
+    /* A busy one fails on its own, synced all the same. */
+    mount_all();
+    stand_in_set_busy(targets[3], true);
+    syncs = stand_in_syncs();
+    CHECK(umount_batch(targets, N, 0, results, NULL) < 0 && errno == EBUSY,
+          "umount_batch with a busy filesystem did not fail with EBUSY");
+    CHECK(stand_in_syncs() - syncs == N, "%lu syncs for %d filesystems",
+          stand_in_syncs() - syncs, N);
+    for(size_t i = 0; i < N; i++)
+        CHECK(results[i] == ((i == 3) ? EBUSY : 0), "%s gave %s",
+              targets[i], strerror(results[i]));
+    CHECK(stand_in_running() == 1, "%zu translators left running",
+          stand_in_running());
+    stand_in_set_busy(targets[3], false);
+    if(umount2(targets[3], 0) < 0)
+        error(1, errno, "umount2 %s", targets[3]);
+
+    /* Nor with UMOUNT_NOSYNC. */
+    mount_all();
+    syncs = stand_in_syncs();
+    CHECK(umount_batch(targets, N, UMOUNT_NOSYNC, results, &times) == 0,
+          "umount_batch with UMOUNT_NOSYNC failed: %s", strerror(errno));
+    CHECK(stand_in_syncs() == syncs, "%lu syncs with UMOUNT_NOSYNC",
+          stand_in_syncs() - syncs);
+    CHECK(times.sync_ns == 0, "a sync phase ran with UMOUNT_NOSYNC");
+    return failures ? 1 : 0;
+}
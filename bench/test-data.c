@@ -0,0 +1,189 @@
+/* bench/test-data.c
+   Check that a struct mount_data is told from a string by its magic, is
+   refused when of another version, and passes the translator only the
+   fields set in its bitmap; and that mount_data_dup copies it whole.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argz.h>
+#include <errno.h>
+#include <error.h>
+#include <mntent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+/* For mount_data_dup. */
+#include "mount-priv.h"
+
+#define DIR "/data"
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Return the command line of the translator on DIR, with spaces between
+   its words, to be released with free. */
+static char *
+command_line(void)
+{
+    char   *argz = NULL;
+    size_t  len  = 0;
+
+    if(!stand_in_active(DIR, &argz, &len))
+        error(1, 0, "nothing is running on " DIR);
+    argz_stringify(argz, len, ' ');
+    return argz;
+}
+
+/* Return the options DIR is recorded with, to be released with free. */
+static char *
+recorded_opts(struct mount_watch *watch)
+{
+    struct mntent *entries;
+    size_t         n;
+    char          *opts = NULL;
+
+    if(mount_watch_resync(watch, &entries, &n, NULL) < 0)
+        error(1, errno, "mount_watch_resync");
+    for(size_t i = 0; i < n; i++)
+        if(strcmp(entries[i].mnt_dir, DIR) == 0)
+            opts = strdup(entries[i].mnt_opts);
+    free(entries);
+    if(!opts)
+        error(1, 0, DIR " is not in the table");
+    return opts;
+}
+
+/* Check that mounting with MD fails with EINVAL. */
+static void
+check_refused(const struct mount_data *md, const char *what)
+{
+    if(mount("/dev/data", DIR, "ext2", 0, md) == 0)
+    {
+        CHECK(0, "a struct mount_data with %s was mounted", what);
+        umount2(DIR, 0);
+    }
+    else
+        CHECK(errno == EINVAL, "a struct mount_data with %s failed with %s",
+              what, strerror(errno));
+}
+
+int
+main(void)
+{
+    struct mount_data   md = MOUNT_DATA_INIT;
+    struct mount_data   bad;
+    struct mount_data  *copy;
+    struct mount_watch *watch;
+    char                extra[] = "rsize=1024,noatime";
+    char               *line, *opts;
+
+    bench_reset();
+    bench_write_mtab(10);
+    watch = mount_watch_open();
+    if(!watch)
+        error(1, errno, "mount_watch_open");
+
+    bad = md;
+    bad.version++;
+    check_refused(&bad, "a later version");
+    bad = md;
+    bad.size = sizeof(bad) - 1;
+    check_refused(&bad, "too small a size");
+    bad = md;
+    bad.fields = MOUNT_DATA_CACHE_SIZE << 1;
+    check_refused(&bad, "an unknown field");
+    bad = md;
+    bad.opts = MOUNT_DATA_LOOP << 1;
+    check_refused(&bad, "an unknown option");
+
+    /* Shorter than the magic, and only ever read as a string. */
+    CHECK(mount("/dev/data", DIR, "ext2", 0, "\177M") == 0,
+          "a string like the magic was not mounted: %s", strerror(errno));
+    umount2(DIR, 0);
+
+    /* Only the fields in the bitmap are passed, ahead of the words of
+       EXTRA, which may override them. */
+    md.fields = MOUNT_DATA_RSIZE | MOUNT_DATA_UID;
+    md.flags  = MS_RDONLY;
+    md.rsize  = 4096;
+    md.wsize  = 8192;
+    md.uid    = 1000;
+    md.gid    = 100;
+    if(mount("/dev/data", DIR, "ext2", 0, &md) < 0)
+        error(1, errno, "mount " DIR);
+    line = command_line();
+    CHECK(strstr(line, " --rsize=4096 ") && strstr(line, " --uid=1000 ")
+          && !strstr(line, "--wsize") && !strstr(line, "--gid")
+          && strstr(line, " --ro "),
+          "a struct mount_data was passed as \"%s\"", line);
+    free(line);
+    opts = recorded_opts(watch);
+    CHECK(strcmp(opts, "ro,rsize=4096,uid=1000") == 0,
+          "a struct mount_data was recorded as \"%s\"", opts);
+    free(opts);
+    umount2(DIR, 0);
+
+    md.extra = extra;
+    if(mount("/dev/data", DIR, "ext2", 0, &md) < 0)
+        error(1, errno, "mount " DIR);
+    line = command_line();
+    CHECK(strstr(line, "--rsize=4096 --uid=1000 --rsize=1024 --noatime"),
+          "a struct mount_data with extra words was passed as \"%s\"",
+          line);
+    free(line);
+    umount2(DIR, 0);
+
+    /* One block, which the original can change under no longer. */
+    CHECK(mount_data_dup(&md, (void **) &copy) == 0, "mount_data_dup: %s",
+          strerror(errno));
+    md.rsize = 1;
+    extra[0] = 'w';
+    CHECK(copy->rsize == 4096 && copy->fields == md.fields
+          && copy->size == sizeof(*copy)
+          && copy->extra == (const char *) (copy + 1)
+          && strcmp(copy->extra, "rsize=1024,noatime") == 0,
+          "mount_data_dup did not copy the structure whole");
+    free(copy);
+
+    CHECK(mount_data_dup("ro,sync", (void **) &copy) == 0
+          && strcmp((char *) copy, "ro,sync") == 0,
+          "mount_data_dup did not copy a string");
+    free(copy);
+    CHECK(mount_data_dup(NULL, (void **) &copy) == 0 && !copy,
+          "mount_data_dup of nothing made a copy");
+    bad = md;
+    bad.version++;
+    CHECK(mount_data_dup(&bad, (void **) &copy) == EINVAL && !copy,
+          "mount_data_dup copied a later version");
+
+    mount_watch_close(watch);
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+/* bench/test-detach.c
+   Check that umount2 with MNT_DETACH keeps asking a busy translator to go
+   away until it does or dies.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* How long the reaper is given to notice, in milliseconds. */
+#define WAIT 3000
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static void
+sleep_ms(long ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000 * 1000 };
+
+    nanosleep(&ts, NULL);
+}
+
+/* Wait for the detach of TARGET to finish, and return how. */
+static int
+wait_detach(const char *target)
+{
+    int err = EINPROGRESS;
+
+    for(long ms = 0; (err == EINPROGRESS) && (ms < WAIT); ms += 10)
+    {
+        err = umount_detach_status(target);
+        if(err == EINPROGRESS)
+            sleep_ms(10);
+    }
+    return err;
+}
+
+/* Detach TARGET while its translator is busy, then let it go with
+   stand_in_release (EXIT). */
+static void
+detach_busy(const char *target, bool exit)
+{
+    int err;
+
+    if(mount("/dev/test", target, "ext2", 0, "") < 0)
+        error(1, errno, "mount %s", target);
+    if(stand_in_set_busy(target, true))
+        error(1, 0, "no translator on %s", target);
+    if(umount2(target, MNT_DETACH) < 0)
+        error(1, errno, "umount2 %s", target);
+
+    /* Long enough for a few tries. */
+    sleep_ms(100);
+    err = umount_detach_status(target);
+    CHECK(err == EINPROGRESS, "%s: detach finished while busy: %s", target,
+          strerror(err));
+    CHECK(stand_in_running() == 1, "%s: %zu translators running while busy",
+          target, stand_in_running());
+
+    CHECK(stand_in_release(exit) == 1, "%s: no busy translator", target);
+    err = wait_detach(target);
+    CHECK(err == 0, "%s: detach ended with %s", target, strerror(err));
+    CHECK(stand_in_running() == 0, "%s: %zu translators left running",
+          target, stand_in_running());
+    CHECK(stand_in_ports() == 0, "%s: %zu rights to control ports left",
+          target, stand_in_ports());
+}
+
+int
+main(void)
+{
+    int err;
+
+    bench_reset();
+    bench_write_mtab(10);
+
+    /* A relative target is the detach of its absolute path. */
+    if(mount("/dev/test", "detach", "ext2", 0, "") < 0)
+        error(1, errno, "mount detach");
+    if(umount2("./detach", MNT_DETACH) < 0)
+        error(1, errno, "umount2 ./detach");
+    err = wait_detach("detach");
+    CHECK(err == 0, "detach: detach ended with %s", strerror(err));
+    CHECK(umount_detach_status("detach/") == 0,
+          "detach/: no finished detach");
+
+    /* It stops being busy and goes away when asked again. */
+    detach_busy("/test/idle", false);
+    /* It dies on its own, leaving a dead name. */
+    detach_busy("/test/exit", true);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+/* bench/test-fstype.c
+   Check the cache of translator programs: that types without one are
+   remembered too, that mount_fstype_flush and its bound empty it, and that
+   a search that a flush overtook is not cached.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* The bound of mount-fstype.c. */
+#define MAX     64
+/* How long a search is made to take, and when the flush overtakes it, in
+   milliseconds. */
+#define SEARCH  100
+#define FLUSH   20
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Mount a filesystem of TYPE on DIR, and unmount it again if that worked.
+   Returns how many times the type was searched for. */
+static unsigned long
+searches(const char *type, const char *dir)
+{
+    unsigned long before = stand_in_count(STAND_IN_FSTYPE);
+
+    if(mount("/dev/fstype", dir, type, 0, "") == 0)
+        umount2(dir, 0);
+    return stand_in_count(STAND_IN_FSTYPE) - before;
+}
+
+static void *
+racer(void *arg)
+{
+    if(mount("/dev/fstype", "/fstype/race", "ext2", 0, "") < 0)
+        error(1, errno, "mount /fstype/race");
+    return NULL;
+}
+
+int
+main(void)
+{
+    struct timespec ts = { 0, FLUSH * 1000 * 1000 };
+    pthread_t       thread;
+    char            type[16];
+
+    bench_reset();
+    bench_write_mtab(10);
+
+    CHECK(mount("/dev/fstype", "/fstype/a", "bogus", 0, "") < 0
+          && errno == EFTYPE, "a bogus type was mounted");
+    CHECK(searches("bogus", "/fstype/a") == 0,
+          "a type without a translator was searched for again");
+    CHECK(searches("ext2", "/fstype/a") == 1, "ext2 was not searched for");
+    CHECK(searches("ext2", "/fstype/a") == 0, "ext2 was searched for again");
+
+    mount_fstype_flush();
+    CHECK(searches("bogus", "/fstype/a") == 1
+          && searches("ext2", "/fstype/a") == 1,
+          "the types were not searched for again after a flush");
+
+    /* Full, and then emptied by one more. */
+    mount_fstype_flush();
+    searches("bogus", "/fstype/a");
+    for(int i = 1; i < MAX; i++)
+    {
+        snprintf(type, sizeof(type), "bogus%d", i);
+        searches(type, "/fstype/a");
+    }
+    CHECK(searches("bogus", "/fstype/a") == 0,
+          "the cache did not keep %d types", MAX);
+    CHECK(searches("bogus0", "/fstype/a") == 1, "bogus0 was cached");
+    CHECK(searches("bogus", "/fstype/a") == 1,
+          "the cache was not emptied past %d types", MAX);
+
+    /* Flushed while the search was under way, so it is not kept. */
+    mount_fstype_flush();
+    stand_in_set_latency(STAND_IN_FSTYPE, SEARCH * 1000 * 1000);
+    if(pthread_create(&thread, NULL, racer, NULL))
+        error(1, 0, "pthread_create");
+    nanosleep(&ts, NULL);
+    mount_fstype_flush();
+    pthread_join(thread, NULL);
+    stand_in_set_latency(STAND_IN_FSTYPE, 0);
+    CHECK(searches("ext2", "/fstype/a") == 1,
+          "a search overtaken by a flush was cached");
+    if(umount2("/fstype/race", 0) < 0)
+        error(1, errno, "umount2 /fstype/race");
+
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+/* bench/test-journal.c
+   Check that the compaction of the journal leaves out filesystems whose
+   translator went away behind the library's back.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mount.h>
+#include <hurd/fsys.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* Enough mount and umount2 records to go past the size at which the
+   journal is compacted, several times over. */
+#define CYCLES 2000
+/* How long the compaction is given, in milliseconds. */
+#define WAIT   3000
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Return whether the table has a filesystem mounted on DIR. */
+static bool
+mounted(const char *dir)
+{
+    char *mountpoint = NULL;
+    char  path[64];
+    bool  ret;
+
+    strcpy(stpcpy(path, dir), "/file");
+    if(mount_point_of(path, &mountpoint) < 0)
+        return false;
+    ret = (strcmp(mountpoint, dir) == 0);
+    free(mountpoint);
+    return ret;
+}
+
+int
+main(void)
+{
+    struct timespec ts = { 0, 10 * 1000 * 1000 };
+
+    bench_reset();
+    bench_write_mtab(10);
+
+    if(mount("/dev/gone", "/journal/gone", "ext2", 0, "") < 0)
+        error(1, errno, "mount /journal/gone");
+    if(mount("/dev/kept", "/journal/kept", "ext2", 0, "") < 0)
+        error(1, errno, "mount /journal/kept");
+    /* As `settrans -g' would. */
+    if(stand_in_goaway("/journal/gone", FSYS_GOAWAY_FORCE))
+        error(1, 0, "no translator on /journal/gone");
+    CHECK(mounted("/journal/gone"), "/journal/gone left the table early");
+
+    for(size_t i = 0; i < CYCLES; i++)
+    {
+        if(mount("/dev/test", "/journal/m", "ext2", 0, "") < 0)
+            error(1, errno, "mount /journal/m");
+        if(umount2("/journal/m", 0) < 0)
+            error(1, errno, "umount2 /journal/m");
+    }
+
+    for(long ms = 0; mounted("/journal/gone") && (ms < WAIT); ms += 10)
+        nanosleep(&ts, NULL);
+    CHECK(!mounted("/journal/gone"),
+          "/journal/gone is still in the table after compaction");
+    CHECK(mounted("/journal/kept"), "/journal/kept left the table");
+    return failures ? 1 : 0;
+}
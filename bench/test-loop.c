@@ -0,0 +1,113 @@
+/* bench/test-loop.c
+   Check the store name a loop mount gives its translator: the image file
+   itself, or the part of it that offset and sizelimit select.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argz.h>
+#include <errno.h>
+#include <error.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+#define IMAGE       BENCH_RUN_DIR "/loop.img"
+#define IMAGE_SIZE  4096
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Mount IMAGE on /loop with OPTS, and check that its translator is told
+   to open the typed store DEVICE. */
+static void
+check_device(const char *opts, const char *device)
+{
+    char   *argz  = NULL;
+    size_t  len   = 0;
+    char   *arg   = NULL;
+    char   *last  = NULL;
+    bool    typed = false;
+
+    if(mount(IMAGE, "/loop", "ext2", 0, opts) < 0)
+    {
+        CHECK(0, "mount with %s: %s", opts, strerror(errno));
+        return;
+    }
+    if(!stand_in_active("/loop", &argz, &len))
+        error(1, 0, "nothing is running on /loop");
+    while((arg = argz_next(argz, len, arg)))
+    {
+        if(strcmp(arg, "--store-type=typed") == 0)
+            typed = true;
+        last = arg;
+    }
+    CHECK(typed, "the translator of %s is not told the store is typed",
+          opts);
+    CHECK(last && (strcmp(last, device) == 0),
+          "the translator of %s opens %s, not %s", opts, last ?: "nothing",
+          device);
+    free(argz);
+    if(umount2("/loop", 0) < 0)
+        error(1, errno, "umount2 /loop");
+}
+
+int
+main(void)
+{
+    FILE *f;
+
+    bench_reset();
+    bench_write_mtab(10);
+    f = fopen(IMAGE, "w");
+    if(!f || (ftruncate(fileno(f), IMAGE_SIZE) < 0) || fclose(f))
+        error(1, errno, "%s", IMAGE);
+
+    check_device("loop", "file:" IMAGE);
+    check_device("loop,offset=0,sizelimit=4096", "file:" IMAGE);
+    check_device("loop,offset=1024", "remap:1024+3072:file:" IMAGE);
+    check_device("loop,offset=1024,sizelimit=1024",
+                 "remap:1024+1024:file:" IMAGE);
+    /* A limit past the end only takes what there is. */
+    check_device("loop,sizelimit=8192", "file:" IMAGE);
+
+    CHECK(mount(IMAGE, "/loop", "ext2", 0, "loop,offset=8192") < 0
+          && errno == EINVAL, "an offset past the end was mounted");
+    CHECK(mount(BENCH_RUN_DIR, "/loop", "ext2", 0, "loop") < 0
+          && errno == EINVAL, "a directory was mounted as an image");
+    CHECK(mount(BENCH_RUN_DIR "/none.img", "/loop", "ext2", 0, "loop") < 0
+          && errno == ENOENT, "a missing image was mounted");
+
+    unlink(IMAGE);
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/* bench/test-map.c
+   Check that mount_map_read refuses a binary table that does not describe
+   itself, rather than reading outside of it.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include "bench.h"
+
+#define MAP_FILE      BENCH_RUN_DIR "/mtab.map"
+/* How long the library is given to publish the map, in milliseconds. */
+#define PUBLISH_WAIT  10000
+
+/* The layout of mount-map.c. */
+#define MAP_DATA      4096
+
+struct map_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;
+    uint64_t count;
+    uint64_t size;
+};
+
+struct map_ent
+{
+    uint32_t fsname;
+    uint32_t dir;
+    uint32_t type;
+    uint32_t opts;
+};
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static int fd;
+
+static void
+map_pread(void *buf, size_t len, off_t off)
+{
+    if(pread(fd, buf, len, off) != (ssize_t) len)
+        error(1, errno, "read %s", MAP_FILE);
+}
+
+/* Write the LEN bytes at BUF at OFF of the map and move its sequence
+   count on, so that readers copy the table again. */
+static void
+map_pwrite(const void *buf, size_t len, off_t off)
+{
+    uint64_t seq;
+
+    if(pwrite(fd, buf, len, off) != (ssize_t) len)
+        error(1, errno, "write %s", MAP_FILE);
+    map_pread(&seq, sizeof(seq), offsetof(struct map_header, seq));
+    seq += 2;
+    if(pwrite(fd, &seq, sizeof(seq), offsetof(struct map_header, seq))
+       != sizeof(seq))
+        error(1, errno, "write %s", MAP_FILE);
+}
+
+/* Read MAP and return -1 with errno set, or how many entries it has. */
+static long
+map_count(struct mount_map *map)
+{
+    const struct mntent *entries;
+    size_t               n;
+
+    if(mount_map_read(map, &entries, &n) < 0)
+        return -1;
+    return n;
+}
+
+int
+main(void)
+{
+    struct timespec    ts  = { 0, 1000 * 1000 };
+    struct mount_map  *map = NULL;
+    struct map_header  hdr;
+    struct map_ent     ent, bad;
+    uint32_t           version;
+    uint64_t           count, size;
+    char               last;
+
+    bench_reset();
+    bench_write_mtab(10);
+    if(mount("/dev/map", "/test/map", "ext2", 0, "") < 0)
+        error(1, errno, "mount /test/map");
+
+    for(long ms = 0; !map && (ms < PUBLISH_WAIT); ms++)
+    {
+        map = mount_map_open();
+        if(map && (map_count(map) != 11))
+        {
+            mount_map_close(map);
+            map = NULL;
+        }
+        if(!map)
+            nanosleep(&ts, NULL);
+    }
+    if(!map)
+        error(1, ETIMEDOUT, "mount_map_open");
+    fd = open(MAP_FILE, O_RDWR);
+    if(fd < 0)
+        error(1, errno, "%s", MAP_FILE);
+    map_pread(&hdr, sizeof(hdr), 0);
+    map_pread(&ent, sizeof(ent), MAP_DATA);
+    map_pread(&last, 1, MAP_DATA + hdr.size - 1);
+
+    version = hdr.version + 1;
+    map_pwrite(&version, sizeof(version),
+               offsetof(struct map_header, version));
+    CHECK(map_count(map) < 0 && errno == EINVAL,
+          "a map of version %u was read", version);
+    map_pwrite(&hdr.version, sizeof(hdr.version),
+               offsetof(struct map_header, version));
+    CHECK(map_count(map) == 11, "the map was not read again: %s",
+          strerror(errno));
+
+    /* More entries than the table has room for. */
+    count = hdr.size / sizeof(ent) + 1;
+    map_pwrite(&count, sizeof(count), offsetof(struct map_header, count));
+    CHECK(map_count(map) < 0 && errno == EINVAL,
+          "a map of %llu entries in %llu bytes was read",
+          (unsigned long long) count, (unsigned long long) hdr.size);
+    map_pwrite(&hdr.count, sizeof(hdr.count),
+               offsetof(struct map_header, count));
+
+    /* A string past the end of the table. */
+    bad     = ent;
+    bad.dir = hdr.size;
+    map_pwrite(&bad, sizeof(bad), MAP_DATA);
+    CHECK(map_count(map) < 0 && errno == EINVAL,
+          "a map with a string at its end was read");
+    map_pwrite(&ent, sizeof(ent), MAP_DATA);
+
+    /* The last string running off the end of the table. */
+    map_pwrite("x", 1, MAP_DATA + hdr.size - 1);
+    CHECK(map_count(map) < 0 && errno == EINVAL,
+          "a map whose last string is not terminated was read");
+    map_pwrite(&last, 1, MAP_DATA + hdr.size - 1);
+    CHECK(map_count(map) == 11, "the map was not read again: %s",
+          strerror(errno));
+
+    /* A table longer than the file, which no remapping will fix. */
+    size = hdr.size + 1024 * 1024;
+    map_pwrite(&size, sizeof(size), offsetof(struct map_header, size));
+    CHECK(map_count(map) < 0 && errno == EINVAL,
+          "a map of %llu bytes was read from a shorter file",
+          (unsigned long long) size);
+    map_pwrite(&hdr.size, sizeof(hdr.size),
+               offsetof(struct map_header, size));
+    CHECK(map_count(map) == 11, "the map was not read again: %s",
+          strerror(errno));
+
+    close(fd);
+    mount_map_close(map);
+    if(umount2("/test/map", 0) < 0)
+        error(1, errno, "umount2 /test/map");
+    return failures ? 1 : 0;
+}
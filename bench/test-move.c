@@ -0,0 +1,124 @@
+/* bench/test-move.c
+   Check that MS_MOVE takes both translators of a mount along, and leaves
+   nothing on the old mount point.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Return whether the table has a filesystem mounted on DIR. */
+static bool
+mounted(const char *dir)
+{
+    char *mountpoint = NULL;
+    char  path[64];
+    bool  ret;
+
+    strcpy(stpcpy(path, dir), "/file");
+    if(mount_point_of(path, &mountpoint) < 0)
+        return false;
+    ret = (strcmp(mountpoint, dir) == 0);
+    free(mountpoint);
+    return ret;
+}
+
+/* Move what is mounted on FROM to TO and check where its translators
+   are.  ACTIVE and PASSIVE say which it has. */
+static void
+check_move(const char *from, const char *to, bool active, bool passive)
+{
+    if(mount(from, to, NULL, MS_MOVE, NULL) < 0)
+    {
+        error(0, errno, "move %s to %s", from, to);
+        failures++;
+        return;
+    }
+    CHECK(!mounted(from) && mounted(to), "%s was not moved to %s in the"
+          " table", from, to);
+    CHECK(!stand_in_active(from, NULL, NULL),
+          "a translator is left running on %s", from);
+    CHECK(!stand_in_passive(from, NULL, NULL),
+          "a passive translator is left on %s", from);
+    CHECK(stand_in_active(to, NULL, NULL) == active,
+          "%s: running translator %s", to, active ? "missing" : "added");
+    CHECK(stand_in_passive(to, NULL, NULL) == passive,
+          "%s: passive translator %s", to, passive ? "missing" : "added");
+}
+
+int
+main(void)
+{
+    bench_reset();
+    bench_write_mtab(10);
+
+    if(mount("/dev/auto", "/move/a", "ext2", 0, "") < 0)
+        error(1, errno, "mount /move/a");
+    check_move("/move/a", "/move/b", true, false);
+
+    /* Nothing runs until it is first looked up. */
+    if(mount("/dev/lazy", "/move/c", "ext2", 0, "noauto,idle=60") < 0)
+        error(1, errno, "mount /move/c");
+    CHECK(stand_in_passive("/move/c", NULL, NULL),
+          "no passive translator on /move/c");
+    check_move("/move/c", "/move/d", false, true);
+
+    /* Not into itself, however TO is spelled. */
+    CHECK(mount("/move/b", "/move/b/../b/sub", NULL, MS_MOVE, NULL) < 0
+          && errno == EINVAL,
+          "/move/b was moved below itself");
+    CHECK(mounted("/move/b"), "/move/b is no longer mounted");
+
+    /* The mounts below the moved one go with it. */
+    if(mount("/dev/sub", "/move/b/sub", "ext2", 0, "") < 0)
+        error(1, errno, "mount /move/b/sub");
+    check_move("/move/b", "/move/e", true, false);
+    CHECK(!mounted("/move/b/sub") && mounted("/move/e/sub"),
+          "/move/b/sub was not moved to /move/e/sub in the table");
+    CHECK(stand_in_active("/move/e/sub", NULL, NULL),
+          "no translator on /move/e/sub");
+    CHECK(umount2("/move/e", MS_REC) == 0, "umount2 /move/e: %s",
+          strerror(errno));
+
+    CHECK(umount2("/move/d", 0) == 0, "umount2 /move/d: %s",
+          strerror(errno));
+    CHECK(!stand_in_passive("/move/d", NULL, NULL),
+          "a passive translator is left on /move/d");
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    CHECK(stand_in_ports() == 0, "%zu rights to control ports left",
+          stand_in_ports());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+/* bench/test-paths.c
+   Check that relative paths are taken against the working directory and
+   never match an absolute mount point of the same name, and that `.',
+   `..' and extra slashes do not make another mount point of a directory.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+int
+main(void)
+{
+    char  cwd[PATH_MAX];
+    char  rel[PATH_MAX + 8];
+    char *mountpoint = NULL;
+
+    if(!getcwd(cwd, sizeof(cwd)))
+        error(1, errno, "getcwd");
+    snprintf(rel, sizeof(rel), "%s/rel", cwd);
+    bench_reset();
+    bench_write_mtab(10);
+
+    /* A relative path names something under the working directory, which
+       is not `/' here, so it must not find /srv/vol1. */
+    CHECK(mount_point_of("srv/vol1/file", &mountpoint) < 0,
+          "srv/vol1/file is on %s", mountpoint);
+    CHECK(umount2("srv/vol1", 0) < 0 && errno == EINVAL,
+          "umount2 srv/vol1 unmounted /srv/vol1");
+    CHECK(umount2("srv", MS_REC) < 0 && errno == EINVAL,
+          "umount2 srv with MS_REC unmounted /srv/vol*");
+    CHECK(mount_point_of("/srv/vol1/file", &mountpoint) == 0,
+          "/srv/vol1 is no longer mounted");
+    free(mountpoint);
+    mountpoint = NULL;
+
+    /* A relative target is recorded as its absolute path. */
+    if(mount("/dev/test", "rel", "ext2", 0, "") < 0)
+        error(1, errno, "mount rel");
+    CHECK(stand_in_active(rel, NULL, NULL), "no translator on %s", rel);
+    CHECK(mount_point_of("rel/file", &mountpoint) == 0
+          && strcmp(mountpoint, rel) == 0,
+          "rel/file is on %s, not %s", mountpoint, rel);
+    free(mountpoint);
+    mountpoint = NULL;
+    CHECK(mount_point_of("/rel/file", &mountpoint) < 0,
+          "/rel/file is on %s", mountpoint);
+    CHECK(umount2("./rel", 0) == 0, "umount2 ./rel: %s", strerror(errno));
+    CHECK(!stand_in_active(rel, NULL, NULL), "a translator is left on %s",
+          rel);
+
+    /* Spellings of one directory name one mount point. */
+    if(mount("/dev/test", "/a/b/", "ext2", 0, "") < 0)
+        error(1, errno, "mount /a/b/");
+    CHECK(mount_point_of("/a//b/../b/file", &mountpoint) == 0
+          && strcmp(mountpoint, "/a/b") == 0,
+          "/a/b/file is on %s, not /a/b", mountpoint);
+    free(mountpoint);
+    mountpoint = NULL;
+    CHECK(mount("/dev/test", "/a/b", "ext2", MS_REMOUNT, "ro") == 0,
+          "remount /a/b: %s", strerror(errno));
+    CHECK(umount2("/a/./b", 0) == 0, "umount2 /a/./b: %s", strerror(errno));
+    CHECK(mount_point_of("/a/b/file", &mountpoint) < 0,
+          "/a/b is still in the table, as %s", mountpoint);
+
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+/* bench/test-pool.c
+   Check that only filesystems that can share their source are pooled, and
+   that a pooled translator is taken by a matching mount and fitted to its
+   mount point.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* How long the pools are given to fill, in milliseconds. */
+#define WAIT 3000
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Wait until the pools hold IDLE translators. */
+static bool
+wait_idle(unsigned long idle)
+{
+    struct timespec         ts = { 0, 10 * 1000 * 1000 };
+    struct mount_pool_stats stats;
+
+    for(long ms = 0; ms < WAIT; ms += 10)
+    {
+        mount_pool_get_stats(&stats);
+        if(stats.idle == idle)
+            return true;
+        nanosleep(&ts, NULL);
+    }
+    return false;
+}
+
+int
+main(void)
+{
+    struct mount_pool_stats stats;
+    mode_t                  mode = 0;
+    uid_t                   uid  = 0;
+    gid_t                   gid  = 0;
+
+    bench_reset();
+    bench_write_mtab(10);
+
+    /* Each translator would write to /dev/hd0s1 on its own. */
+    CHECK(mount_pool_configure("/dev/hd0s1", "ext2", 0, "", 2) < 0
+          && errno == EINVAL, "a writable ext2 was pooled");
+    CHECK(mount_pool_configure("/dev/hd0s1", "ext2", 0, "rw", 2) < 0
+          && errno == EINVAL, "a writable ext2 was pooled with rw");
+
+    CHECK(mount_pool_configure("/dev/hd0s1", "ext2", MS_RDONLY, "", 2) == 0,
+          "a read-only ext2 was not pooled: %s", strerror(errno));
+    CHECK(mount_pool_configure("/dev/hd1s1", "ext2", 0, "ro", 2) == 0,
+          "an ext2 with ro was not pooled: %s", strerror(errno));
+    CHECK(mount_pool_configure("none", "tmpfs", 0, "", 2) == 0,
+          "tmpfs was not pooled: %s", strerror(errno));
+    CHECK(wait_idle(6), "the pools did not fill");
+
+    /* A matching mount takes a waiting translator, whose root looks as if
+       it had been started on the mount point. */
+    stand_in_set_owner("/pool/tmp", 01777, 1000, 100);
+    if(mount("none", "/pool/tmp", "tmpfs", 0, "") < 0)
+        error(1, errno, "mount /pool/tmp");
+    mount_pool_get_stats(&stats);
+    CHECK(stats.hits == 1, "%llu mounts took a pooled translator",
+          stats.hits);
+    CHECK(stand_in_root_owner("/pool/tmp", &mode, &uid, &gid) == 0,
+          "nothing is running on /pool/tmp");
+    CHECK(((mode & 07777) == 01777) && (uid == 1000) && (gid == 100),
+          "the root of /pool/tmp has mode %o and owner %u:%u",
+          (unsigned) mode, (unsigned) uid, (unsigned) gid);
+    if(umount2("/pool/tmp", 0) < 0)
+        error(1, errno, "umount2 /pool/tmp");
+
+    mount_pool_configure("/dev/hd0s1", "ext2", MS_RDONLY, "", 0);
+    mount_pool_configure("/dev/hd1s1", "ext2", 0, "ro", 0);
+    mount_pool_configure("none", "tmpfs", 0, "", 0);
+    CHECK(wait_idle(0), "the pools did not empty");
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+/* bench/test-rec.c
+   Check that umount2_rec leaves in place what contains a filesystem that
+   would not go away, failing it with EBUSY, and reports every filesystem
+   it left.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* The tree, each below the one before it that is a prefix of it. */
+static const char *const dirs[] =
+    { "/rec", "/rec/a", "/rec/a/x", "/rec/a/y", "/rec/b", "/rec/b/z" };
+#define NDIRS (sizeof(dirs) / sizeof(dirs[0]))
+
+int
+main(void)
+{
+    struct umount_failure *failed = NULL;
+    size_t                 nfailed = 0;
+    /* What is left once /rec/a/x will not go: it and what contains it. */
+    static const char *const left[] = { "/rec", "/rec/a", "/rec/a/x" };
+
+    bench_reset();
+    bench_write_mtab(10);
+    for(size_t i = 0; i < NDIRS; i++)
+        if(mount("/dev/rec", dirs[i], "ext2", 0, "") < 0)
+            error(1, errno, "mount %s", dirs[i]);
+
+    stand_in_set_busy("/rec/a/x", true);
+    CHECK(umount2_rec("/rec", 0, &failed, &nfailed) < 0 && errno == EBUSY,
+          "umount2_rec of a tree with a busy filesystem did not fail with "
+          "EBUSY");
+    CHECK(nfailed == 3, "%zu filesystems failed, not 3", nfailed);
+    /* Each one after what contains it. */
+    for(size_t i = 0; failed && (i < nfailed) && (i < 3); i++)
+    {
+        CHECK(strcmp(failed[i].target, left[i]) == 0,
+              "failure %zu is %s, not %s", i, failed[i].target, left[i]);
+        CHECK(failed[i].err == EBUSY, "%s failed with %s, not EBUSY",
+              failed[i].target, strerror(failed[i].err));
+    }
+    free(failed);
+
+    for(size_t i = 0; i < NDIRS; i++)
+    {
+        bool kept = false;
+
+        for(size_t j = 0; j < 3; j++)
+            kept |= strcmp(dirs[i], left[j]) == 0;
+        CHECK(stand_in_active(dirs[i], NULL, NULL) == kept,
+              "%s was %s", dirs[i], kept ? "unmounted" : "left mounted");
+    }
+
+    /* With nothing in the way, the rest goes, and nothing is reported. */
+    stand_in_set_busy("/rec/a/x", false);
+    failed = (struct umount_failure *) dirs;
+    CHECK(umount2_rec("/rec", 0, &failed, &nfailed) == 0,
+          "umount2_rec failed: %s", strerror(errno));
+    CHECK(!failed && !nfailed, "%zu failures were reported", nfailed);
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+
+    /* Nothing mounted there. */
+    CHECK(umount2_rec("/rec", 0, NULL, NULL) < 0 && errno == EINVAL,
+          "umount2_rec of nothing did not fail with EINVAL");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,102 @@
+/* bench/test-remount.c
+   Check that a remount sends the translator only the options that change,
+   and nothing at all when none does.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <argz.h>
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+#define DIR "/remount"
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Remount DIR with FLAGS and OPTS, and check that the translator was sent
+   SENT, separated by spaces, or nothing if SENT is null. */
+static void
+check_remount(unsigned long flags, const char *opts, const char *sent)
+{
+    unsigned long  before = stand_in_options(DIR, NULL, NULL);
+    unsigned long  after;
+    char          *argz   = NULL;
+    size_t         len    = 0;
+
+    if(mount(NULL, DIR, NULL, MS_REMOUNT | flags, opts) < 0)
+    {
+        CHECK(0, "remount with %s: %s", opts, strerror(errno));
+        return;
+    }
+    after = stand_in_options(DIR, &argz, &len);
+    if(!sent)
+        CHECK(after == before, "remount with %s set the options", opts);
+    else if(after != before + 1)
+        CHECK(0, "remount with %s set the options %lu times", opts,
+              after - before);
+    else
+    {
+        argz_stringify(argz, len, ' ');
+        CHECK((len ? strcmp(argz, sent) : *sent) == 0,
+              "remount with %s sent \"%s\", not \"%s\"", opts,
+              len ? argz : "", sent);
+    }
+    free(argz);
+}
+
+int
+main(void)
+{
+    bench_reset();
+    bench_write_mtab(10);
+    if(mount("/dev/remount", DIR, "ext2", 0, "ro") < 0)
+        error(1, errno, "mount " DIR);
+
+    check_remount(0, "ro", NULL);
+    check_remount(0, "rw", "--writable");
+    check_remount(0, "rw", NULL);
+    check_remount(MS_RDONLY, "", "--readonly");
+    check_remount(0, "", "--writable");
+
+    check_remount(0, "sync", "--sync");
+    check_remount(0, "sync", NULL);
+    /* The interval is all that changes; it must not be sent a default
+       one as well. */
+    check_remount(0, "sync=10", "--sync=10");
+    check_remount(0, "sync=10", NULL);
+    check_remount(0, "sync", "--sync");
+    check_remount(0, "", "--sync=5");
+
+    if(umount2(DIR, 0) < 0)
+        error(1, errno, "umount2 " DIR);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/* bench/test-stats.c
+   Check that the statistics count each call, failure and error number of
+   a known run of mounts and unmounts, and time its phases into the right
+   buckets; and that they stand still while disabled.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+#define DIR    "/stats"
+/* Starting a translator is made to take this long, in microseconds, which
+   falls in bucket START_BUCKET: from 2^11 up to 2^12 microseconds. */
+#define START         2500
+#define START_BUCKET  12
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* Return how many failures with ERR STATS counts. */
+static unsigned long long
+errno_count(const struct mount_stats *stats, int err)
+{
+    for(size_t i = 0; i < MOUNT_STATS_ERRNOS; i++)
+        if(stats->errnos[i].err == err)
+            return stats->errnos[i].count;
+    return 0;
+}
+
+/* Check that phase P of STATS ran COUNT times, and that its histogram and
+   times agree with that. */
+static void
+check_phase(const struct mount_stats *stats, enum mount_phase p,
+            unsigned long long count)
+{
+    const struct mount_phase_stats *ps  = &stats->phases[p];
+    unsigned long long              sum = 0;
+
+    for(size_t b = 0; b < MOUNT_STATS_BUCKETS; b++)
+        sum += ps->hist[b];
+    CHECK(ps->count == count, "phase %d ran %llu times, not %llu", p,
+          ps->count, count);
+    CHECK(sum == ps->count, "phase %d has %llu in its histogram, not %llu",
+          p, sum, ps->count);
+    CHECK(ps->max_ns <= ps->total_ns && (!count || ps->max_ns),
+          "phase %d took %llu ns at most of %llu", p, ps->max_ns,
+          ps->total_ns);
+}
+
+int
+main(void)
+{
+    struct mount_stats stats;
+    int                umount_err;
+
+    bench_reset();
+    bench_write_mtab(10);
+    mount_stats_reset();
+    CHECK(mount_stats_enable(1) == 0, "the statistics were already enabled");
+
+    stand_in_set_latency(STAND_IN_START, START * 1000);
+    if(mount("/dev/stats", DIR, "ext2", 0, "") < 0)
+        error(1, errno, "mount " DIR);
+    stand_in_set_latency(STAND_IN_START, 0);
+    if(umount2(DIR, 0) < 0)
+        error(1, errno, "umount2 " DIR);
+    CHECK(mount("/dev/stats", DIR, "bogus", 0, "") < 0 && errno == EFTYPE,
+          "a bogus type was mounted");
+    CHECK(mount("/dev/stats", DIR, "bogus", 0, "") < 0 && errno == EFTYPE,
+          "a bogus type was mounted");
+    CHECK(umount2(DIR, 0) < 0, "nothing was unmounted");
+    umount_err = errno;
+
+    mount_stats_get(&stats);
+    CHECK(stats.calls[MOUNT_STATS_MOUNT] == 3
+          && stats.errors[MOUNT_STATS_MOUNT] == 2,
+          "%llu mounts with %llu failures, not 3 with 2",
+          stats.calls[MOUNT_STATS_MOUNT], stats.errors[MOUNT_STATS_MOUNT]);
+    CHECK(stats.calls[MOUNT_STATS_UMOUNT] == 2
+          && stats.errors[MOUNT_STATS_UMOUNT] == 1,
+          "%llu unmounts with %llu failures, not 2 with 1",
+          stats.calls[MOUNT_STATS_UMOUNT], stats.errors[MOUNT_STATS_UMOUNT]);
+    CHECK(errno_count(&stats, EFTYPE) == 2, "%llu failures with EFTYPE",
+          errno_count(&stats, EFTYPE));
+    CHECK(errno_count(&stats, umount_err) == 1, "%llu failures with %s",
+          errno_count(&stats, umount_err), strerror(umount_err));
+    CHECK(stats.errnos_other == 0, "%llu failures with other errors",
+          stats.errnos_other);
+
+    check_phase(&stats, MOUNT_PHASE_OPTIONS, 3);
+    check_phase(&stats, MOUNT_PHASE_FSTYPE, 3);
+    check_phase(&stats, MOUNT_PHASE_START, 1);
+    check_phase(&stats, MOUNT_PHASE_OPEN, 1);
+    check_phase(&stats, MOUNT_PHASE_ATTACH, 1);
+    check_phase(&stats, MOUNT_PHASE_GOAWAY, 1);
+    check_phase(&stats, MOUNT_PHASE_REMOUNT, 0);
+    CHECK(stats.phases[MOUNT_PHASE_START].hist[START_BUCKET] == 1,
+          "a start of %d us was not in bucket %d", START, START_BUCKET);
+    CHECK(stats.phases[MOUNT_PHASE_START].total_ns >= START * 1000ULL,
+          "a start of %d us took %llu ns", START,
+          stats.phases[MOUNT_PHASE_START].total_ns);
+
+    /* Nothing moves while disabled, and a reset clears it all. */
+    CHECK(mount_stats_enable(0) == 1, "the statistics were not enabled");
+    if(mount("/dev/stats", DIR, "ext2", 0, "") < 0)
+        error(1, errno, "mount " DIR);
+    if(umount2(DIR, 0) < 0)
+        error(1, errno, "umount2 " DIR);
+    mount_stats_get(&stats);
+    CHECK(stats.calls[MOUNT_STATS_MOUNT] == 3
+          && stats.phases[MOUNT_PHASE_START].count == 1,
+          "the statistics moved while disabled");
+    mount_stats_reset();
+    mount_stats_get(&stats);
+    CHECK(!stats.calls[MOUNT_STATS_MOUNT] && !stats.errors[MOUNT_STATS_MOUNT]
+          && !stats.errnos[0].err && !stats.errnos[0].count
+          && !stats.phases[MOUNT_PHASE_START].count
+          && !stats.phases[MOUNT_PHASE_START].hist[START_BUCKET],
+          "mount_stats_reset left counts behind");
+
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
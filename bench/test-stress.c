@@ -0,0 +1,159 @@
+/* bench/test-stress.c
+   Run mount and umount2 from many threads at once and check that each
+   sees its own mounts and that nothing is left behind.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+/* Threads with mount points of their own, and threads fighting over one
+   mount point. */
+#define OWN_THREADS    8
+#define SHARED_THREADS 4
+#define ITERATIONS     200
+/* Mount points of each thread of its own. */
+#define TARGETS        4
+
+#define SHARED_TARGET  "/stress/shared"
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            __atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);             \
+        }                                                                   \
+    } while(0)
+
+/* Check that DIR is mounted, and for a bind mount, from where. */
+static void
+check_mounted(const char *dir, const char *bound)
+{
+    char  path[64];
+    char *mountpoint = NULL;
+    char *argz       = NULL;
+    size_t argz_len  = 0;
+
+    snprintf(path, sizeof(path), "%s/file", dir);
+    CHECK(mount_point_of(path, &mountpoint) == 0,
+          "mount_point_of %s: %s", path, strerror(errno));
+    if(mountpoint)
+    {
+        CHECK(strcmp(mountpoint, dir) == 0,
+              "%s is on %s, not %s", path, mountpoint, dir);
+        free(mountpoint);
+    }
+    CHECK(stand_in_active(dir, &argz, &argz_len),
+          "no translator on %s", dir);
+    if(argz && bound)
+        CHECK(memmem(argz, argz_len, bound, strlen(bound) + 1),
+              "the translator on %s is not bound to %s", dir, bound);
+    free(argz);
+}
+
+static void *
+own(void *arg)
+{
+    size_t id = (size_t) arg;
+    char   target[TARGETS][64];
+
+    for(size_t i = 0; i < TARGETS; i++)
+        snprintf(target[i], sizeof(target[i]), "/stress/t%zu/m%zu", id, i);
+
+    for(size_t i = 0; i < ITERATIONS; i++)
+    {
+        const char    *t     = target[i % TARGETS];
+        unsigned long  flags = MS_REMOUNT | ((i & 1) ? 0 : MS_RDONLY);
+
+        CHECK(mount("/dev/stress", t, "ext2", 0, "") == 0,
+              "mount %s: %s", t, strerror(errno));
+        check_mounted(t, NULL);
+        CHECK(mount(NULL, t, NULL, flags, NULL) == 0,
+              "remount %s: %s", t, strerror(errno));
+        CHECK(umount2(t, 0) == 0, "umount2 %s: %s", t, strerror(errno));
+        CHECK(!stand_in_active(t, NULL, NULL),
+              "a translator is left on %s", t);
+
+        CHECK(mount("/srv/vol1", t, "none", MS_BIND, NULL) == 0,
+              "bind %s: %s", t, strerror(errno));
+        check_mounted(t, "/srv/vol1");
+        CHECK(umount2(t, 0) == 0, "umount2 %s: %s", t, strerror(errno));
+    }
+    return NULL;
+}
+
+/* Only one of these may have SHARED_TARGET mounted at a time; the others
+   must be told so. */
+static void *
+shared(void *arg)
+{
+    for(size_t i = 0; i < ITERATIONS; i++)
+    {
+        if(mount("/dev/shared", SHARED_TARGET, "ext2", 0, "") < 0)
+            CHECK(errno == EBUSY, "mount " SHARED_TARGET ": %s",
+                  strerror(errno));
+        if(umount2(SHARED_TARGET, 0) < 0)
+            CHECK(errno == EINVAL, "umount2 " SHARED_TARGET ": %s",
+                  strerror(errno));
+    }
+    return NULL;
+}
+
+int
+main(void)
+{
+    pthread_t threads[OWN_THREADS + SHARED_THREADS];
+    char     *mountpoint = NULL;
+
+    bench_reset();
+    bench_write_mtab(1000);
+
+    for(size_t i = 0; i < OWN_THREADS + SHARED_THREADS; i++)
+        if(pthread_create(&threads[i], NULL,
+                          (i < OWN_THREADS) ? own : shared, (void *) i))
+            error(1, errno, "pthread_create");
+    for(size_t i = 0; i < OWN_THREADS + SHARED_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    if(umount2(SHARED_TARGET, 0) < 0)
+        CHECK(errno == EINVAL, "umount2 " SHARED_TARGET ": %s",
+              strerror(errno));
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    CHECK(stand_in_ports() == 0, "%zu rights to control ports left",
+          stand_in_ports());
+    /* The table is back to what other programs mounted. */
+    CHECK(mount_point_of("/stress/t0/m0/file", &mountpoint) < 0,
+          "/stress/t0/m0 is still in the table, under %s", mountpoint);
+    CHECK(mount_point_of("/srv/vol999/file", &mountpoint) == 0
+          && strcmp(mountpoint, "/srv/vol999") == 0,
+          "/srv/vol999 is no longer in the table");
+    free(mountpoint);
+    return failures ? 1 : 0;
+}
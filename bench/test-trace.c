@@ -0,0 +1,171 @@
+/* bench/test-trace.c
+   Check that the trace hooks are called around each phase of mount and
+   umount2, in order, with the context, cookie and error of each, and not
+   at all once unregistered.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+#define DIR     "/trace"
+#define EVENTS  32
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+/* A hook that was called: its phase, plus EVENTS for an end hook. */
+struct event
+{
+    int   phase;
+    int   err;
+    void *context;
+    void *cookie;
+};
+
+static struct event events[EVENTS];
+static size_t       nevents;
+static int          cookie;
+static int          context;
+
+static void
+record(int phase, int err, void *context, void *cookie)
+{
+    if(nevents < EVENTS)
+        events[nevents] = (struct event) { phase, err, context, cookie };
+    nevents++;
+}
+
+static void
+begin(enum mount_phase phase, void *context, void *cookie)
+{
+    record(phase, 0, context, cookie);
+}
+
+static void
+end(enum mount_phase phase, int err, unsigned long long ns, void *context,
+    void *cookie)
+{
+    record(EVENTS + phase, err, context, cookie);
+}
+
+#define B(phase) (phase)
+#define E(phase) (EVENTS + (phase))
+
+/* Check that the hooks called since the last check were the N in
+   EXPECTED, with the context and cookie set, and that the last one ended
+   with ERR. */
+static void
+check_events(const char *what, const int *expected, size_t n, int err)
+{
+    CHECK(nevents == n, "%s called %zu hooks, not %zu", what, nevents, n);
+    for(size_t i = 0; (i < n) && (i < nevents); i++)
+    {
+        CHECK(events[i].phase == expected[i],
+              "hook %zu of %s was %s of phase %d, not %s of %d", i, what,
+              (events[i].phase < EVENTS) ? "the begin" : "the end",
+              events[i].phase % EVENTS,
+              (expected[i] < EVENTS) ? "the begin" : "the end",
+              expected[i] % EVENTS);
+        CHECK(events[i].context == &context && events[i].cookie == &cookie,
+              "hook %zu of %s was not passed the context and cookie", i,
+              what);
+    }
+    if(nevents && (nevents == n))
+        CHECK(events[n - 1].err == err, "the last phase of %s ended with %s",
+              what, strerror(events[n - 1].err));
+    nevents = 0;
+}
+
+int
+main(void)
+{
+    static const int mounted[] =
+        { B(MOUNT_PHASE_FSTAB), E(MOUNT_PHASE_FSTAB),
+          B(MOUNT_PHASE_OPTIONS), E(MOUNT_PHASE_OPTIONS),
+          B(MOUNT_PHASE_FSTYPE), E(MOUNT_PHASE_FSTYPE),
+          B(MOUNT_PHASE_START),
+          B(MOUNT_PHASE_OPEN), E(MOUNT_PHASE_OPEN),
+          E(MOUNT_PHASE_START),
+          B(MOUNT_PHASE_ATTACH), E(MOUNT_PHASE_ATTACH) };
+    static const int unmounted[] =
+        { B(MOUNT_PHASE_FSTAB), E(MOUNT_PHASE_FSTAB),
+          B(MOUNT_PHASE_GOAWAY), E(MOUNT_PHASE_GOAWAY),
+          B(MOUNT_PHASE_GOAWAY_SOURCE), E(MOUNT_PHASE_GOAWAY_SOURCE) };
+    static const int refused[] =
+        { B(MOUNT_PHASE_FSTAB), E(MOUNT_PHASE_FSTAB),
+          B(MOUNT_PHASE_OPTIONS), E(MOUNT_PHASE_OPTIONS),
+          B(MOUNT_PHASE_FSTYPE), E(MOUNT_PHASE_FSTYPE) };
+    struct mount_trace_hooks hooks = { begin, end };
+    struct mount_trace_hooks other = { begin, NULL };
+
+    bench_reset();
+    bench_write_mtab(10);
+    mount_trace_set_context(&context);
+    if(mount_trace_register(&hooks, &cookie) < 0)
+        error(1, errno, "mount_trace_register");
+
+    if(mount("/dev/trace", DIR, "ext2", 0, "") < 0)
+        error(1, errno, "mount " DIR);
+    check_events("mount", mounted, sizeof(mounted) / sizeof(mounted[0]), 0);
+    if(umount2(DIR, 0) < 0)
+        error(1, errno, "umount2 " DIR);
+    check_events("umount2", unmounted,
+                 sizeof(unmounted) / sizeof(unmounted[0]), 0);
+
+    /* The phase that failed ends with its error, and errno is left as it
+       set it. */
+    CHECK(mount("/dev/trace", DIR, "bogus", 0, "") < 0 && errno == EFTYPE,
+          "a bogus type was mounted, or failed with %s", strerror(errno));
+    check_events("a refused mount", refused,
+                 sizeof(refused) / sizeof(refused[0]), EFTYPE);
+
+    CHECK(mount_trace_unregister(NULL, &cookie) < 0 && errno == EINVAL,
+          "mount_trace_unregister of no hooks did not fail with EINVAL");
+    CHECK(mount_trace_unregister(&other, &cookie) < 0 && errno == ENOENT,
+          "mount_trace_unregister of other hooks did not fail with ENOENT");
+    CHECK(mount_trace_unregister(&hooks, NULL) < 0 && errno == ENOENT,
+          "mount_trace_unregister with another cookie did not fail with "
+          "ENOENT");
+    CHECK(mount_trace_unregister(&hooks, &cookie) == 0,
+          "mount_trace_unregister: %s", strerror(errno));
+
+    if(mount("/dev/trace", DIR, "ext2", 0, "") < 0)
+        error(1, errno, "mount " DIR);
+    if(umount2(DIR, 0) < 0)
+        error(1, errno, "umount2 " DIR);
+    CHECK(nevents == 0, "%zu hooks were called once unregistered", nevents);
+
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,100 @@
+/* bench/test-vector.c
+   Check that mountv and umountv report each entry of a batch that mixes
+   successes and failures, carry on past the failures, and fail with the
+   first of them.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+#include "stand-in.h"
+
+#define N 5
+
+static int failures;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+int
+main(void)
+{
+    static const struct mount_req reqs[N] =
+        { { "/dev/v0", "/vector/0", "ext2",  0, "" },
+          { "/dev/v1", "/vector/1", "bogus", 0, "" },
+          { "/dev/v2", "/vector/2", "ext2",  0, "" },
+          { "/dev/v0", "/vector/0", "ext2",  0, "" },
+          { "/dev/v3", "/vector/3", "tmpfs", 0, "" } };
+    /* What each of REQS gives, and so whether it is left mounted. */
+    static const int mounted[N] = { 0, EFTYPE, 0, EBUSY, 0 };
+    static const char *const targets[N] =
+        { "/vector/0", "/vector/1", "/vector/2", "/vector/3", "/vector/0" };
+    /* What each of TARGETS gives with /vector/2 busy. */
+    static const int unmounted[N] = { 0, EINVAL, EBUSY, 0, EINVAL };
+    int results[N];
+
+    bench_reset();
+    bench_write_mtab(10);
+
+    memset(results, -1, sizeof(results));
+    CHECK(mountv(reqs, N, results) < 0 && errno == EFTYPE,
+          "mountv did not fail with the first failure, EFTYPE, but %s",
+          strerror(errno));
+    for(size_t i = 0; i < N; i++)
+        CHECK(results[i] == mounted[i], "entry %zu of mountv gave %s, not %s",
+              i, strerror(results[i]), strerror(mounted[i]));
+    for(size_t i = 0; i < N; i++)
+        CHECK(stand_in_active(reqs[i].target, NULL, NULL)
+              == ((reqs[i].filesystemtype[0] != 'b')),
+              "%s was%s mounted", reqs[i].target,
+              stand_in_active(reqs[i].target, NULL, NULL) ? "" : " not");
+    CHECK(stand_in_running() == 3, "%zu translators are running, not 3",
+          stand_in_running());
+
+    /* Unknown, busy, and already gone earlier in the batch. */
+    stand_in_set_busy("/vector/2", true);
+    memset(results, -1, sizeof(results));
+    CHECK(umountv(targets, N, 0, results) < 0 && errno == EINVAL,
+          "umountv did not fail with the first failure, EINVAL, but %s",
+          strerror(errno));
+    for(size_t i = 0; i < N; i++)
+        CHECK(results[i] == unmounted[i],
+              "entry %zu of umountv gave %s, not %s", i,
+              strerror(results[i]), strerror(unmounted[i]));
+    CHECK(stand_in_running() == 1, "%zu translators are running, not 1",
+          stand_in_running());
+
+    stand_in_set_busy("/vector/2", false);
+    CHECK(umountv(targets + 2, 1, 0, NULL) == 0, "umountv: %s",
+          strerror(errno));
+    CHECK(mountv(NULL, 0, NULL) == 0 && umountv(NULL, 0, 0, NULL) == 0,
+          "an empty batch failed");
+    CHECK(stand_in_running() == 0, "%zu translators left running",
+          stand_in_running());
+    return failures ? 1 : 0;
+}
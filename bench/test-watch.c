@@ -0,0 +1,121 @@
+/* bench/test-watch.c
+   Check that a watcher that resyncs while the table changes gets each
+   change either in the table or as an event, never in both.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <error.h>
+#include <mntent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "bench.h"
+
+/* Mounts and umounts of /watch/m made while the watcher resyncs. */
+#define CYCLES 2000
+
+static int  failures;
+static bool done;
+
+#define CHECK(cond, ...)                                                    \
+    do                                                                      \
+    {                                                                       \
+        if(!(cond))                                                         \
+        {                                                                   \
+            error(0, 0, __VA_ARGS__);                                       \
+            failures++;                                                     \
+        }                                                                   \
+    } while(0)
+
+static void *
+changer(void *arg)
+{
+    for(size_t i = 0; i < CYCLES; i++)
+    {
+        if(mount("/dev/watch", "/watch/m", "ext2", 0, "") < 0)
+            error(1, errno, "mount /watch/m");
+        if(umount2("/watch/m", 0) < 0)
+            error(1, errno, "umount2 /watch/m");
+    }
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Resync WATCH and return whether the table has /watch/m. */
+static bool
+resync(struct mount_watch *watch)
+{
+    struct mntent *entries;
+    size_t         n;
+    bool           ret = false;
+
+    if(mount_watch_resync(watch, &entries, &n, NULL) < 0)
+        error(1, errno, "mount_watch_resync");
+    for(size_t i = 0; i < n; i++)
+        if(strcmp(entries[i].mnt_dir, "/watch/m") == 0)
+            ret = true;
+    free(entries);
+    return ret;
+}
+
+int
+main(void)
+{
+    struct mount_watch *watch;
+    struct mount_event  ev;
+    pthread_t           thread;
+    bool                mounted;
+
+    bench_reset();
+    bench_write_mtab(10);
+
+    watch = mount_watch_open();
+    if(!watch)
+        error(1, errno, "mount_watch_open");
+    mounted = resync(watch);
+    if(pthread_create(&thread, NULL, changer, NULL))
+        error(1, 0, "pthread_create");
+
+    while(!__atomic_load_n(&done, __ATOMIC_ACQUIRE) && !failures)
+    {
+        mounted = resync(watch);
+        /* What follows the table must lead on from it. */
+        while((mount_watch_read(watch, &ev) == 0) && !failures)
+        {
+            if(ev.type == MOUNT_EVENT_OVERFLOW)
+            {
+                mounted = resync(watch);
+                continue;
+            }
+            if(strcmp(ev.mnt->mnt_dir, "/watch/m") != 0)
+                continue;
+            CHECK(mounted != (ev.type == MOUNT_EVENT_ADD),
+                  "%s /watch/m read after a resync that %s it",
+                  (ev.type == MOUNT_EVENT_ADD) ? "add of" : "removal of",
+                  mounted ? "had" : "did not have");
+            mounted = (ev.type == MOUNT_EVENT_ADD);
+        }
+    }
+
+    pthread_join(thread, NULL);
+    mount_watch_close(watch);
+    return failures ? 1 : 0;
+}
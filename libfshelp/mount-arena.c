@@ -0,0 +1,98 @@
+/* hurd/libfshelp/mount-arena.c
+   Bump allocator for the transient allocations of mount(2) and umount(2).
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mount-priv.h"
+
+#define MOUNT_ARENA_ALIGN       __alignof__ (max_align_t)
+#define MOUNT_ARENA_CHUNK_MIN   4096
+
+/* Heap memory taken once the inline buffer is used up. */
+struct mount_arena_chunk
+{
+    struct mount_arena_chunk *next;
+    size_t                    size;
+    max_align_t               data[];
+};
+
+void
+mount_arena_init(struct mount_arena *arena)
+{
+    arena->cur    = (char *) arena->inline_buf;
+    arena->end    = arena->cur + sizeof(arena->inline_buf);
+    arena->chunks = NULL;
+}
+
+void *
+mount_arena_alloc(struct mount_arena *arena, size_t size)
+{
+    size_t  pad = -(uintptr_t) arena->cur & (MOUNT_ARENA_ALIGN - 1);
+    char   *ret;
+
+    if(size + pad > (size_t) (arena->end - arena->cur))
+    {
+        /* Grow geometrically so a large call still only allocates a few
+           times. */
+        size_t chunk_size = arena->chunks ? 2 * arena->chunks->size
+                                          : MOUNT_ARENA_CHUNK_MIN;
+        struct mount_arena_chunk *chunk;
+
+        if(chunk_size < size)
+            chunk_size = size;
+        chunk = malloc(sizeof(*chunk) + chunk_size);
+        if(!chunk)
+            return NULL;
+        chunk->next   = arena->chunks;
+        chunk->size   = chunk_size;
+        arena->chunks = chunk;
+        arena->cur    = (char *) chunk->data;
+        arena->end    = arena->cur + chunk_size;
+        pad           = 0;
+    }
+
+    ret = arena->cur + pad;
+    arena->cur = ret + size;
+    return ret;
+}
+
+char *
+mount_arena_strdup(struct mount_arena *arena, const char *str)
+{
+    size_t  len = strlen(str) + 1;
+    char   *ret = mount_arena_alloc(arena, len);
+
+    if(ret)
+        memcpy(ret, str, len);
+    return ret;
+}
+
+void
+mount_arena_free(struct mount_arena *arena)
+{
+    while(arena->chunks)
+    {
+        struct mount_arena_chunk *next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    mount_arena_init(arena);
+}
@@ -0,0 +1,334 @@
+/* hurd/libfshelp/mount-async.c
+   Asynchronous mount(2) and umount2(2) on a pool of worker threads.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* Most threads started to run requests.  Mounts mostly wait on the new
+   translator, so a few threads are enough to overlap them. */
+#define MOUNT_ASYNC_THREADS 4
+
+enum mount_async_state
+{
+    MOUNT_ASYNC_QUEUED,
+    MOUNT_ASYNC_RUNNING,
+    MOUNT_ASYNC_DONE
+};
+
+struct mount_async
+{
+    bool                    umount;
+    char                   *source;
+    char                   *target;
+    char                   *fstype;
+    void                   *data;      /* A string or struct mount_data. */
+    unsigned long           mountflags;
+    int                     flags;
+
+    mount_async_fn          fn;
+    void                   *cookie;
+    void                   *context;   /* For the trace hooks. */
+
+    enum mount_async_state  state;
+    error_t                 err;
+    /* Set while CALLER runs the callback of a request that is done. */
+    bool                    calling;
+    pthread_t               caller;
+    /* One for the caller until mount_async_free, one for the queue until
+       the request is done. */
+    int                     refs;
+    struct mount_async     *next;
+};
+
+static pthread_mutex_t     mount_async_lock    = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled when a request is queued. */
+static pthread_cond_t      mount_async_work    = PTHREAD_COND_INITIALIZER;
+/* Broadcast when any request is done. */
+static pthread_cond_t      mount_async_done    = PTHREAD_COND_INITIALIZER;
+static struct mount_async *mount_async_head    = NULL;
+static struct mount_async *mount_async_tail    = NULL;
+static int                 mount_async_threads = 0;
+static int                 mount_async_idle    = 0;
+
+static void
+mount_async_release(struct mount_async *req)
+{
+    if(--req->refs)
+        return;
+    free(req->source);
+    free(req->target);
+    free(req->fstype);
+    free(req->data);
+    free(req);
+}
+
+/* Mark REQ done with ERR and call its callback.  Called with
+   mount_async_lock held, which is dropped around the callback. */
+static void
+mount_async_finish(struct mount_async *req, error_t err)
+{
+    req->err   = err;
+    req->state = MOUNT_ASYNC_DONE;
+    if(req->fn)
+    {
+        /* Done already, so that the callback may ask for the result; other
+           waiters wait for it to return as well. */
+        req->calling = true;
+        req->caller  = pthread_self();
+        pthread_mutex_unlock(&mount_async_lock);
+        (*req->fn)(req, err, req->cookie);
+        pthread_mutex_lock(&mount_async_lock);
+        req->calling = false;
+    }
+    pthread_cond_broadcast(&mount_async_done);
+    mount_async_release(req);
+}
+
+static void *
+mount_async_worker(void *arg)
+{
+    pthread_mutex_lock(&mount_async_lock);
+    for(;;)
+    {
+        struct mount_async *req;
+        int                 ret;
+
+        while(!mount_async_head)
+        {
+            mount_async_idle++;
+            pthread_cond_wait(&mount_async_work, &mount_async_lock);
+            mount_async_idle--;
+        }
+
+        req = mount_async_head;
+        mount_async_head = req->next;
+        if(!mount_async_head)
+            mount_async_tail = NULL;
+        req->state = MOUNT_ASYNC_RUNNING;
+        pthread_mutex_unlock(&mount_async_lock);
+
+        mount_trace_set_context(req->context);
+        if(req->umount)
+            ret = umount2(req->target, req->flags);
+        else
+            ret = mount(req->source, req->target, req->fstype,
+                        req->mountflags, req->data);
+        mount_trace_set_context(NULL);
+
+        pthread_mutex_lock(&mount_async_lock);
+        mount_async_finish(req, ret ? errno : 0);
+    }
+    return NULL;
+}
+
+/* Queue REQ, starting a worker if none is idle.  On error REQ is freed. */
+static struct mount_async *
+mount_async_queue(struct mount_async *req)
+{
+    error_t err = 0;
+
+    req->state   = MOUNT_ASYNC_QUEUED;
+    req->context = mount_trace_get_context();
+    req->refs  = 2;
+    req->next  = NULL;
+
+    pthread_mutex_lock(&mount_async_lock);
+    if(!mount_async_idle && (mount_async_threads < MOUNT_ASYNC_THREADS))
+    {
+        pthread_t      thread;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        err = pthread_create(&thread, &attr, mount_async_worker, NULL);
+        pthread_attr_destroy(&attr);
+        if(!err)
+            mount_async_threads++;
+        else if(mount_async_threads)
+            /* The running workers will get to it. */
+            err = 0;
+    }
+    if(!err)
+    {
+        if(mount_async_tail)
+            mount_async_tail->next = req;
+        else
+            mount_async_head = req;
+        mount_async_tail = req;
+        pthread_cond_signal(&mount_async_work);
+    }
+    pthread_mutex_unlock(&mount_async_lock);
+
+    if(err)
+    {
+        req->refs = 1;
+        mount_async_release(req);
+        errno = err;
+        return NULL;
+    }
+    return req;
+}
+
+/* Copy STR into *COPY, leaving NULL as is. */
+static error_t
+mount_async_strdup(const char *str, char **copy)
+{
+    *copy = NULL;
+    if(!str)
+        return 0;
+    *copy = strdup(str);
+    return *copy ? 0 : ENOMEM;
+}
+
+/* Mounts a filesystem asynchronously. */
+struct mount_async *
+mount_async(const char *source, const char *target,
+            const char *filesystemtype, unsigned long mountflags,
+            const void *data, mount_async_fn fn, void *cookie)
+{
+    struct mount_async *req = calloc(1, sizeof(*req));
+    error_t             err;
+
+    if(!req)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    req->refs = 1;
+    if(mount_async_strdup(source, &req->source)
+       || mount_async_strdup(target, &req->target)
+       || mount_async_strdup(filesystemtype, &req->fstype))
+    {
+        mount_async_release(req);
+        errno = ENOMEM;
+        return NULL;
+    }
+    err = mount_data_dup(data, &req->data);
+    if(err)
+    {
+        mount_async_release(req);
+        errno = err;
+        return NULL;
+    }
+    req->mountflags = mountflags;
+    req->fn         = fn;
+    req->cookie     = cookie;
+
+    return mount_async_queue(req);
+}
+
+/* Unmounts a filesystem asynchronously. */
+struct mount_async *
+umount2_async(const char *target, int flags, mount_async_fn fn,
+              void *cookie)
+{
+    struct mount_async *req = calloc(1, sizeof(*req));
+
+    if(!req)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    req->refs = 1;
+    if(mount_async_strdup(target, &req->target))
+    {
+        mount_async_release(req);
+        errno = ENOMEM;
+        return NULL;
+    }
+    req->umount = true;
+    req->flags  = flags;
+    req->fn     = fn;
+    req->cookie = cookie;
+
+    return mount_async_queue(req);
+}
+
+/* Return the result of REQ, or EINPROGRESS if it is not done. */
+int
+mount_async_status(struct mount_async *req)
+{
+    error_t err;
+
+    pthread_mutex_lock(&mount_async_lock);
+    err = (req->state == MOUNT_ASYNC_DONE) ? req->err : EINPROGRESS;
+    pthread_mutex_unlock(&mount_async_lock);
+    return err;
+}
+
+/* Wait for REQ to be done and return its result. */
+int
+mount_async_wait(struct mount_async *req)
+{
+    error_t err;
+
+    pthread_mutex_lock(&mount_async_lock);
+    while((req->state != MOUNT_ASYNC_DONE)
+          || (req->calling && !pthread_equal(req->caller, pthread_self())))
+        pthread_cond_wait(&mount_async_done, &mount_async_lock);
+    err = req->err;
+    pthread_mutex_unlock(&mount_async_lock);
+    return err;
+}
+
+/* Cancel REQ if no worker has started on it yet. */
+int
+mount_async_cancel(struct mount_async *req)
+{
+    error_t err = 0;
+
+    pthread_mutex_lock(&mount_async_lock);
+    if(req->state == MOUNT_ASYNC_QUEUED)
+    {
+        struct mount_async **prev = &mount_async_head;
+        struct mount_async  *last = NULL;
+
+        while(*prev != req)
+        {
+            last = *prev;
+            prev = &(*prev)->next;
+        }
+        *prev = req->next;
+        if(mount_async_tail == req)
+            mount_async_tail = last;
+
+        req->state = MOUNT_ASYNC_RUNNING;
+        mount_async_finish(req, ECANCELED);
+    }
+    else
+        err = EBUSY;
+    pthread_mutex_unlock(&mount_async_lock);
+    return err;
+}
+
+/* Release REQ.  A request that is still running completes, but its result
+   is discarded. */
+void
+mount_async_free(struct mount_async *req)
+{
+    pthread_mutex_lock(&mount_async_lock);
+    mount_async_release(req);
+    pthread_mutex_unlock(&mount_async_lock);
+}
@@ -0,0 +1,333 @@
+/* hurd/libfshelp/mount-control.c
+   Control ports of mounted translators.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+
+#include <fcntl.h>
+#include <hurd.h>
+#include <hurd/fsys.h>
+#include <mach.h>
+#include <mach/notify.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mount-priv.h"
+
+/* The control ports of the translators we started, and the nodes they sit
+   on, by mount point.  An entry holds a send right to each.  A dead-name
+   notification for the control port, handled by a thread of its own,
+   drops the entry once its translator is gone. */
+
+struct mount_control
+{
+    char                 *dir;
+    fsys_t                control;
+    file_t                node;
+    struct mount_control *next;
+};
+
+#define MOUNT_CONTROL_BUCKETS 64
+
+static pthread_mutex_t       mount_control_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mount_control *mount_controls[MOUNT_CONTROL_BUCKETS];
+/* The receive right the notifications are sent to. */
+static mach_port_t           mount_control_notify = MACH_PORT_NULL;
+static pthread_once_t        mount_control_once = PTHREAD_ONCE_INIT;
+
+static struct mount_control **
+mount_control_bucket(const char *dir)
+{
+    size_t h = 5381;
+
+    while(*dir)
+        h = h * 33 + (unsigned char) *dir++;
+    return &mount_controls[h % MOUNT_CONTROL_BUCKETS];
+}
+
+/* Held by a call while it changes what is mounted on a mount point; see
+   mount_point_lock.  Striped by the hash of the buckets. */
+static pthread_mutex_t       mount_point_locks[MOUNT_CONTROL_BUCKETS] =
+    { [0 ... MOUNT_CONTROL_BUCKETS - 1] = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_mutex_t *
+mount_point_mutex(const char *dir)
+{
+    return &mount_point_locks[mount_control_bucket(dir) - mount_controls];
+}
+
+void
+mount_point_lock(const char *dir)
+{
+    pthread_mutex_lock(mount_point_mutex(dir));
+}
+
+void
+mount_point_unlock(const char *dir)
+{
+    pthread_mutex_unlock(mount_point_mutex(dir));
+}
+
+#if MOUNT_CONTROL_BUCKETS > 64
+# error "mount_point_bit needs a bit for each lock"
+#endif
+
+uint64_t
+mount_point_bit(const char *dir)
+{
+    return (uint64_t) 1 << (mount_point_mutex(dir) - mount_point_locks);
+}
+
+void
+mount_point_lock_mask(uint64_t mask)
+{
+    /* Always in the same order, so two callers cannot deadlock. */
+    for(size_t i = 0; i < MOUNT_CONTROL_BUCKETS; i++)
+        if(mask & ((uint64_t) 1 << i))
+            pthread_mutex_lock(&mount_point_locks[i]);
+}
+
+void
+mount_point_unlock_mask(uint64_t mask)
+{
+    for(size_t i = 0; i < MOUNT_CONTROL_BUCKETS; i++)
+        if(mask & ((uint64_t) 1 << i))
+            pthread_mutex_unlock(&mount_point_locks[i]);
+}
+
+static void
+mount_control_free(struct mount_control *mc)
+{
+    mach_port_deallocate(mach_task_self(), mc->control);
+    mach_port_deallocate(mach_task_self(), mc->node);
+    free(mc->dir);
+    free(mc);
+}
+
+/* Drop the entry whose control port is CONTROL, now a dead name. */
+static void
+mount_control_dead(mach_port_t control)
+{
+    struct mount_control *dead = NULL;
+
+    pthread_mutex_lock(&mount_control_lock);
+    for(size_t b = 0; !dead && (b < MOUNT_CONTROL_BUCKETS); b++)
+        for(struct mount_control **prev = &mount_controls[b]; *prev;
+            prev = &(*prev)->next)
+            if((*prev)->control == control)
+            {
+                dead  = *prev;
+                *prev = dead->next;
+                break;
+            }
+    pthread_mutex_unlock(&mount_control_lock);
+
+    if(dead)
+        mount_control_free(dead);
+}
+
+static void *
+mount_control_notify_run(void *arg)
+{
+    for(;;)
+    {
+        union
+        {
+            mach_msg_header_t             hdr;
+            mach_dead_name_notification_t dead;
+            char                          buf[256];
+        } msg;
+
+        if(mach_msg(&msg.hdr, MACH_RCV_MSG, 0, sizeof(msg),
+                    mount_control_notify, MACH_MSG_TIMEOUT_NONE,
+                    MACH_PORT_NULL) != MACH_MSG_SUCCESS)
+            continue;
+
+        /* Port-deleted notifications, for the entries we dropped
+           ourselves, need nothing done. */
+        if(msg.hdr.msgh_id == MACH_NOTIFY_DEAD_NAME)
+        {
+            /* The notification carries a reference of its own.  Holding
+               it keeps the name from being reused for another
+               translator's control port until the entry is unlinked, so
+               it is dropped last. */
+            mount_control_dead(msg.dead.not_port);
+            mach_port_deallocate(mach_task_self(), msg.dead.not_port);
+        }
+    }
+    return NULL;
+}
+
+static void
+mount_control_init(void)
+{
+    pthread_t thread;
+
+    if(mach_port_allocate(mach_task_self(), MACH_PORT_RIGHT_RECEIVE,
+                          &mount_control_notify) != 0)
+    {
+        mount_control_notify = MACH_PORT_NULL;
+        return;
+    }
+    if(pthread_create(&thread, NULL, mount_control_notify_run, NULL) == 0)
+        pthread_detach(thread);
+    else
+    {
+        mach_port_mod_refs(mach_task_self(), mount_control_notify,
+                           MACH_PORT_RIGHT_RECEIVE, -1);
+        mount_control_notify = MACH_PORT_NULL;
+    }
+}
+
+/* Remove and return the entry for DIR.  Called with mount_control_lock
+   held. */
+static struct mount_control *
+mount_control_unlink(const char *dir)
+{
+    for(struct mount_control **prev = mount_control_bucket(dir); *prev;
+        prev = &(*prev)->next)
+        if(strcmp((*prev)->dir, dir) == 0)
+        {
+            struct mount_control *mc = *prev;
+
+            *prev = mc->next;
+            return mc;
+        }
+    return NULL;
+}
+
+void
+mount_control_add(const char *dir, fsys_t control, file_t node)
+{
+    struct mount_control *mc   = NULL;
+    struct mount_control *old  = NULL;
+    mach_port_t           prev = MACH_PORT_NULL;
+
+    pthread_once(&mount_control_once, mount_control_init);
+
+    mc = malloc(sizeof(*mc));
+    if(mc)
+        mc->dir = strdup(dir);
+    /* Without notifications an entry could outlive its translator. */
+    if(!mc || !mc->dir || (mount_control_notify == MACH_PORT_NULL)
+       || (mach_port_request_notification(mach_task_self(), control,
+                                          MACH_NOTIFY_DEAD_NAME, 1,
+                                          mount_control_notify,
+                                          MACH_MSG_TYPE_MAKE_SEND_ONCE,
+                                          &prev) != 0))
+    {
+        if(mc)
+            free(mc->dir);
+        free(mc);
+        mach_port_deallocate(mach_task_self(), control);
+        mach_port_deallocate(mach_task_self(), node);
+        return;
+    }
+    if(prev != MACH_PORT_NULL)
+        mach_port_deallocate(mach_task_self(), prev);
+    mc->control = control;
+    mc->node    = node;
+
+    pthread_mutex_lock(&mount_control_lock);
+    old = mount_control_unlink(dir);
+    mc->next = *mount_control_bucket(dir);
+    *mount_control_bucket(dir) = mc;
+    pthread_mutex_unlock(&mount_control_lock);
+
+    if(old)
+        mount_control_free(old);
+}
+
+void
+mount_control_forget(const char *dir)
+{
+    struct mount_control *mc;
+
+    pthread_mutex_lock(&mount_control_lock);
+    mc = mount_control_unlink(dir);
+    pthread_mutex_unlock(&mount_control_lock);
+
+    if(mc)
+        mount_control_free(mc);
+}
+
+error_t
+mount_control_get(const char *dir, fsys_t *control, file_t *node)
+{
+    error_t               err  = 0;
+    struct mount_control *mc   = NULL;
+    struct mount_control *dead = NULL;
+    file_t                n    = MACH_PORT_NULL;
+
+    pthread_mutex_lock(&mount_control_lock);
+    for(mc = *mount_control_bucket(dir); mc; mc = mc->next)
+        if(strcmp(mc->dir, dir) == 0)
+            break;
+    if(mc)
+    {
+        mach_port_type_t type = 0;
+
+        /* The notification may not have been handled yet. */
+        if((mach_port_type(mach_task_self(), mc->control, &type) != 0)
+           || (type & MACH_PORT_TYPE_DEAD_NAME))
+        {
+            dead = mount_control_unlink(dir);
+            mc   = NULL;
+        }
+        else
+        {
+            if(control)
+            {
+                mach_port_mod_refs(mach_task_self(), mc->control,
+                                   MACH_PORT_RIGHT_SEND, 1);
+                *control = mc->control;
+            }
+            if(node)
+            {
+                mach_port_mod_refs(mach_task_self(), mc->node,
+                                   MACH_PORT_RIGHT_SEND, 1);
+                *node = mc->node;
+            }
+        }
+    }
+    pthread_mutex_unlock(&mount_control_lock);
+
+    if(dead)
+        mount_control_free(dead);
+    if(mc)
+        return 0;
+
+    /* Not one of ours: ask the node. */
+    n = file_name_lookup(dir, O_NOTRANS, 0666);
+    if(n == MACH_PORT_NULL)
+        return errno;
+    if(control)
+    {
+        err = file_get_translator_cntl(n, control);
+        if(err)
+        {
+            mach_port_deallocate(mach_task_self(), n);
+            return err;
+        }
+    }
+    if(node)
+        *node = n;
+    else
+        mach_port_deallocate(mach_task_self(), n);
+    return 0;
+}
@@ -0,0 +1,362 @@
+/* hurd/libfshelp/mount-detach.c
+   Lazy unmounting for umount2(2) with MNT_DETACH.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mount.h>
+#include <hurd/fsys.h>
+#include "mount-priv.h"
+
+/* Finished detaches remembered for umount_detach_status; the oldest are
+   forgotten past this. */
+#define MOUNT_DETACH_KEEP 256
+
+/* How long the reaper waits before asking a translator that refused with
+   EBUSY again, at first and at most; the wait doubles each time. */
+#define MOUNT_DETACH_RETRY_MIN 10               /* Milliseconds. */
+#define MOUNT_DETACH_RETRY_MAX 1000
+
+/* A translator detached from its mount point that the reaper has yet to
+   make go away, or has already. */
+struct mount_detach
+{
+    char                *target;
+    char                *fsname;
+    fsys_t               control;
+    int                  goaway_flags;
+    error_t              err;       /* EINPROGRESS until reaped. */
+    struct timespec      due;       /* When to ask it to go away. */
+    unsigned int         retry;     /* Milliseconds until the next try. */
+    struct mount_detach *next;      /* Reaper queue. */
+    struct mount_detach *older;     /* All detaches, newest first. */
+};
+
+static pthread_mutex_t      mount_detach_lock    = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled when a detach is queued. */
+static pthread_cond_t       mount_detach_queued  = PTHREAD_COND_INITIALIZER;
+static struct mount_detach *mount_detach_head    = NULL;
+static struct mount_detach *mount_detach_tail    = NULL;
+static struct mount_detach *mount_detach_all     = NULL;
+static size_t               mount_detach_count   = 0;
+static bool                 mount_detach_reaping = false;
+
+static void
+mount_detach_free(struct mount_detach *det)
+{
+    free(det->target);
+    free(det->fsname);
+    free(det);
+}
+
+/* Forget the oldest finished detaches past MOUNT_DETACH_KEEP.  Called with
+   mount_detach_lock held. */
+static void
+mount_detach_trim(void)
+{
+    struct mount_detach **prev = &mount_detach_all;
+    size_t                seen = 0;
+
+    while(*prev)
+    {
+        struct mount_detach *det = *prev;
+
+        if((++seen > MOUNT_DETACH_KEEP) && (det->err != EINPROGRESS))
+        {
+            *prev = det->older;
+            mount_detach_free(det);
+            mount_detach_count--;
+        }
+        else
+            prev = &det->older;
+    }
+}
+
+/* Whether CONTROL names a translator that is gone. */
+static bool
+mount_detach_dead(fsys_t control)
+{
+    mach_port_type_t type = 0;
+
+    return (mach_port_type(mach_task_self(), control, &type) == 0)
+        && (type & MACH_PORT_TYPE_DEAD_NAME);
+}
+
+/* Make DET's translator go away, as do_umount does for an attached one.
+   EBUSY if it refused and should be asked again later. */
+static error_t
+mount_detach_reap(struct mount_detach *det)
+{
+    error_t err = fsys_goaway(det->control, det->goaway_flags);
+
+    /* Gone on its own since it was detached, so there is nothing left to
+       make go away. */
+    if(err && mount_detach_dead(det->control))
+        err = 0;
+    if(err == EBUSY)
+        return err;
+
+    if(!err && (det->fsname[0] != '\0') && (strcmp(det->fsname, "none") != 0))
+    {
+        file_t source = file_name_lookup(det->fsname, O_NOTRANS, 0666);
+        if(source == MACH_PORT_NULL)
+            return 0;
+
+        err = file_set_translator(source, 0, FS_TRANS_SET, det->goaway_flags,
+                                  NULL, 0, MACH_PORT_NULL,
+                                  MACH_MSG_TYPE_COPY_SEND);
+        mach_port_deallocate(mach_task_self(), source);
+
+        if(!(det->goaway_flags & FSYS_GOAWAY_FORCE))
+            err = 0;
+    }
+    return err;
+}
+
+/* Queue DET to be reaped at DET->due.  Called with mount_detach_lock
+   held. */
+static void
+mount_detach_queue(struct mount_detach *det)
+{
+    det->next = NULL;
+    if(mount_detach_tail)
+        mount_detach_tail->next = det;
+    else
+        mount_detach_head = det;
+    mount_detach_tail = det;
+    pthread_cond_signal(&mount_detach_queued);
+}
+
+static bool
+mount_detach_before(const struct timespec *a, const struct timespec *b)
+{
+    return (a->tv_sec < b->tv_sec)
+        || ((a->tv_sec == b->tv_sec) && (a->tv_nsec < b->tv_nsec));
+}
+
+/* Take the queued detach due first out of the queue if it is due by NOW,
+   and return it.  Otherwise store when it is due in DUE and return NULL.
+   Called with mount_detach_lock held. */
+static struct mount_detach *
+mount_detach_next(const struct timespec *now, struct timespec *due)
+{
+    struct mount_detach *first      = mount_detach_head;
+    struct mount_detach *first_prev = NULL;
+
+    for(struct mount_detach *prev = mount_detach_head, *det = prev->next;
+        det; prev = det, det = det->next)
+        if(mount_detach_before(&det->due, &first->due))
+        {
+            first      = det;
+            first_prev = prev;
+        }
+
+    if(mount_detach_before(now, &first->due))
+    {
+        *due = first->due;
+        return NULL;
+    }
+    if(first_prev)
+        first_prev->next = first->next;
+    else
+        mount_detach_head = first->next;
+    if(mount_detach_tail == first)
+        mount_detach_tail = first_prev;
+    return first;
+}
+
+/* Put off DET after it refused to go away, doubling the wait each time. */
+static void
+mount_detach_defer(struct mount_detach *det, const struct timespec *now)
+{
+    det->retry = det->retry ? det->retry * 2 : MOUNT_DETACH_RETRY_MIN;
+    if(det->retry > MOUNT_DETACH_RETRY_MAX)
+        det->retry = MOUNT_DETACH_RETRY_MAX;
+
+    det->due          = *now;
+    det->due.tv_sec  += det->retry / 1000;
+    det->due.tv_nsec += (det->retry % 1000) * 1000000L;
+    if(det->due.tv_nsec >= 1000000000L)
+    {
+        det->due.tv_sec++;
+        det->due.tv_nsec -= 1000000000L;
+    }
+}
+
+static void *
+mount_detach_reaper(void *arg)
+{
+    pthread_mutex_lock(&mount_detach_lock);
+    while(mount_detach_head)
+    {
+        struct mount_detach *det;
+        struct timespec      now, due;
+        error_t              err;
+
+        clock_gettime(CLOCK_REALTIME, &now);
+        det = mount_detach_next(&now, &due);
+        if(!det)
+        {
+            /* Only translators that refused are left; wait for the first
+               of them or for a new detach. */
+            pthread_cond_timedwait(&mount_detach_queued, &mount_detach_lock,
+                                   &due);
+            continue;
+        }
+        pthread_mutex_unlock(&mount_detach_lock);
+
+        /* Until it goes away or its port is a dead name, the translator
+           stays queued; one that never does keeps the reaper. */
+        err = mount_detach_reap(det);
+        if(err != EBUSY)
+            mach_port_deallocate(mach_task_self(), det->control);
+
+        pthread_mutex_lock(&mount_detach_lock);
+        if(err == EBUSY)
+        {
+            clock_gettime(CLOCK_REALTIME, &now);
+            mount_detach_defer(det, &now);
+            mount_detach_queue(det);
+        }
+        else
+            det->err = err;
+    }
+    /* Exit when idle; the next detach starts a new reaper. */
+    mount_detach_reaping = false;
+    pthread_mutex_unlock(&mount_detach_lock);
+    return NULL;
+}
+
+/* Start a reaper unless one runs.  If none can be started the queue waits
+   for the next call to try again; reaping here instead would keep the
+   caller, and the mount point lock it holds, for as long as a translator
+   refuses to go away.  Called with mount_detach_lock held. */
+static void
+mount_detach_start_reaper(void)
+{
+    pthread_t      thread;
+    pthread_attr_t attr;
+
+    if(mount_detach_reaping || !mount_detach_head)
+        return;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&thread, &attr, mount_detach_reaper, NULL) == 0)
+        mount_detach_reaping = true;
+    pthread_attr_destroy(&attr);
+}
+
+error_t
+mount_detach(const struct mntent *mntent, int goaway_flags)
+{
+    error_t              err     = 0;
+    fsys_t               control = MACH_PORT_NULL;
+    struct mount_detach *det     = NULL;
+    file_t               node    = MACH_PORT_NULL;
+
+    err = mount_control_get(mntent->mnt_dir, &control, &node);
+    if(err)
+        return err;
+
+    det = calloc(1, sizeof(*det));
+    if(det)
+    {
+        det->target = strdup(mntent->mnt_dir);
+        det->fsname = strdup(mntent->mnt_fsname);
+    }
+    if(!det || !det->target || !det->fsname)
+    {
+        err = ENOMEM;
+        goto end_detach;
+    }
+
+    /* Take the translator out of the namespace without asking it to go
+       away; the reaper does that with the control port we hold. */
+    err = file_set_translator(node, mount_lazy_passive_flags(mntent),
+                              FS_TRANS_SET | FS_TRANS_ORPHAN, 0,
+                              NULL, 0, MACH_PORT_NULL,
+                              MACH_MSG_TYPE_COPY_SEND);
+    if(err)
+        goto end_detach;
+
+    det->control      = control;
+    det->goaway_flags = goaway_flags;
+    det->err          = EINPROGRESS;
+    control           = MACH_PORT_NULL;
+
+    pthread_mutex_lock(&mount_detach_lock);
+    det->older       = mount_detach_all;
+    mount_detach_all = det;
+    mount_detach_count++;
+    if(mount_detach_count > MOUNT_DETACH_KEEP)
+        mount_detach_trim();
+
+    clock_gettime(CLOCK_REALTIME, &det->due);
+    mount_detach_queue(det);
+    mount_detach_start_reaper();
+    pthread_mutex_unlock(&mount_detach_lock);
+    det = NULL;
+
+end_detach:
+    if(det)
+        mount_detach_free(det);
+    if(control != MACH_PORT_NULL)
+        mach_port_deallocate(mach_task_self(), control);
+    mach_port_deallocate(mach_task_self(), node);
+    return err;
+}
+
+/* Return the state of the last detach of TARGET. */
+int
+umount_detach_status(const char *target)
+{
+    error_t            err = 0;
+    char              *dir = NULL;
+    struct mount_arena arena;
+
+    if(!target || (target[0] == '\0'))
+        return EINVAL;
+
+    /* Detaches are remembered by the mount point umount2 found. */
+    mount_arena_init(&arena);
+    err = mount_path_absolute(&arena, target, &dir);
+    if(err)
+    {
+        mount_arena_free(&arena);
+        return err;
+    }
+
+    err = ENOENT;
+    pthread_mutex_lock(&mount_detach_lock);
+    for(struct mount_detach *det = mount_detach_all; det; det = det->older)
+        if(strcmp(det->target, dir) == 0)
+        {
+            err = det->err;
+            break;
+        }
+    /* Queued work left by a call that could not start a reaper. */
+    if(err == EINPROGRESS)
+        mount_detach_start_reaper();
+    pthread_mutex_unlock(&mount_detach_lock);
+    mount_arena_free(&arena);
+    return err;
+}
@@ -0,0 +1,180 @@
+/* hurd/libfshelp/mount-fstype.c
+   Cache of the translator programs that implement each filesystem type.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <hurd/paths.h>
+#include "mount-priv.h"
+
+/* Past this many types the cache is simply emptied, so that a caller
+   trying bogus types cannot grow it without bound. */
+#define MOUNT_FSTYPE_MAX 64
+
+struct mount_fstype
+{
+    char                *name;
+    char                *program;   /* NULL if there is no translator. */
+    struct mount_fstype *next;
+};
+
+static pthread_mutex_t      mount_fstype_lock    = PTHREAD_MUTEX_INITIALIZER;
+static struct mount_fstype *mount_fstypes        = NULL;
+static size_t               mount_fstypes_count  = 0;
+/* Modification time of _HURD when the cache was filled; installing or
+   removing a translator there changes it. */
+static struct timespec      mount_fstype_stamp;
+/* Moved on whenever the cache is flushed, so that a search started before
+   is not cached after it. */
+static unsigned long        mount_fstype_generation;
+
+/* Empty the cache.  Called with mount_fstype_lock held. */
+static void
+mount_fstype_clear(void)
+{
+    while(mount_fstypes)
+    {
+        struct mount_fstype *next = mount_fstypes->next;
+        free(mount_fstypes->name);
+        free(mount_fstypes->program);
+        free(mount_fstypes);
+        mount_fstypes = next;
+    }
+    mount_fstypes_count = 0;
+}
+
+/* Return the entry for type NAME, or NULL.  Called with
+   mount_fstype_lock held. */
+static struct mount_fstype *
+mount_fstype_find(const char *name)
+{
+    struct mount_fstype *entry;
+
+    for(entry = mount_fstypes; entry; entry = entry->next)
+        if(strcasecmp(entry->name, name) == 0)
+            break;
+    return entry;
+}
+
+/* Remember that type NAME is implemented by PROGRAM, which may be NULL.
+   Called with mount_fstype_lock held; failing to allocate just means the
+   result is not cached. */
+static void
+mount_fstype_add(const char *name, const char *program)
+{
+    struct mount_fstype *entry;
+
+    /* Another thread may have searched for it meanwhile. */
+    if(mount_fstype_find(name))
+        return;
+
+    entry = malloc(sizeof(*entry));
+
+    if(!entry)
+        return;
+    entry->name    = strdup(name);
+    entry->program = program ? strdup(program) : NULL;
+    if(!entry->name || (program && !entry->program))
+    {
+        free(entry->name);
+        free(entry->program);
+        free(entry);
+        return;
+    }
+
+    if(mount_fstypes_count >= MOUNT_FSTYPE_MAX)
+        mount_fstype_clear();
+    entry->next   = mount_fstypes;
+    mount_fstypes = entry;
+    mount_fstypes_count++;
+}
+
+error_t
+mount_fstype_program(struct mount_arena *arena, struct fs *fs,
+                     char **program)
+{
+    error_t              err   = 0;
+    struct mount_fstype *entry = NULL;
+    struct fstype       *type  = NULL;
+    struct stat          st;
+
+    if(stat(_HURD, &st) != 0)
+        memset(&st, 0, sizeof(st));
+
+    pthread_mutex_lock(&mount_fstype_lock);
+    if((st.st_mtim.tv_sec != mount_fstype_stamp.tv_sec)
+       || (st.st_mtim.tv_nsec != mount_fstype_stamp.tv_nsec))
+    {
+        mount_fstype_clear();
+        mount_fstype_stamp = st.st_mtim;
+        mount_fstype_generation++;
+    }
+
+    entry = mount_fstype_find(fs->mntent.mnt_type);
+    if(entry)
+    {
+        if(entry->program)
+            *program = mount_arena_strdup(arena, entry->program);
+        else
+            err = EFTYPE;
+        pthread_mutex_unlock(&mount_fstype_lock);
+    }
+    else
+    {
+        unsigned long generation = mount_fstype_generation;
+
+        pthread_mutex_unlock(&mount_fstype_lock);
+
+        /* Search for the program through FS's own fstab, without holding
+           the lock so that mounts of other types are not held up.  Errors
+           other than not finding one may be transient, so they are not
+           cached. */
+        err = fs_type(fs, &type);
+        if(err)
+            return err;
+
+        pthread_mutex_lock(&mount_fstype_lock);
+        if(generation == mount_fstype_generation)
+            mount_fstype_add(fs->mntent.mnt_type, type->program);
+        pthread_mutex_unlock(&mount_fstype_lock);
+
+        if(type->program)
+            *program = mount_arena_strdup(arena, type->program);
+        else
+            err = EFTYPE;
+    }
+
+    if(!err && !*program)
+        err = ENOMEM;
+    return err;
+}
+
+/* Forget the translator programs found for filesystem types. */
+void
+mount_fstype_flush(void)
+{
+    pthread_mutex_lock(&mount_fstype_lock);
+    mount_fstype_clear();
+    mount_fstype_generation++;
+    pthread_mutex_unlock(&mount_fstype_lock);
+}
@@ -0,0 +1,416 @@
+/* hurd/libfshelp/mount-index.c
+   Index of a mount table by mount point and by device.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mount-priv.h"
+
+/* The mount points form a trie with one node per path component.  The
+   edges of every node live in one hash table keyed by the parent node and
+   the component, so finding a child costs the same however many siblings
+   it has, and a lookup costs one probe per component of the path. */
+
+struct mount_index_mount
+{
+    struct fs                *fs;
+    struct mount_index_mount *next;     /* Same mount point, in fstab order. */
+};
+
+struct mount_index_node
+{
+    struct mount_index_node  *parent;
+    const char               *name;     /* Points into a mnt_dir. */
+    size_t                    name_len;
+    struct mount_index_node  *child;    /* First child, for walks. */
+    struct mount_index_node  *sibling;
+    struct mount_index_mount *mounts;
+    struct mount_index_mount *mounts_tail;
+};
+
+struct mount_index
+{
+    struct mount_index_node   root;
+    struct mount_index_node  *nodes;
+    size_t                    nnodes;
+    struct mount_index_node **edges;    /* Open addressing, by parent+name. */
+    size_t                    edges_mask;
+    struct mount_index_mount *mounts;
+    struct fs               **devices;  /* Open addressing, by mnt_fsname. */
+    size_t                    devices_mask;
+};
+
+static size_t
+hash_bytes(size_t h, const char *s, size_t len)
+{
+    for(size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) s[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+static size_t
+hash_edge(const struct mount_index_node *parent, const char *name, size_t len)
+{
+    return hash_bytes(0xcbf29ce484222325ULL ^ (uintptr_t) parent, name, len);
+}
+
+/* Return the next component of the path at *PATH and its length in *LEN,
+   advancing *PATH past it, or NULL at the end.  Empty and `.' components
+   are skipped. */
+static const char *
+path_next(const char **path, size_t *len)
+{
+    const char *p = *path;
+
+    for(;;)
+    {
+        const char *comp;
+
+        while(*p == '/')
+            p++;
+        if(!*p)
+        {
+            *path = p;
+            return NULL;
+        }
+        comp = p;
+        while(*p && (*p != '/'))
+            p++;
+        if((p - comp == 1) && (comp[0] == '.'))
+            continue;
+        *path = p;
+        *len  = p - comp;
+        return comp;
+    }
+}
+
+static size_t
+path_components(const char *path)
+{
+    size_t n = 0, len;
+
+    while(path_next(&path, &len))
+        n++;
+    return n;
+}
+
+/* Return the child of PARENT called NAME, or NULL. */
+static struct mount_index_node *
+edge_find(const struct mount_index *index,
+          const struct mount_index_node *parent, const char *name, size_t len)
+{
+    for(size_t i = hash_edge(parent, name, len) & index->edges_mask;
+        index->edges[i]; i = (i + 1) & index->edges_mask)
+    {
+        struct mount_index_node *node = index->edges[i];
+
+        if((node->parent == parent) && (node->name_len == len)
+           && (memcmp(node->name, name, len) == 0))
+            return node;
+    }
+    return NULL;
+}
+
+/* Return the child of PARENT called NAME, adding it if needed.  There is
+   always room, since the tables are sized for every component. */
+static struct mount_index_node *
+edge_add(struct mount_index *index, struct mount_index_node *parent,
+         const char *name, size_t len)
+{
+    size_t i = hash_edge(parent, name, len) & index->edges_mask;
+    struct mount_index_node *node;
+
+    for(; index->edges[i]; i = (i + 1) & index->edges_mask)
+    {
+        node = index->edges[i];
+        if((node->parent == parent) && (node->name_len == len)
+           && (memcmp(node->name, name, len) == 0))
+            return node;
+    }
+
+    node = &index->nodes[index->nnodes++];
+    memset(node, 0, sizeof(*node));
+    node->parent   = parent;
+    node->name     = name;
+    node->name_len = len;
+    node->sibling  = parent->child;
+    parent->child  = node;
+    index->edges[i] = node;
+    return node;
+}
+
+/* Return the smallest power of two that is at least twice N. */
+static size_t
+table_size(size_t n)
+{
+    size_t size = 8;
+
+    while(size < 2 * n)
+        size *= 2;
+    return size;
+}
+
+error_t
+mount_index_build(struct fstab *fstab, struct mount_index **index)
+{
+    struct mount_index *idx;
+    size_t              ncomps  = 0;
+    size_t              nmounts = 0;
+    size_t              i       = 0;
+
+    for(struct fs *fs = fstab->entries; fs; fs = fs->next)
+    {
+        ncomps += path_components(fs->mntent.mnt_dir);
+        nmounts++;
+    }
+
+    idx = calloc(1, sizeof(*idx));
+    if(!idx)
+        return ENOMEM;
+    idx->edges_mask   = table_size(ncomps) - 1;
+    idx->devices_mask = table_size(nmounts) - 1;
+    idx->nodes   = malloc((ncomps ?: 1) * sizeof(*idx->nodes));
+    idx->mounts  = malloc((nmounts ?: 1) * sizeof(*idx->mounts));
+    idx->edges   = calloc(idx->edges_mask + 1, sizeof(*idx->edges));
+    idx->devices = calloc(idx->devices_mask + 1, sizeof(*idx->devices));
+    if(!idx->nodes || !idx->mounts || !idx->edges || !idx->devices)
+    {
+        mount_index_free(idx);
+        return ENOMEM;
+    }
+
+    for(struct fs *fs = fstab->entries; fs; fs = fs->next, i++)
+    {
+        struct mount_index_node  *node = &idx->root;
+        struct mount_index_mount *m    = &idx->mounts[i];
+        const char               *path = fs->mntent.mnt_dir;
+        const char               *comp;
+        const char               *dev  = fs->mntent.mnt_fsname;
+        size_t                    len, d;
+
+        while((comp = path_next(&path, &len)))
+            node = edge_add(idx, node, comp, len);
+
+        m->fs   = fs;
+        m->next = NULL;
+        if(node->mounts_tail)
+            node->mounts_tail->next = m;
+        else
+            node->mounts = m;
+        node->mounts_tail = m;
+
+        /* Keep the first entry of each device, as fstab_find_device. */
+        for(d = hash_bytes(0xcbf29ce484222325ULL, dev, strlen(dev))
+                & idx->devices_mask;
+            idx->devices[d]; d = (d + 1) & idx->devices_mask)
+            if(strcmp(idx->devices[d]->mntent.mnt_fsname, dev) == 0)
+                break;
+        if(!idx->devices[d])
+            idx->devices[d] = fs;
+    }
+
+    *index = idx;
+    return 0;
+}
+
+void
+mount_index_free(struct mount_index *index)
+{
+    if(!index)
+        return;
+    free(index->nodes);
+    free(index->mounts);
+    free(index->edges);
+    free(index->devices);
+    free(index);
+}
+
+/* Return the node for PATH, or if CONTAINING, that of the deepest mount
+   point that contains PATH.  `..' is taken lexically.  A relative PATH
+   matches nothing, since the mount points are absolute. */
+static const struct mount_index_node *
+mount_index_walk(const struct mount_index *index, const char *path,
+                 bool containing)
+{
+    const struct mount_index_node *node  = &index->root;
+    const struct mount_index_node *found = index->root.mounts ? node : NULL;
+    /* How far PATH has gone below NODE through components not in the
+       trie. */
+    size_t                         below = 0;
+    const char                    *comp;
+    size_t                         len;
+
+    if(path[0] != '/')
+        return NULL;
+
+    while((comp = path_next(&path, &len)))
+    {
+        if((len == 2) && (comp[0] == '.') && (comp[1] == '.'))
+        {
+            if(below)
+                below--;
+            else if(node->parent)
+            {
+                node = node->parent;
+                /* Going back up, recompute the deepest mount above. */
+                for(found = node; found && !found->mounts;
+                    found = found->parent)
+                    ;
+            }
+            continue;
+        }
+        if(!below)
+        {
+            const struct mount_index_node *child
+                = edge_find(index, node, comp, len);
+            if(child)
+            {
+                node = child;
+                if(node->mounts)
+                    found = node;
+                continue;
+            }
+        }
+        below++;
+    }
+
+    if(containing)
+        return found;
+    return below ? NULL : node;
+}
+
+struct fs *
+mount_index_find_mount(const struct mount_index *index, const char *dir)
+{
+    const struct mount_index_node *node = mount_index_walk(index, dir, false);
+
+    return (node && node->mounts) ? node->mounts->fs : NULL;
+}
+
+struct fs *
+mount_index_find_device(const struct mount_index *index, const char *dev)
+{
+    for(size_t d = hash_bytes(0xcbf29ce484222325ULL, dev, strlen(dev))
+            & index->devices_mask;
+        index->devices[d]; d = (d + 1) & index->devices_mask)
+        if(strcmp(index->devices[d]->mntent.mnt_fsname, dev) == 0)
+            return index->devices[d];
+    return NULL;
+}
+
+struct fs *
+mount_index_containing(const struct mount_index *index, const char *path)
+{
+    const struct mount_index_node *node = mount_index_walk(index, path, true);
+
+    return node ? node->mounts->fs : NULL;
+}
+
+size_t
+mount_index_each_under(const struct mount_index *index, const char *dir,
+                       void (*fn)(struct fs *fs, void *cookie), void *cookie)
+{
+    const struct mount_index_node *top  = mount_index_walk(index, dir, false);
+    const struct mount_index_node *node = top;
+    size_t                         n    = 0;
+
+    /* Preorder walk of the subtree under TOP, without a stack. */
+    while(node)
+    {
+        for(const struct mount_index_mount *m = node->mounts; m; m = m->next)
+        {
+            if(fn)
+                (*fn)(m->fs, cookie);
+            n++;
+        }
+
+        if(node->child)
+            node = node->child;
+        else
+        {
+            while((node != top) && !node->sibling)
+                node = node->parent;
+            node = (node == top) ? NULL : node->sibling;
+        }
+    }
+    return n;
+}
+
+/* Fold `.' and `..' in PATH, which is absolute, and drop repeated and
+   trailing slashes, in place.  The result is never longer than PATH. */
+static void
+path_canonicalize(char *path)
+{
+    char       *out = path;
+    const char *p   = path;
+    const char *comp;
+    size_t      len;
+
+    while((comp = path_next(&p, &len)))
+    {
+        if((len == 2) && (comp[0] == '.') && (comp[1] == '.'))
+        {
+            /* Back to the slash before the last component, if any. */
+            while((out > path) && (*--out != '/'))
+                ;
+            continue;
+        }
+        *out++ = '/';
+        memmove(out, comp, len);
+        out += len;
+    }
+    if(out == path)
+        *out++ = '/';
+    *out = '\0';
+}
+
+error_t
+mount_path_absolute(struct mount_arena *arena, const char *path, char **abs)
+{
+    char   *cwd;
+    size_t  cwd_len, path_len;
+
+    if(path[0] == '/')
+    {
+        *abs = mount_arena_strdup(arena, path);
+        if(!*abs)
+            return ENOMEM;
+        path_canonicalize(*abs);
+        return 0;
+    }
+
+    cwd = getcwd(NULL, 0);
+    if(!cwd)
+        return errno;
+    cwd_len  = strlen(cwd);
+    path_len = strlen(path);
+    *abs     = mount_arena_alloc(arena, cwd_len + path_len + 2);
+    if(*abs)
+    {
+        memcpy(*abs, cwd, cwd_len);
+        (*abs)[cwd_len] = '/';
+        memcpy(*abs + cwd_len + 1, path, path_len + 1);
+        path_canonicalize(*abs);
+    }
+    free(cwd);
+    return *abs ? 0 : ENOMEM;
+}
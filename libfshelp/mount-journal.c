@@ -0,0 +1,620 @@
+/* hurd/libfshelp/mount-journal.c
+   Append-only journal of the filesystems mounted by mount(2).
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <fcntl.h>
+#include <hurd.h>
+#include <mntent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mount-priv.h"
+
+/* What we mounted is kept in two files: a snapshot in mtab format and a
+   journal of the changes made since.  Every mount and unmount appends one
+   record to the journal, and callers that change the table together share
+   one fsync.  Once the journal grows past MOUNT_JOURNAL_COMPACT bytes a
+   background thread renames it aside, folds it into a new snapshot and
+   removes it.
+
+   _PATH_MOUNT_LOCK orders readers against the renames: readers hold it
+   shared while they read all three files, the compactor holds it exclusive
+   for the rename of the journal and for that of the snapshot, and
+   appenders hold it shared so that a record is never written to a journal
+   that has already been folded. */
+
+#define _PATH_MOUNT_JOURNAL_OLD _PATH_MOUNT_JOURNAL ".old"
+#define _PATH_MOUNT_SNAPSHOT_NEW _PATH_MOUNT_SNAPSHOT ".new"
+#define _PATH_MOUNT_LOCK        _PATH_MOUNT_RUN "mtab.lock"
+#define _PATH_MOUNT_COMPACT     _PATH_MOUNT_RUN "mtab.compact"
+
+#define MOUNT_JOURNAL_MAGIC     0x4d4e544aU     /* "MNTJ" */
+#define MOUNT_JOURNAL_COMPACT   (64 * 1024)
+
+/* The fixed header of a record.  It is followed by the strings, each with
+   its terminating null, and padding to a multiple of four bytes. */
+struct mount_journal_rec
+{
+    uint32_t magic;
+    uint16_t op;
+    uint16_t len[4];            /* Of mnt_fsname, mnt_dir, mnt_type and
+                                   mnt_opts, with the null. */
+    uint16_t pad;
+    uint32_t sum;               /* Of the record with SUM zero. */
+};
+
+static pthread_mutex_t journal_lock   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  journal_synced_cond = PTHREAD_COND_INITIALIZER;
+static int             journal_fd     = -1;
+/* Records we appended, and how many of them are known to be on disk. */
+static uint64_t        journal_written = 0;
+static uint64_t        journal_synced  = 0;
+static bool            journal_syncing = false;
+static bool            journal_compacting = false;
+
+#define JOURNAL_SUM_INIT        0x811c9dc5U
+
+static uint32_t
+journal_sum(uint32_t h, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+
+    for(size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 0x01000193U;
+    return h;
+}
+
+int
+mount_run_open(const char *path, int flags, mode_t mode)
+{
+    int fd = open(path, flags, mode);
+
+    if((fd < 0) && (errno == ENOENT) && (flags & O_CREAT)
+       && ((mkdir(_PATH_MOUNT_RUN, 0755) == 0) || (errno == EEXIST)))
+        fd = open(path, flags, mode);
+    return fd;
+}
+
+static int
+journal_lock_open(const char *path)
+{
+    return mount_run_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+
+/* Call FN with every valid record in the LEN bytes at BUF, stopping at the
+   first one that is not, which is what a write cut short leaves. */
+static void
+journal_replay(const char *buf, size_t len,
+               void (*fn)(int op, const struct mntent *mnt, void *cookie),
+               void *cookie)
+{
+    size_t off = 0;
+
+    while(off + sizeof(struct mount_journal_rec) <= len)
+    {
+        struct mount_journal_rec rec;
+        const char              *strs[4];
+        const char              *p;
+        size_t                   total = sizeof(rec);
+        uint32_t                 sum;
+        struct mntent            mnt   = { 0 };
+
+        memcpy(&rec, buf + off, sizeof(rec));
+        if(rec.magic != MOUNT_JOURNAL_MAGIC)
+            return;
+        for(int i = 0; i < 4; i++)
+            total += rec.len[i];
+        total = (total + 3) & ~(size_t) 3;
+        if(off + total > len)
+            return;
+
+        sum = rec.sum;
+        rec.sum = 0;
+        if(journal_sum(journal_sum(JOURNAL_SUM_INIT, &rec, sizeof(rec)),
+                       buf + off + sizeof(rec), total - sizeof(rec)) != sum)
+            return;
+        p = buf + off + sizeof(rec);
+        for(int i = 0; i < 4; i++)
+        {
+            if(!rec.len[i] || (p[rec.len[i] - 1] != '\0'))
+                return;
+            strs[i] = p;
+            p += rec.len[i];
+        }
+
+        mnt.mnt_fsname = (char *) strs[0];
+        mnt.mnt_dir    = (char *) strs[1];
+        mnt.mnt_type   = (char *) strs[2];
+        mnt.mnt_opts   = (char *) strs[3];
+        (*fn)(rec.op, &mnt, cookie);
+        off += total;
+    }
+}
+
+/* Read all of the file at PATH into *BUF and *LEN.  A missing file is
+   empty. */
+static error_t
+journal_read_file(const char *path, char **buf, size_t *len)
+{
+    int         fd  = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    size_t      got = 0;
+
+    *buf = NULL;
+    *len = 0;
+    if(fd < 0)
+        return (errno == ENOENT) ? 0 : errno;
+    if(fstat(fd, &st) < 0)
+    {
+        error_t err = errno;
+        close(fd);
+        return err;
+    }
+
+    *buf = malloc(st.st_size ?: 1);
+    if(!*buf)
+    {
+        close(fd);
+        return ENOMEM;
+    }
+    while(got < (size_t) st.st_size)
+    {
+        ssize_t n = read(fd, *buf + got, st.st_size - got);
+        if(n < 0 && (errno == EINTR))
+            continue;
+        if(n <= 0)
+            break;
+        got += n;
+    }
+    close(fd);
+    *len = got;
+    return 0;
+}
+
+static void
+journal_apply(int op, const struct mntent *mnt, void *cookie)
+{
+    struct fstab *fstab = cookie;
+    struct fs    *fs    = fstab_find_mount(fstab, mnt->mnt_dir);
+
+    switch(op)
+    {
+    case MOUNT_JOURNAL_ADD:
+        /* Replaces any entry on the same mount point, so replaying a
+           record already in the snapshot changes nothing. */
+        fstab_add_mntent(fstab, mnt, &fs);
+        break;
+    case MOUNT_JOURNAL_REMOUNT:
+        if(fs)
+        {
+            /* Copied, since the entry's own strings are freed when it is
+               replaced. */
+            struct mntent m = fs->mntent;
+
+            m.mnt_fsname = strdupa(m.mnt_fsname);
+            m.mnt_dir    = strdupa(m.mnt_dir);
+            m.mnt_type   = strdupa(m.mnt_type);
+            m.mnt_opts   = mnt->mnt_opts;
+            fstab_add_mntent(fstab, &m, &fs);
+        }
+        break;
+    case MOUNT_JOURNAL_DEL:
+        if(fs)
+            fs_free(fs);
+        break;
+    }
+}
+
+error_t
+mount_journal_load(struct fstab *fstab)
+{
+    static const char *const journals[] =
+        { _PATH_MOUNT_JOURNAL_OLD, _PATH_MOUNT_JOURNAL };
+    error_t err    = 0;
+    int     lockfd = journal_lock_open(_PATH_MOUNT_LOCK);
+
+    /* Without the lock file, nothing of ours can be there to read. */
+    if(lockfd < 0)
+        return 0;
+    flock(lockfd, LOCK_SH);
+
+    err = fstab_read(fstab, _PATH_MOUNT_SNAPSHOT);
+    if(err == ENOENT)
+        err = 0;
+    for(size_t i = 0; !err && (i < sizeof(journals) / sizeof(*journals)); i++)
+    {
+        char   *buf;
+        size_t  len;
+
+        err = journal_read_file(journals[i], &buf, &len);
+        if(!err)
+        {
+            journal_replay(buf, len, journal_apply, fstab);
+            free(buf);
+        }
+    }
+
+    close(lockfd);
+    return err;
+}
+
+/* An entry of the table being compacted. */
+struct journal_ent
+{
+    struct mntent       mnt;
+    struct journal_ent *next;
+};
+
+struct journal_table
+{
+    struct mount_arena  arena;
+    struct journal_ent *entries;
+    struct journal_ent **tail;
+    error_t             err;
+};
+
+static void
+journal_table_apply(int op, const struct mntent *mnt, void *cookie)
+{
+    struct journal_table *table = cookie;
+    struct journal_ent  **prev  = &table->entries;
+    struct journal_ent   *ent;
+
+    while(*prev && strcmp((*prev)->mnt.mnt_dir, mnt->mnt_dir))
+        prev = &(*prev)->next;
+    ent = *prev;
+
+    if(op == MOUNT_JOURNAL_DEL)
+    {
+        if(ent)
+        {
+            *prev = ent->next;
+            if(!*prev)
+                table->tail = prev;
+        }
+        return;
+    }
+    if((op == MOUNT_JOURNAL_REMOUNT) && !ent)
+        return;
+
+    if(!ent)
+    {
+        ent = mount_arena_alloc(&table->arena, sizeof(*ent));
+        if(!ent)
+        {
+            table->err = ENOMEM;
+            return;
+        }
+        memset(ent, 0, sizeof(*ent));
+        *table->tail = ent;
+        table->tail  = &ent->next;
+    }
+    if(op == MOUNT_JOURNAL_ADD)
+    {
+        ent->mnt.mnt_fsname = mount_arena_strdup(&table->arena,
+                                                 mnt->mnt_fsname);
+        ent->mnt.mnt_dir    = mount_arena_strdup(&table->arena, mnt->mnt_dir);
+        ent->mnt.mnt_type   = mount_arena_strdup(&table->arena,
+                                                 mnt->mnt_type);
+    }
+    ent->mnt.mnt_opts = mount_arena_strdup(&table->arena, mnt->mnt_opts);
+    if(!ent->mnt.mnt_fsname || !ent->mnt.mnt_dir || !ent->mnt.mnt_type
+       || !ent->mnt.mnt_opts)
+        table->err = ENOMEM;
+}
+
+/* Return whether anything is still set on the mount point of MNT: a
+   running translator, or the passive one of a noauto mount.  One made to
+   go away behind our back, with `settrans -g' say, leaves neither. */
+static bool
+journal_ent_live(const struct mntent *mnt)
+{
+    file_t  node    = file_name_lookup(mnt->mnt_dir, O_NOTRANS, 0666);
+    fsys_t  control = MACH_PORT_NULL;
+    char    buf[256];
+    char   *trans   = buf;
+    size_t  len     = sizeof(buf);
+    bool    live    = false;
+
+    if(node == MACH_PORT_NULL)
+        return false;
+    if((file_get_translator_cntl(node, &control) == 0)
+       && (control != MACH_PORT_NULL))
+    {
+        mach_port_deallocate(mach_task_self(), control);
+        live = true;
+    }
+    else if(file_get_translator(node, &trans, &len) == 0)
+    {
+        if(trans != buf)
+            vm_deallocate(mach_task_self(), (vm_address_t) trans, len);
+        live = (len > 0);
+    }
+    mach_port_deallocate(mach_task_self(), node);
+    return live;
+}
+
+/* Fold the journal renamed aside into a new snapshot, leaving out the
+   filesystems that are no longer there. */
+static error_t
+journal_compact(int lockfd)
+{
+    error_t               err  = 0;
+    FILE                 *file = NULL;
+    struct mntent        *mnt;
+    char                 *buf  = NULL;
+    size_t                len  = 0;
+    struct journal_table  table;
+
+    mount_arena_init(&table.arena);
+    table.entries = NULL;
+    table.tail    = &table.entries;
+    table.err     = 0;
+
+    file = setmntent(_PATH_MOUNT_SNAPSHOT, "r");
+    if(file)
+    {
+        while(!table.err && (mnt = getmntent(file)))
+            journal_table_apply(MOUNT_JOURNAL_ADD, mnt, &table);
+        endmntent(file);
+    }
+    else if(errno != ENOENT)
+    {
+        err = errno;
+        goto end_compact;
+    }
+
+    err = journal_read_file(_PATH_MOUNT_JOURNAL_OLD, &buf, &len);
+    if(err)
+        goto end_compact;
+    journal_replay(buf, len, journal_table_apply, &table);
+    err = table.err;
+    if(err)
+        goto end_compact;
+
+    file = setmntent(_PATH_MOUNT_SNAPSHOT_NEW, "w");
+    if(!file)
+    {
+        err = errno;
+        goto end_compact;
+    }
+    for(struct journal_ent *ent = table.entries; ent && !err; ent = ent->next)
+        if(journal_ent_live(&ent->mnt) && addmntent(file, &ent->mnt))
+            err = errno ?: EIO;
+    if(!err && ((fflush(file) != 0) || (fsync(fileno(file)) < 0)))
+        err = errno;
+    endmntent(file);
+    if(err)
+    {
+        unlink(_PATH_MOUNT_SNAPSHOT_NEW);
+        goto end_compact;
+    }
+
+    flock(lockfd, LOCK_EX);
+    if(rename(_PATH_MOUNT_SNAPSHOT_NEW, _PATH_MOUNT_SNAPSHOT) < 0)
+        err = errno;
+    else
+        unlink(_PATH_MOUNT_JOURNAL_OLD);
+    flock(lockfd, LOCK_UN);
+
+end_compact:
+    free(buf);
+    mount_arena_free(&table.arena);
+    return err;
+}
+
+static void *
+journal_compactor(void *arg)
+{
+    int lockfd    = journal_lock_open(_PATH_MOUNT_LOCK);
+    int compactfd = journal_lock_open(_PATH_MOUNT_COMPACT);
+
+    /* Another process may be compacting already. */
+    if((lockfd < 0) || (compactfd < 0)
+       || (flock(compactfd, LOCK_EX | LOCK_NB) < 0))
+        goto end_compactor;
+
+    flock(lockfd, LOCK_EX);
+    pthread_mutex_lock(&journal_lock);
+    while(journal_syncing)
+        pthread_cond_wait(&journal_synced_cond, &journal_lock);
+    if(journal_fd >= 0)
+    {
+        /* What we wrote is about to be in the journal renamed aside; the
+           next append opens the new one. */
+        fdatasync(journal_fd);
+        close(journal_fd);
+        journal_fd     = -1;
+        journal_synced = journal_written;
+        pthread_cond_broadcast(&journal_synced_cond);
+    }
+    pthread_mutex_unlock(&journal_lock);
+    /* A journal left aside by a compaction that did not finish is folded
+       first; the current one waits for the next time. */
+    if(access(_PATH_MOUNT_JOURNAL_OLD, F_OK) < 0)
+        rename(_PATH_MOUNT_JOURNAL, _PATH_MOUNT_JOURNAL_OLD);
+    flock(lockfd, LOCK_UN);
+
+    journal_compact(lockfd);
+
+end_compactor:
+    if(compactfd >= 0)
+        close(compactfd);
+    if(lockfd >= 0)
+        close(lockfd);
+    pthread_mutex_lock(&journal_lock);
+    journal_compacting = false;
+    pthread_mutex_unlock(&journal_lock);
+    return NULL;
+}
+
+/* Open the journal if needed, or again if a compaction renamed it away.
+   Called with journal_lock held. */
+static error_t
+journal_open(void)
+{
+    struct stat st_fd, st_path;
+
+    if((journal_fd >= 0) && (stat(_PATH_MOUNT_JOURNAL, &st_path) == 0)
+       && (fstat(journal_fd, &st_fd) == 0)
+       && (st_fd.st_dev == st_path.st_dev) && (st_fd.st_ino == st_path.st_ino))
+        return 0;
+
+    if(journal_fd >= 0)
+    {
+        /* Our records in the old one are the compactor's to sync. */
+        close(journal_fd);
+        journal_synced = journal_written;
+    }
+    journal_fd = mount_run_open(_PATH_MOUNT_JOURNAL,
+                                O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                                0644);
+    return (journal_fd < 0) ? errno : 0;
+}
+
+static void
+journal_append(enum mount_journal_op op, const struct mntent *mnt)
+{
+    const char               *strs[4] =
+        { mnt->mnt_fsname ?: "", mnt->mnt_dir, mnt->mnt_type ?: "",
+          mnt->mnt_opts ?: "" };
+    struct mount_journal_rec  rec     = { 0 };
+    size_t                    total   = sizeof(rec);
+    size_t                    off     = 0;
+    char                     *buf;
+    off_t                     end     = 0;
+    int                       lockfd;
+    bool                      compact = false;
+    pthread_t                 thread;
+
+    rec.magic = MOUNT_JOURNAL_MAGIC;
+    rec.op    = op;
+    for(int i = 0; i < 4; i++)
+    {
+        size_t len = strlen(strs[i]) + 1;
+
+        /* Longer strings cannot be recorded; leave the journal as it is
+           rather than write a record that does not say what happened. */
+        if(len > UINT16_MAX)
+            return;
+        rec.len[i] = len;
+        total     += len;
+    }
+    total = (total + 3) & ~(size_t) 3;
+
+    buf = calloc(1, total);
+    if(!buf)
+        return;
+    off = sizeof(rec);
+    for(int i = 0; i < 4; i++)
+    {
+        memcpy(buf + off, strs[i], rec.len[i]);
+        off += rec.len[i];
+    }
+    rec.sum = journal_sum(journal_sum(JOURNAL_SUM_INIT, &rec, sizeof(rec)),
+                          buf + sizeof(rec), total - sizeof(rec));
+    memcpy(buf, &rec, sizeof(rec));
+
+    lockfd = journal_lock_open(_PATH_MOUNT_LOCK);
+    if(lockfd < 0)
+    {
+        free(buf);
+        return;
+    }
+    flock(lockfd, LOCK_SH);
+    pthread_mutex_lock(&journal_lock);
+    if(journal_open() == 0)
+    {
+        /* One write, so that concurrent appenders do not interleave. */
+        if(write(journal_fd, buf, total) == (ssize_t) total)
+            journal_written++;
+        end = lseek(journal_fd, 0, SEEK_CUR);
+    }
+    if((end > MOUNT_JOURNAL_COMPACT) && !journal_compacting)
+        compact = journal_compacting = true;
+    pthread_mutex_unlock(&journal_lock);
+    flock(lockfd, LOCK_UN);
+    close(lockfd);
+    free(buf);
+
+    if(compact)
+    {
+        if(pthread_create(&thread, NULL, journal_compactor, NULL) == 0)
+            pthread_detach(thread);
+        else
+            journal_compactor(NULL);
+    }
+}
+
+void
+mount_journal_append(enum mount_journal_op op, const struct mntent *mnt)
+{
+    /* Only once the record is written, so that a watcher that resyncs
+       from the table finds whatever the events it dropped said, and with
+       no resync in between, which would find this one too. */
+    bool post = mount_watch_post_lock();
+
+    journal_append(op, mnt);
+    if(post)
+        mount_watch_post(op, mnt);
+    mount_watch_post_unlock(post);
+}
+
+void
+mount_journal_commit(void)
+{
+    uint64_t target;
+
+    pthread_mutex_lock(&journal_lock);
+    target = journal_written;
+    /* Whoever syncs first syncs everything appended so far, and the other
+       callers only wait for it. */
+    while(journal_synced < target)
+    {
+        uint64_t upto;
+        int      fd;
+        bool     ok;
+
+        if(journal_syncing)
+        {
+            pthread_cond_wait(&journal_synced_cond, &journal_lock);
+            continue;
+        }
+        if(journal_fd < 0)
+            break;
+
+        journal_syncing = true;
+        upto = journal_written;
+        fd   = journal_fd;
+        pthread_mutex_unlock(&journal_lock);
+        ok = (fdatasync(fd) == 0);
+        pthread_mutex_lock(&journal_lock);
+        journal_syncing = false;
+        if(ok && (upto > journal_synced))
+            journal_synced = upto;
+        pthread_cond_broadcast(&journal_synced_cond);
+        if(!ok)
+            break;
+    }
+    pthread_mutex_unlock(&journal_lock);
+}
@@ -0,0 +1,228 @@
+/* hurd/libfshelp/mount-lazy.c
+   Mounts whose translator only starts when first looked up.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <fcntl.h>
+#include <hurd.h>
+#include <hurd/fsys.h>
+#include <mntent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* A lazy mount whose translator is stopped once it is idle. */
+struct mount_lazy
+{
+    char              *dir;
+    unsigned int       idle;    /* Seconds between checks. */
+    time_t             due;     /* When to check next. */
+    struct mount_lazy *next;
+};
+
+static pthread_mutex_t    mount_lazy_lock    = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled when the list changes. */
+static pthread_cond_t     mount_lazy_changed = PTHREAD_COND_INITIALIZER;
+static struct mount_lazy *mount_lazies       = NULL;
+static bool               mount_lazy_running = false;
+
+/* Ask the translator running on DIR, if any, to go away unless it is in
+   use.  The passive translator stays, so the next lookup starts it
+   again. */
+static void
+mount_lazy_stop(const char *dir)
+{
+    file_t node    = file_name_lookup(dir, O_NOTRANS, 0666);
+    fsys_t control = MACH_PORT_NULL;
+
+    if(node == MACH_PORT_NULL)
+        return;
+    if((file_get_translator_cntl(node, &control) == 0)
+       && (control != MACH_PORT_NULL))
+    {
+        /* Without FSYS_GOAWAY_FORCE it refuses with EBUSY while anything
+           of it is open, which is how idle is told from busy. */
+        fsys_goaway(control, 0);
+        mach_port_deallocate(mach_task_self(), control);
+    }
+    mach_port_deallocate(mach_task_self(), node);
+}
+
+static void *
+mount_lazy_reaper(void *arg)
+{
+    pthread_mutex_lock(&mount_lazy_lock);
+    while(mount_lazies)
+    {
+        struct mount_lazy *first = mount_lazies;
+        time_t             now   = time(NULL);
+        char              *dir;
+
+        for(struct mount_lazy *lazy = mount_lazies; lazy; lazy = lazy->next)
+            if(lazy->due < first->due)
+                first = lazy;
+
+        if(first->due > now)
+        {
+            struct timespec until = { .tv_sec = first->due, .tv_nsec = 0 };
+
+            pthread_cond_timedwait(&mount_lazy_changed, &mount_lazy_lock,
+                                   &until);
+            continue;
+        }
+
+        /* A copy on the heap, as this loop runs for as long as there are
+           lazy mounts; without one, it is tried again when next due. */
+        first->due = now + first->idle;
+        dir = strdup(first->dir);
+        if(!dir)
+            continue;
+        pthread_mutex_unlock(&mount_lazy_lock);
+        mount_lazy_stop(dir);
+        free(dir);
+        pthread_mutex_lock(&mount_lazy_lock);
+    }
+    /* Exit when there is nothing to watch; the next lazy mount with a
+       timeout starts a new one. */
+    mount_lazy_running = false;
+    pthread_mutex_unlock(&mount_lazy_lock);
+    return NULL;
+}
+
+/* Stop the translator of DIR whenever it was idle for IDLE seconds. */
+static error_t
+mount_lazy_watch(const char *dir, unsigned int idle)
+{
+    struct mount_lazy *lazy = calloc(1, sizeof(*lazy));
+
+    if(lazy)
+        lazy->dir = strdup(dir);
+    if(!lazy || !lazy->dir)
+    {
+        free(lazy);
+        return ENOMEM;
+    }
+    lazy->idle = idle;
+    lazy->due  = time(NULL) + idle;
+
+    pthread_mutex_lock(&mount_lazy_lock);
+    lazy->next   = mount_lazies;
+    mount_lazies = lazy;
+    if(!mount_lazy_running)
+    {
+        pthread_t      thread;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if(pthread_create(&thread, &attr, mount_lazy_reaper, NULL) == 0)
+            mount_lazy_running = true;
+        pthread_attr_destroy(&attr);
+    }
+    pthread_cond_signal(&mount_lazy_changed);
+    pthread_mutex_unlock(&mount_lazy_lock);
+    return 0;
+}
+
+error_t
+mount_lazy(const char *dir, char *argz, size_t argz_len, unsigned int idle)
+{
+    error_t err  = 0;
+    file_t  node = file_name_lookup(dir, O_NOTRANS, 0666);
+
+    if(node == MACH_PORT_NULL)
+        return errno;
+
+    /* Only the passive translator is set; the filesystem holding DIR
+       starts it on the first lookup through it. */
+    err = file_set_translator(node, FS_TRANS_SET | FS_TRANS_EXCL, 0, 0,
+                              argz, argz_len, MACH_PORT_NULL,
+                              MACH_MSG_TYPE_COPY_SEND);
+    if(!err && idle)
+    {
+        err = mount_lazy_watch(dir, idle);
+        if(err)
+            file_set_translator(node, FS_TRANS_SET, 0, 0, NULL, 0,
+                                MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
+    }
+    mach_port_deallocate(mach_task_self(), node);
+    return err;
+}
+
+int
+mount_lazy_passive_flags(const struct mntent *mntent)
+{
+    return (mntent->mnt_opts && hasmntopt(mntent, "noauto"))
+        ? FS_TRANS_SET : 0;
+}
+
+void
+mount_lazy_move(const char *from, const char *to)
+{
+    char *dir = strdup(to);
+
+    pthread_mutex_lock(&mount_lazy_lock);
+    for(struct mount_lazy **prev = &mount_lazies; *prev;
+        prev = &(*prev)->next)
+    {
+        struct mount_lazy *lazy = *prev;
+
+        if(strcmp(lazy->dir, from) != 0)
+            continue;
+        if(dir)
+        {
+            free(lazy->dir);
+            lazy->dir = dir;
+            dir       = NULL;
+        }
+        else
+        {
+            /* Better not watched than stopping whatever is on FROM. */
+            *prev = lazy->next;
+            free(lazy->dir);
+            free(lazy);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&mount_lazy_lock);
+    free(dir);
+}
+
+void
+mount_lazy_forget(const char *dir)
+{
+    pthread_mutex_lock(&mount_lazy_lock);
+    for(struct mount_lazy **prev = &mount_lazies; *prev;
+        prev = &(*prev)->next)
+    {
+        struct mount_lazy *lazy = *prev;
+
+        if(strcmp(lazy->dir, dir) == 0)
+        {
+            *prev = lazy->next;
+            free(lazy->dir);
+            free(lazy);
+            pthread_cond_signal(&mount_lazy_changed);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mount_lazy_lock);
+}
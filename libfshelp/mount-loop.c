@@ -0,0 +1,85 @@
+/* hurd/libfshelp/mount-loop.c
+   Mounting image files for mount(2) with the loop option.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include "mount-priv.h"
+
+/* Has a translator that opens its device with libstore take the device
+   name as a typed store name, like `file:IMAGE'. */
+#define LOOP_STORE_SWITCH "--store-type=typed"
+
+error_t
+mount_loop_device(struct mount_arena *arena, const char *image,
+                  const struct mount_opts *opts, char **fsopts,
+                  size_t *fsopts_len, char **device)
+{
+    struct stat  st;
+    uint64_t     size;
+    char        *name;
+    char        *argz;
+    int          len;
+
+    if(stat(image, &st) < 0)
+        return errno;
+    if(!S_ISREG(st.st_mode) || (opts->loop_offset > (uint64_t) st.st_size))
+        return EINVAL;
+
+    size = st.st_size - opts->loop_offset;
+    if(opts->loop_sizelimit && (opts->loop_sizelimit < size))
+        size = opts->loop_sizelimit;
+
+    /* The translator reads the image through the file's own server, with
+       no storeio translator in between.  A file store still copies every
+       block with io_read and io_write rather than mapping the file, so
+       this saves a translator and its RPCs, not the copy.  A part of the
+       image is taken with a remap store, whose blocks are bytes for a file
+       store.  A store that maps the file with io_map would save the copy,
+       but libstore's memobj class can only be made from a memory object
+       port: it has no name to be opened by, so there is no way to give
+       one on the translator's command line. */
+    if((opts->loop_offset == 0) && (size == (uint64_t) st.st_size))
+        len = snprintf(NULL, 0, "file:%s", image);
+    else
+        len = snprintf(NULL, 0, "remap:%llu+%llu:file:%s",
+                       (unsigned long long) opts->loop_offset,
+                       (unsigned long long) size, image);
+    name = mount_arena_alloc(arena, len + 1);
+    argz = mount_arena_alloc(arena, sizeof(LOOP_STORE_SWITCH) + *fsopts_len);
+    if(!name || !argz)
+        return ENOMEM;
+    if((opts->loop_offset == 0) && (size == (uint64_t) st.st_size))
+        sprintf(name, "file:%s", image);
+    else
+        sprintf(name, "remap:%llu+%llu:file:%s",
+                (unsigned long long) opts->loop_offset,
+                (unsigned long long) size, image);
+
+    /* In front, so that a store type given in the options still wins. */
+    memcpy(argz, LOOP_STORE_SWITCH, sizeof(LOOP_STORE_SWITCH));
+    if(*fsopts_len)
+        memcpy(argz + sizeof(LOOP_STORE_SWITCH), *fsopts, *fsopts_len);
+    *fsopts      = argz;
+    *fsopts_len += sizeof(LOOP_STORE_SWITCH);
+    *device      = name;
+    return 0;
+}
@@ -0,0 +1,473 @@
+/* hurd/libfshelp/mount-map.c
+   Binary mount table that readers map instead of parsing mtab.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <fcntl.h>
+#include <mntent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "mount-priv.h"
+
+/* The file starts with a header page, followed by the table: an array of
+   struct mount_map_ent, then the strings they point to.  The table is
+   rewritten in place under a sequence count, odd while a write is in
+   progress, so readers copy it and retry if the count moved.  Writers are
+   serialized by a flock on the file.  The file only grows, and a reader
+   whose mapping is too short for the current table maps it again. */
+
+#define MOUNT_MAP_MAGIC         0x4d4e544dU     /* "MNTM" */
+#define MOUNT_MAP_VERSION       1
+#define MOUNT_MAP_DATA          4096            /* Offset of the table. */
+/* How many times a reader retries a table that is being written before it
+   gives up with EAGAIN, in case a writer died in the middle. */
+#define MOUNT_MAP_RETRIES       (1 << 20)
+
+/* How long the publisher waits after the first change it has yet to
+   publish, so that a burst of changes is published once. */
+#define MOUNT_MAP_DELAY         10              /* Milliseconds. */
+
+struct mount_map_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seq;
+    uint64_t count;             /* Entries in the table. */
+    uint64_t size;              /* Bytes of the table. */
+};
+
+/* Offsets from the start of the table. */
+struct mount_map_ent
+{
+    uint32_t fsname;
+    uint32_t dir;
+    uint32_t type;
+    uint32_t opts;
+};
+
+struct mount_map
+{
+    int             fd;
+    char           *base;       /* The mapped file. */
+    size_t          len;
+    uint64_t        seq;        /* Of the copy in BUF, or 0. */
+    char           *buf;        /* Our copy of the table. */
+    size_t          buf_len;
+    struct mntent  *entries;
+    size_t          entries_len;
+    size_t          count;
+};
+
+static uint64_t
+map_load(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void
+map_store(uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+/* Whether the string at OFF in the SIZE bytes of table at BUF ends within
+   them. */
+static bool
+map_string_ok(const char *buf, uint64_t size, uint32_t off)
+{
+    return (off < size) && memchr(buf + off, '\0', size - off);
+}
+
+void
+mount_map_publish(struct mount_table *table)
+{
+    struct mount_map_header *hdr;
+    struct mount_map_ent    *ents;
+    struct stat              st;
+    char                    *base  = MAP_FAILED;
+    char                    *data;
+    size_t                   count = 0;
+    size_t                   size;
+    size_t                   off;
+    size_t                   len;
+    uint64_t                 seq;
+    int                      fd;
+
+    for(struct fs *fs = table->fstab->entries; fs; fs = fs->next)
+        count++;
+    size = count * sizeof(*ents);
+    for(struct fs *fs = table->fstab->entries; fs; fs = fs->next)
+        size += strlen(fs->mntent.mnt_fsname) + strlen(fs->mntent.mnt_dir)
+            + strlen(fs->mntent.mnt_type) + strlen(fs->mntent.mnt_opts ?: "")
+            + 4;
+    if(size > UINT32_MAX)
+        return;
+
+    fd = mount_run_open(_PATH_MOUNT_MAP, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0)
+        return;
+    flock(fd, LOCK_EX);
+    if(fstat(fd, &st) < 0)
+        goto end_publish;
+
+    len = (st.st_size > MOUNT_MAP_DATA) ? st.st_size : 2 * MOUNT_MAP_DATA;
+    while(len < MOUNT_MAP_DATA + size)
+        len *= 2;
+    if((len > (size_t) st.st_size) && (ftruncate(fd, len) < 0))
+        goto end_publish;
+
+    base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(base == MAP_FAILED)
+        goto end_publish;
+    hdr  = (struct mount_map_header *) base;
+    data = base + MOUNT_MAP_DATA;
+    ents = (struct mount_map_ent *) data;
+
+    /* An odd count left by a writer that died is simply finished now. */
+    seq = map_load(&hdr->seq) | 1;
+    if(hdr->magic != MOUNT_MAP_MAGIC)
+        seq = 1;
+    map_store(&hdr->seq, seq);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    off = count * sizeof(*ents);
+    for(struct fs *fs = table->fstab->entries; fs; fs = fs->next, ents++)
+    {
+        const char *strs[4] =
+            { fs->mntent.mnt_fsname, fs->mntent.mnt_dir, fs->mntent.mnt_type,
+              fs->mntent.mnt_opts ?: "" };
+        uint32_t   *offs[4] =
+            { &ents->fsname, &ents->dir, &ents->type, &ents->opts };
+
+        for(int i = 0; i < 4; i++)
+        {
+            size_t slen = strlen(strs[i]) + 1;
+
+            memcpy(data + off, strs[i], slen);
+            *offs[i] = off;
+            off     += slen;
+        }
+    }
+    hdr->magic   = MOUNT_MAP_MAGIC;
+    hdr->version = MOUNT_MAP_VERSION;
+    hdr->count   = count;
+    hdr->size    = size;
+    map_store(&hdr->seq, seq + 1);
+
+end_publish:
+    if(base != MAP_FAILED)
+        munmap(base, len);
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+static pthread_mutex_t mount_map_lock    = PTHREAD_MUTEX_INITIALIZER;
+/* Signalled when the publisher exits. */
+static pthread_cond_t  mount_map_idle    = PTHREAD_COND_INITIALIZER;
+/* Set when the table changed since the publisher last read it. */
+static bool            mount_map_dirty   = false;
+static bool            mount_map_running = false;
+
+static void *
+mount_map_publisher(void *arg)
+{
+    struct timespec delay = { 0, MOUNT_MAP_DELAY * 1000 * 1000 };
+
+    pthread_mutex_lock(&mount_map_lock);
+    while(mount_map_dirty)
+    {
+        struct mount_table *table = NULL;
+
+        pthread_mutex_unlock(&mount_map_lock);
+        if(arg)
+            nanosleep(&delay, NULL);
+        pthread_mutex_lock(&mount_map_lock);
+        /* What changes from here on is published the next time round. */
+        mount_map_dirty = false;
+        pthread_mutex_unlock(&mount_map_lock);
+
+        if(mount_table_acquire(&table) == 0)
+        {
+            mount_map_publish(table);
+            mount_table_release(table);
+        }
+        pthread_mutex_lock(&mount_map_lock);
+    }
+    /* Exit when idle; the next change starts a new publisher. */
+    mount_map_running = false;
+    pthread_cond_broadcast(&mount_map_idle);
+    pthread_mutex_unlock(&mount_map_lock);
+    return NULL;
+}
+
+void
+mount_map_schedule(void)
+{
+    bool publisher;
+
+    pthread_mutex_lock(&mount_map_lock);
+    mount_map_dirty = true;
+    if(!mount_map_running)
+    {
+        pthread_t      thread;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if(pthread_create(&thread, &attr, mount_map_publisher,
+                          (void *) 1) == 0)
+            mount_map_running = true;
+        pthread_attr_destroy(&attr);
+    }
+    publisher = mount_map_running;
+    pthread_mutex_unlock(&mount_map_lock);
+
+    /* Without a publisher thread, publish here rather than never. */
+    if(!publisher)
+        mount_map_publisher(NULL);
+}
+
+/* Let the publisher finish before the process exits, or a program that
+   mounts something and exits at once would leave the map behind. */
+static void __attribute__((destructor))
+mount_map_flush(void)
+{
+    pthread_mutex_lock(&mount_map_lock);
+    while(mount_map_running)
+        pthread_cond_wait(&mount_map_idle, &mount_map_lock);
+    pthread_mutex_unlock(&mount_map_lock);
+}
+
+/* Opens the binary mount table. */
+struct mount_map *
+mount_map_open(void)
+{
+    struct mount_map *map = calloc(1, sizeof(*map));
+    struct stat       st;
+    error_t           err = 0;
+
+    if(!map)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    map->fd = open(_PATH_MOUNT_MAP, O_RDONLY | O_CLOEXEC);
+    if((map->fd < 0) || (fstat(map->fd, &st) < 0))
+    {
+        err = errno;
+        goto end_open;
+    }
+    if(st.st_size < MOUNT_MAP_DATA)
+    {
+        err = ENOENT;
+        goto end_open;
+    }
+    map->len  = st.st_size;
+    map->base = mmap(NULL, map->len, PROT_READ, MAP_SHARED, map->fd, 0);
+    if(map->base == MAP_FAILED)
+    {
+        map->base = NULL;
+        err = errno;
+    }
+
+end_open:
+    if(err)
+    {
+        mount_map_close(map);
+        errno = err;
+        return NULL;
+    }
+    return map;
+}
+
+/* Map the file again, for a table that has grown past our mapping. */
+static error_t
+mount_map_remap(struct mount_map *map)
+{
+    struct stat  st;
+    char        *base;
+
+    if(fstat(map->fd, &st) < 0)
+        return errno;
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, map->fd, 0);
+    if(base == MAP_FAILED)
+        return errno;
+    munmap(map->base, map->len);
+    map->base = base;
+    map->len  = st.st_size;
+    return 0;
+}
+
+/* Reads a consistent copy of the binary mount table. */
+int
+mount_map_read(struct mount_map *map, const struct mntent **entries,
+               size_t *n)
+{
+    const struct mount_map_header *hdr;
+    error_t                        err = 0;
+    uint64_t                       seq;
+    uint64_t                       count;
+    uint64_t                       size;
+    uint32_t                       version;
+
+    if(!map || !entries || !n)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for(long tries = 0;; tries++)
+    {
+        hdr = (const struct mount_map_header *) map->base;
+        seq = map_load(&hdr->seq);
+        /* Nothing changed since our last copy. */
+        if(seq == map->seq)
+            goto end_read;
+        if((seq & 1) || (hdr->magic != MOUNT_MAP_MAGIC))
+        {
+            if(tries >= MOUNT_MAP_RETRIES)
+            {
+                err = EAGAIN;
+                goto end_read;
+            }
+            continue;
+        }
+
+        version = hdr->version;
+        count   = hdr->count;
+        size    = hdr->size;
+        if((size > map->len) || (MOUNT_MAP_DATA + size > map->len))
+        {
+            size_t len = map->len;
+
+            /* Only valid if the count did not move in the meantime. */
+            if(map_load(&hdr->seq) != seq)
+                continue;
+            err = mount_map_remap(map);
+            /* The file grows before a larger table is published in it. */
+            if(!err && (map->len <= len))
+                err = EINVAL;
+            if(err)
+                goto end_read;
+            continue;
+        }
+
+        if(size > map->buf_len)
+        {
+            char *buf = realloc(map->buf, size);
+            if(!buf)
+            {
+                err = ENOMEM;
+                goto end_read;
+            }
+            map->buf     = buf;
+            map->buf_len = size;
+        }
+        memcpy(map->buf, map->base + MOUNT_MAP_DATA, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(map_load(&hdr->seq) == seq)
+            break;
+    }
+
+    /* The copy is consistent, but the file is anyone's to write; check
+       that it describes a table within itself as it is made into
+       entries. */
+    if((version != MOUNT_MAP_VERSION)
+       || (count > size / sizeof(struct mount_map_ent)))
+    {
+        err = EINVAL;
+        goto end_read;
+    }
+    if(count > map->entries_len)
+    {
+        struct mntent *entries = realloc(map->entries,
+                                         count * sizeof(*entries));
+        if(!entries)
+        {
+            err = ENOMEM;
+            goto end_read;
+        }
+        map->entries     = entries;
+        map->entries_len = count;
+    }
+    for(size_t i = 0; i < count; i++)
+    {
+        struct mount_map_ent ent;
+
+        memcpy(&ent, map->buf + i * sizeof(ent), sizeof(ent));
+        if(!map_string_ok(map->buf, size, ent.fsname)
+           || !map_string_ok(map->buf, size, ent.dir)
+           || !map_string_ok(map->buf, size, ent.type)
+           || !map_string_ok(map->buf, size, ent.opts))
+        {
+            err = EINVAL;
+            goto end_read;
+        }
+        memset(&map->entries[i], 0, sizeof(map->entries[i]));
+        map->entries[i].mnt_fsname = map->buf + ent.fsname;
+        map->entries[i].mnt_dir    = map->buf + ent.dir;
+        map->entries[i].mnt_type   = map->buf + ent.type;
+        map->entries[i].mnt_opts   = map->buf + ent.opts;
+    }
+    map->count = count;
+    map->seq   = seq;
+
+end_read:
+    if(!err)
+    {
+        *entries = map->entries;
+        *n       = map->count;
+    }
+    else
+    {
+        /* The copy we had may have been overwritten. */
+        map->count = 0;
+        map->seq   = 0;
+    }
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
+
+/* Returns the generation of the binary mount table. */
+unsigned long long
+mount_map_generation(struct mount_map *map)
+{
+    return map_load(&((const struct mount_map_header *) map->base)->seq);
+}
+
+/* Closes the binary mount table. */
+void
+mount_map_close(struct mount_map *map)
+{
+    if(!map)
+        return;
+    if(map->base)
+        munmap(map->base, map->len);
+    if(map->fd >= 0)
+        close(map->fd);
+    free(map->buf);
+    free(map->entries);
+    free(map);
+}
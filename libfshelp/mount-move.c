@@ -0,0 +1,250 @@
+/* hurd/libfshelp/mount-move.c
+   Moving a mounted filesystem for mount(2) with MS_MOVE.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <fcntl.h>
+#include <hurd.h>
+#include <hurd/fsys.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* Where move_collect copies the mounts found by mount_move. */
+struct move_collect
+{
+    struct mount_arena *arena;
+    struct mntent      *mnts;
+    size_t              n;
+    error_t             err;
+};
+
+static void
+move_collect(struct fs *fs, void *cookie)
+{
+    struct move_collect *c   = cookie;
+    struct mntent       *mnt = &c->mnts[c->n++];
+
+    memset(mnt, 0, sizeof(*mnt));
+    mnt->mnt_fsname = mount_arena_strdup(c->arena, fs->mntent.mnt_fsname);
+    mnt->mnt_dir    = mount_arena_strdup(c->arena, fs->mntent.mnt_dir);
+    mnt->mnt_type   = mount_arena_strdup(c->arena, fs->mntent.mnt_type);
+    mnt->mnt_opts   = mount_arena_strdup(c->arena,
+                                         fs->mntent.mnt_opts ?: "defaults");
+    if(!mnt->mnt_fsname || !mnt->mnt_dir || !mnt->mnt_type
+       || !mnt->mnt_opts)
+        c->err = ENOMEM;
+}
+
+/* Return whether directory DIR is below PREFIX of length PREFIX_LEN. */
+static bool
+move_below(const char *dir, const char *prefix, size_t prefix_len)
+{
+    return (strncmp(dir, prefix, prefix_len) == 0)
+        && ((dir[prefix_len] == '/') || (dir[prefix_len] == '\0'));
+}
+
+/* Move the mount on FROM to TO, which are canonical, with the mount point
+   locks in HELD.  If the mounts below FROM need more than those, add them
+   to NEED and return without doing anything, for the caller to retry with
+   them held. */
+static error_t
+move(struct mount_arena *arena, const char *from, const char *to,
+     uint64_t held, uint64_t *need)
+{
+    error_t             err      = 0;
+    struct mount_table *table    = NULL;
+    struct move_collect c        = { .arena = arena };
+    size_t              n        = 0;
+    size_t              from_len = strlen(from);
+    const char         *from_dir = NULL;
+    /* Where each of C.MNTS goes. */
+    char              **to_dirs  = NULL;
+    fsys_t              control  = MACH_PORT_NULL;
+    file_t              old_node = MACH_PORT_NULL;
+    file_t              new_node = MACH_PORT_NULL;
+    /* FS_TRANS_SET for a noauto mount, whose passive translator moves
+       too. */
+    int                 lazy     = 0;
+    char                buf[1024];
+    char               *passive  = buf;
+    size_t              passive_len = 0;
+    int                 passive_flags;
+    int                 active_flags;
+    uint64_t            start;
+
+    err = mount_table_acquire(&table);
+    if(err)
+        return err;
+    if(!mount_index_find_mount(table->index, from))
+        err = EINVAL;
+    else if(mount_index_find_mount(table->index, to))
+        err = EBUSY;
+    else
+    {
+        /* The mounts below FROM move along with it, since they are on
+           nodes of its filesystem, but their mount points change. */
+        n = mount_index_each_under(table->index, from, NULL, NULL);
+        c.mnts = mount_arena_alloc(arena, n * sizeof(*c.mnts));
+        if(!c.mnts)
+            err = ENOMEM;
+        else
+        {
+            mount_index_each_under(table->index, from, move_collect, &c);
+            err = c.err;
+        }
+    }
+    mount_table_release(table);
+    if(err)
+        return err;
+
+    /* Compared as canonical paths, so that no spelling of a directory
+       below FROM gets through. */
+    if(!strcmp(from, "/") || move_below(to, from, from_len))
+        return EINVAL;
+
+    /* The mounts below FROM change too, so their locks are needed as well
+       as those of their new mount points.  The index gives FROM's own
+       entry first, as spelled in the table. */
+    from_dir = c.mnts[0].mnt_dir;
+    to_dirs  = mount_arena_alloc(arena, n * sizeof(*to_dirs));
+    if(!to_dirs)
+        return ENOMEM;
+    for(size_t i = 0; i < n; i++)
+    {
+        const char *rest = c.mnts[i].mnt_dir + strlen(from_dir);
+
+        to_dirs[i] = mount_arena_alloc(arena, strlen(to) + strlen(rest) + 1);
+        if(!to_dirs[i])
+            return ENOMEM;
+        stpcpy(stpcpy(to_dirs[i], to), rest);
+        *need |= mount_point_bit(c.mnts[i].mnt_dir)
+            | mount_point_bit(to_dirs[i]);
+    }
+    if(*need & ~held)
+        return 0;
+
+    /* A noauto mount may have nothing running, only its passive
+       translator. */
+    lazy = mount_lazy_passive_flags(&c.mnts[0]);
+    err  = mount_control_get(from_dir, &control, &old_node);
+    if(err && lazy)
+    {
+        old_node = file_name_lookup(from_dir, O_NOTRANS, 0666);
+        err      = (old_node == MACH_PORT_NULL) ? errno : 0;
+    }
+    if(err)
+        return err;
+    if(lazy)
+    {
+        passive_len = sizeof(buf);
+        err = file_get_translator(old_node, &passive, &passive_len);
+        if(err)
+            goto end_move;
+    }
+
+    new_node = file_name_lookup(to, O_NOTRANS, 0666);
+    if(new_node == MACH_PORT_NULL)
+    {
+        err = errno;
+        goto end_move;
+    }
+
+    start = mount_stats_begin(MOUNT_PHASE_ATTACH);
+    /* Attach the running translator and set the passive one on the new
+       node first, so that it is reachable throughout.  The running one
+       keeps the node it was started on as its underlying node. */
+    passive_flags = lazy ? FS_TRANS_SET | FS_TRANS_EXCL : 0;
+    active_flags  = (control != MACH_PORT_NULL)
+        ? FS_TRANS_SET | FS_TRANS_EXCL : 0;
+    err = file_set_translator(new_node, passive_flags, active_flags, 0,
+                              passive, passive_len, control,
+                              MACH_MSG_TYPE_COPY_SEND);
+    if(!err)
+    {
+        /* Then take them off the old one without asking it to go away. */
+        active_flags = (control != MACH_PORT_NULL)
+            ? FS_TRANS_SET | FS_TRANS_ORPHAN : 0;
+        err = file_set_translator(old_node, lazy, active_flags, 0, NULL, 0,
+                                  MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
+        if(err)
+            file_set_translator(new_node, lazy, active_flags, 0, NULL, 0,
+                                MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
+    }
+    mount_stats_end(MOUNT_PHASE_ATTACH, start, err);
+    if(err)
+        goto end_move;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        struct mntent *mnt = &c.mnts[i];
+
+        mount_control_forget(mnt->mnt_dir);
+        mount_journal_append(MOUNT_JOURNAL_DEL, mnt);
+        mount_lazy_move(mnt->mnt_dir, to_dirs[i]);
+        mnt->mnt_dir = to_dirs[i];
+        mount_journal_append(MOUNT_JOURNAL_ADD, mnt);
+    }
+
+    if(control != MACH_PORT_NULL)
+    {
+        mount_control_add(to, control, new_node);
+        control  = MACH_PORT_NULL;
+        new_node = MACH_PORT_NULL;
+    }
+
+end_move:
+    if(passive != buf)
+        vm_deallocate(mach_task_self(), (vm_address_t) passive, passive_len);
+    if(control != MACH_PORT_NULL)
+        mach_port_deallocate(mach_task_self(), control);
+    if(new_node != MACH_PORT_NULL)
+        mach_port_deallocate(mach_task_self(), new_node);
+    mach_port_deallocate(mach_task_self(), old_node);
+    return err;
+}
+
+error_t
+mount_move(struct mount_arena *arena, const char *from, const char *to)
+{
+    error_t   err;
+    char     *from_abs = NULL;
+    char     *to_abs   = NULL;
+    uint64_t  held, need;
+
+    if(!from || !to || (from[0] == '\0') || (to[0] == '\0'))
+        return EINVAL;
+
+    err = mount_path_absolute(arena, from, &from_abs);
+    if(!err)
+        err = mount_path_absolute(arena, to, &to_abs);
+    if(err)
+        return err;
+
+    /* Each try that finds more mounts below FROM takes more locks, of which
+       there are only so many. */
+    need = mount_point_bit(from_abs) | mount_point_bit(to_abs);
+    do
+    {
+        held = need;
+        mount_point_lock_mask(held);
+        err = move(arena, from_abs, to_abs, held, &need);
+        mount_point_unlock_mask(held);
+    } while(!err && (need & ~held));
+    return err;
+}
@@ -0,0 +1,435 @@
+/* hurd/libfshelp/mount-opts.c
+   Compile mount(2) flags and option data into translator switches.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* What to do with an option word that we recognize. */
+enum mount_kw_class
+{
+    MOUNT_KW_DROP,              /* Meaningless to the translator. */
+    MOUNT_KW_REMOUNT,
+    MOUNT_KW_BIND,
+    MOUNT_KW_NOAUTO,
+    MOUNT_KW_LOOP,
+    MOUNT_KW_OFFSET,            /* `offset=N', for loop. */
+    MOUNT_KW_SIZELIMIT,         /* `sizelimit=N', for loop. */
+    MOUNT_KW_IDLE,              /* `idle=N', for noauto. */
+    MOUNT_KW_FLAG               /* Passed on, and also set by a mount flag. */
+};
+
+struct mount_kw
+{
+    const char          *name;
+    size_t               len;
+    enum mount_kw_class  class;
+    unsigned long        flag;  /* For MOUNT_KW_FLAG. */
+};
+
+#define KW(name, class, flag) { name, sizeof(name) - 1, class, flag }
+
+/* Every word we treat specially, sorted by length.  The MOUNT_KW_FLAG
+   entries double as the table for converting mountflags into options for
+   the filesystem driver. */
+static const struct mount_kw mount_kws[] =
+{
+    KW("ro",          MOUNT_KW_FLAG,       MS_RDONLY),
+    KW("rw",          MOUNT_KW_FLAG,       0),
+    KW("bind",        MOUNT_KW_BIND,       0),
+    KW("idle",        MOUNT_KW_IDLE,       0),
+    KW("exec",        MOUNT_KW_DROP,       0),
+    KW("loop",        MOUNT_KW_LOOP,       0),
+    KW("sync",        MOUNT_KW_FLAG,       MS_SYNCHRONOUS),
+    KW("noauto",      MOUNT_KW_NOAUTO,     0),
+    KW("noexec",      MOUNT_KW_FLAG,       MS_NOEXEC),
+    KW("nosuid",      MOUNT_KW_FLAG,       MS_NOSUID),
+    KW("offset",      MOUNT_KW_OFFSET,     0),
+    KW("noatime",     MOUNT_KW_FLAG,       MS_NOATIME),
+    KW("remount",     MOUNT_KW_REMOUNT,    0),
+    KW("defaults",    MOUNT_KW_DROP,       0),
+    KW("relatime",    MOUNT_KW_FLAG,       MS_RELATIME),
+    KW("sizelimit",   MOUNT_KW_SIZELIMIT,  0),
+    KW("nodiratime",  MOUNT_KW_FLAG,       MS_NODIRATIME),
+    KW("strictatime", MOUNT_KW_FLAG,       MS_STRICTATIME),
+};
+
+#undef KW
+
+#define MOUNT_KWS_LEN    (sizeof(mount_kws) / sizeof(mount_kws[0]))
+#define MOUNT_KW_MAX_LEN (sizeof("strictatime") - 1)
+
+/* mount_kws[mount_kw_first[LEN]] up to mount_kws[mount_kw_first[LEN + 1]]
+   are the keywords of length LEN. */
+static unsigned char   mount_kw_first[MOUNT_KW_MAX_LEN + 2];
+/* Room needed to turn every flag of the table into a switch. */
+static size_t          mount_kw_flags_len;
+static pthread_once_t  mount_kw_once = PTHREAD_ONCE_INIT;
+
+static void
+mount_kw_init(void)
+{
+    size_t k = 0;
+
+    for(size_t len = 0; len <= MOUNT_KW_MAX_LEN + 1; len++)
+    {
+        while((k < MOUNT_KWS_LEN) && (mount_kws[k].len < len))
+            k++;
+        mount_kw_first[len] = k;
+    }
+
+    for(k = 0; k < MOUNT_KWS_LEN; k++)
+        if(mount_kws[k].class == MOUNT_KW_FLAG)
+            mount_kw_flags_len += mount_kws[k].len + 3;
+}
+
+/* Return whether KW is written with a value, as `NAME=VALUE'. */
+static bool
+mount_kw_valued(const struct mount_kw *kw)
+{
+    return (kw->class == MOUNT_KW_OFFSET) || (kw->class == MOUNT_KW_SIZELIMIT)
+        || (kw->class == MOUNT_KW_IDLE);
+}
+
+/* Return the keyword TOK of length LEN, or NULL if it is not one. */
+static const struct mount_kw *
+mount_kw_lookup(const char *tok, size_t len)
+{
+    if(len > MOUNT_KW_MAX_LEN)
+        return NULL;
+
+    for(size_t k = mount_kw_first[len]; k < mount_kw_first[len + 1]; k++)
+        if(memcmp(mount_kws[k].name, tok, len) == 0)
+            return &mount_kws[k];
+    return NULL;
+}
+
+/* The typed fields of struct mount_data, and the options they stand for. */
+struct mount_data_field
+{
+    const char   *name;
+    size_t        offset;
+    unsigned int  bit;
+};
+
+#define FIELD(name, member, bit) \
+    { name, offsetof(struct mount_data, member), bit }
+
+static const struct mount_data_field mount_data_fields[] =
+{
+    FIELD("rsize",      rsize,      MOUNT_DATA_RSIZE),
+    FIELD("wsize",      wsize,      MOUNT_DATA_WSIZE),
+    FIELD("uid",        uid,        MOUNT_DATA_UID),
+    FIELD("gid",        gid,        MOUNT_DATA_GID),
+    FIELD("cache-size", cache_size, MOUNT_DATA_CACHE_SIZE),
+};
+
+#undef FIELD
+
+#define MOUNT_DATA_FIELDS_LEN \
+    (sizeof(mount_data_fields) / sizeof(mount_data_fields[0]))
+/* Room for `--NAME=VALUE' of any field, with the null. */
+#define MOUNT_DATA_FIELD_MAX  (2 + 10 + 1 + 10 + 1)
+
+#define MOUNT_DATA_FIELDS_ALL \
+    (MOUNT_DATA_RSIZE | MOUNT_DATA_WSIZE | MOUNT_DATA_UID | MOUNT_DATA_GID \
+     | MOUNT_DATA_CACHE_SIZE)
+#define MOUNT_DATA_OPTS_ALL   (MOUNT_DATA_NOAUTO | MOUNT_DATA_LOOP)
+
+static const char mount_data_magic[4] = MOUNT_DATA_MAGIC;
+
+/* Return whether DATA is a struct mount_data rather than a string.  The
+   magic is compared a byte at a time, so a shorter string is not read past
+   its end. */
+static bool
+mount_data_binary(const void *data)
+{
+    const char *p = data;
+
+    if(!data)
+        return false;
+    for(size_t i = 0; i < sizeof(mount_data_magic); i++)
+        if(p[i] != mount_data_magic[i])
+            return false;
+    return true;
+}
+
+/* Return whether MD is a struct mount_data of a version we know. */
+static bool
+mount_data_valid(const struct mount_data *md)
+{
+    return (md->version == MOUNT_DATA_VERSION) && (md->size >= sizeof(*md))
+        && !(md->fields & ~MOUNT_DATA_FIELDS_ALL)
+        && !(md->opts & ~MOUNT_DATA_OPTS_ALL);
+}
+
+static unsigned int
+mount_data_value(const struct mount_data *md,
+                 const struct mount_data_field *field)
+{
+    return *(const unsigned int *) ((const char *) md + field->offset);
+}
+
+unsigned long
+mount_data_flags(const void *data)
+{
+    const struct mount_data *md = data;
+
+    if(!mount_data_binary(data) || !mount_data_valid(md))
+        return 0;
+    return md->flags;
+}
+
+error_t
+mount_data_dup(const void *data, void **copy)
+{
+    const struct mount_data *md = data;
+    struct mount_data       *dup;
+    size_t                   extra_len;
+
+    *copy = NULL;
+    if(!data)
+        return 0;
+    if(!mount_data_binary(data))
+    {
+        *copy = strdup(data);
+        return *copy ? 0 : ENOMEM;
+    }
+    if(!mount_data_valid(md))
+        return EINVAL;
+
+    /* One block, so that it is released with a single free. */
+    extra_len = md->extra ? strlen(md->extra) + 1 : 0;
+    dup = malloc(sizeof(*dup) + extra_len);
+    if(!dup)
+        return ENOMEM;
+    memcpy(dup, md, sizeof(*dup));
+    dup->size = sizeof(*dup);
+    if(md->extra)
+        dup->extra = memcpy(dup + 1, md->extra, extra_len);
+    *copy = dup;
+    return 0;
+}
+
+/* Append the switch for option TOK of length LEN to OUT, prepending `--'
+   to make a long option (e.g. `--ro' or `--rsize=1024') unless TOK is
+   already a letter option like `-r'.  Returns the end of the switch. */
+static char *
+mount_opts_put(char *out, const char *tok, size_t len)
+{
+    if(*tok != '-')
+    {
+        *out++ = '-';
+        *out++ = '-';
+    }
+    memcpy(out, tok, len);
+    out += len;
+    *out++ = '\0';
+    return out;
+}
+
+error_t
+mount_opts_compile(struct mount_arena *arena, const void *data,
+                   unsigned long flags, struct mount_opts *opts)
+{
+    const struct mount_data *md       = NULL;
+    const char              *words    = data;
+    size_t                   data_len = 0;
+    unsigned long            seen     = 0;
+    char                    *out      = NULL;
+
+    pthread_once(&mount_kw_once, mount_kw_init);
+    memset(opts, 0, sizeof(*opts));
+
+    if(mount_data_binary(data))
+    {
+        md = data;
+        if(!mount_data_valid(md))
+            return EINVAL;
+        words = md->extra;
+    }
+    if(!words)
+        words = "";
+    data_len = strlen(words);
+
+    /* Each word of DATA grows by at most its `--' prefix, and a word is
+       at least one character plus its separator. */
+    opts->argz = mount_arena_alloc(arena, 3 * (data_len + 1)
+                                          + mount_kw_flags_len
+                                          + (md ? MOUNT_DATA_FIELDS_LEN
+                                              * MOUNT_DATA_FIELD_MAX : 0));
+    if(!opts->argz)
+        return ENOMEM;
+    out = opts->argz;
+
+    /* The typed fields go first, so that the words of MD->extra can
+       override them. */
+    if(md)
+    {
+        for(size_t f = 0; f < MOUNT_DATA_FIELDS_LEN; f++)
+            if(md->fields & mount_data_fields[f].bit)
+                out += sprintf(out, "--%s=%u", mount_data_fields[f].name,
+                               mount_data_value(md, &mount_data_fields[f]))
+                    + 1;
+        opts->noauto = (md->opts & MOUNT_DATA_NOAUTO) != 0;
+        opts->loop   = (md->opts & MOUNT_DATA_LOOP) != 0;
+    }
+
+    for(const char *tok = words; *tok; )
+    {
+        const char *end = strchrnul(tok, ',');
+        size_t      len = end - tok;
+        const char *eq  = memchr(tok, '=', len);
+        const struct mount_kw *kw = mount_kw_lookup(tok, eq ? eq - tok : len);
+
+        /* Only the keywords that take a value may have one, so that e.g.
+           `sync=5' is passed on. */
+        if(kw && ((eq != NULL) != mount_kw_valued(kw)))
+            kw = NULL;
+
+        if(!kw && len)
+            out = mount_opts_put(out, tok, len);
+        else if(kw)
+        {
+            switch(kw->class)
+            {
+            case MOUNT_KW_REMOUNT:
+                opts->remount = true;
+                break;
+            case MOUNT_KW_BIND:
+                opts->bind = true;
+                break;
+            case MOUNT_KW_NOAUTO:
+                opts->noauto = true;
+                break;
+            case MOUNT_KW_LOOP:
+                opts->loop = true;
+                break;
+            case MOUNT_KW_OFFSET:
+            case MOUNT_KW_SIZELIMIT:
+            case MOUNT_KW_IDLE:
+            {
+                char               *num_end;
+                unsigned long long  num;
+
+                errno = 0;
+                num = strtoull(eq + 1, &num_end, 0);
+                if(errno || (num_end != end) || (eq + 1 == end)
+                   || (eq[1] == '-'))
+                    return EINVAL;
+                if(kw->class == MOUNT_KW_OFFSET)
+                    opts->loop_offset = num;
+                else if(kw->class == MOUNT_KW_SIZELIMIT)
+                    opts->loop_sizelimit = num;
+                else if(num <= UINT_MAX)
+                    opts->idle_timeout = num;
+                else
+                    return EINVAL;
+                break;
+            }
+            case MOUNT_KW_FLAG:
+                /* Don't pass the same switch twice if it is also given as
+                   a flag. */
+                if(!(seen & kw->flag))
+                    out = mount_opts_put(out, tok, len);
+                seen |= kw->flag;
+                break;
+            case MOUNT_KW_DROP:
+                break;
+            }
+        }
+
+        tok = (*end) ? end + 1 : end;
+    }
+
+    /* Add OR'd flags to option string. */
+    for(size_t k = 0; k < MOUNT_KWS_LEN; k++)
+    {
+        if((mount_kws[k].class == MOUNT_KW_FLAG)
+           && (flags & mount_kws[k].flag) && !(seen & mount_kws[k].flag))
+            out = mount_opts_put(out, mount_kws[k].name, mount_kws[k].len);
+    }
+
+    opts->argz_len = out - opts->argz;
+    if(!opts->argz_len)
+        opts->argz = NULL;
+    opts->flags = flags | seen;
+    return 0;
+}
+
+bool
+mount_opts_flag_switch(const char *sw)
+{
+    const struct mount_kw *kw;
+
+    pthread_once(&mount_kw_once, mount_kw_init);
+    if((sw[0] != '-') || (sw[1] != '-'))
+        return false;
+    kw = mount_kw_lookup(sw + 2, strlen(sw + 2));
+    return kw && (kw->class == MOUNT_KW_FLAG);
+}
+
+error_t
+mount_opts_text(struct mount_arena *arena, const void *data, char **text)
+{
+    const struct mount_data *md  = data;
+    char                    *out = NULL;
+    size_t                   len = 0;
+
+    pthread_once(&mount_kw_once, mount_kw_init);
+    if(!mount_data_binary(data))
+    {
+        *text = (char *) ((data && (*(const char *) data != '\0'))
+                          ? data : "defaults");
+        return 0;
+    }
+    if(!mount_data_valid(md))
+        return EINVAL;
+
+    len = mount_kw_flags_len + MOUNT_DATA_FIELDS_LEN * MOUNT_DATA_FIELD_MAX
+        + sizeof("noauto,loop,") + (md->extra ? strlen(md->extra) : 0) + 1;
+    *text = out = mount_arena_alloc(arena, len);
+    if(!out)
+        return ENOMEM;
+
+    for(size_t k = 0; k < MOUNT_KWS_LEN; k++)
+        if((mount_kws[k].class == MOUNT_KW_FLAG) && mount_kws[k].flag
+           && (md->flags & mount_kws[k].flag))
+            out += sprintf(out, "%s,", mount_kws[k].name);
+    if(md->opts & MOUNT_DATA_NOAUTO)
+        out = stpcpy(out, "noauto,");
+    if(md->opts & MOUNT_DATA_LOOP)
+        out = stpcpy(out, "loop,");
+    for(size_t f = 0; f < MOUNT_DATA_FIELDS_LEN; f++)
+        if(md->fields & mount_data_fields[f].bit)
+            out += sprintf(out, "%s=%u,", mount_data_fields[f].name,
+                           mount_data_value(md, &mount_data_fields[f]));
+    if(md->extra && (md->extra[0] != '\0'))
+        out = stpcpy(out, md->extra);
+    else if(out > *text)
+        out[-1] = '\0';
+    else
+        strcpy(out, "defaults");
+    return 0;
+}
@@ -0,0 +1,407 @@
+/* hurd/libfshelp/mount-pool.c
+   Translators started ahead of the mounts that will use them.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+
+#include <fcntl.h>
+#include <hurd.h>
+#include <hurd/fshelp.h>
+#include <hurd/fsys.h>
+#include <mach.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include "mount-priv.h"
+
+/* A pool is configured for the exact command line that do_mount would run
+   for a mount, and keeps up to its size of translators started with it
+   and waiting.  A mount that would run that command line takes one
+   instead, and a thread of its own starts a replacement.  Since the
+   mount point is not known when they start, pooled translators get the
+   root directory as their underlying node.  A filesystem without a
+   backing store takes the mode and owner of its root from that node, as
+   tmpfs does, so the mount that takes one gives its root those of the
+   mount point with mount_pool_fit. */
+
+/* Every translator of a pool runs the same command line, device included,
+   so they must be able to share it: pools are only for filesystems
+   without a backing store, and for read-only ones.  Two writable
+   translators on one block device would corrupt it. */
+
+/* Most translators one pool, and all of them together, keep waiting. */
+#define MOUNT_POOL_MAX_SIZE  32
+#define MOUNT_POOL_MAX_TOTAL 64
+
+struct mount_pool_idle
+{
+    fsys_t                  control;
+    struct mount_pool_idle *next;
+};
+
+struct mount_pool
+{
+    char                   *argz;
+    size_t                  argz_len;
+    unsigned int            size;
+    unsigned int            nidle;
+    unsigned int            starting;
+    /* Set for filesystems without a backing store; see mount_pool_fit. */
+    bool                    fit;
+    /* Set when starting one failed, so the refill thread does not keep
+       trying; cleared when the pool is configured or used. */
+    bool                    broken;
+    struct mount_pool_idle *idle;
+    struct mount_pool      *next;
+};
+
+static pthread_mutex_t    mount_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Pools are never freed, only set to size 0, so a pointer to one stays
+   good without the lock. */
+static struct mount_pool *mount_pools     = NULL;
+static unsigned int       mount_pool_idle_total = 0;
+static bool               mount_pool_refilling  = false;
+static struct mount_pool_stats mount_pool_counts;
+
+static error_t
+mount_pool_open(int flags, mach_port_t *underlying,
+                mach_msg_type_name_t *underlying_type, task_t task,
+                void *cookie)
+{
+    file_t node = file_name_lookup("/", flags | O_NOTRANS, 0666);
+
+    if(node == MACH_PORT_NULL)
+        return errno;
+    *underlying      = node;
+    *underlying_type = MACH_MSG_TYPE_MOVE_SEND;
+    return 0;
+}
+
+/* Return the pool for ARGZ, or NULL.  Called with mount_pool_lock held. */
+static struct mount_pool *
+mount_pool_find(const char *argz, size_t argz_len)
+{
+    struct mount_pool *pool;
+
+    for(pool = mount_pools; pool; pool = pool->next)
+        if((pool->argz_len == argz_len)
+           && (memcmp(pool->argz, argz, argz_len) == 0))
+            break;
+    return pool;
+}
+
+/* Return a pool that wants another translator, or NULL.  Called with
+   mount_pool_lock held. */
+static struct mount_pool *
+mount_pool_wanting(void)
+{
+    unsigned int total = mount_pool_idle_total;
+
+    for(struct mount_pool *pool = mount_pools; pool; pool = pool->next)
+        total += pool->starting;
+    if(total >= MOUNT_POOL_MAX_TOTAL)
+        return NULL;
+
+    for(struct mount_pool *pool = mount_pools; pool; pool = pool->next)
+        if(!pool->broken && (pool->nidle + pool->starting < pool->size))
+            return pool;
+    return NULL;
+}
+
+static void *
+mount_pool_refill(void *arg)
+{
+    struct mount_pool *pool;
+
+    pthread_mutex_lock(&mount_pool_lock);
+    while((pool = mount_pool_wanting()))
+    {
+        struct mount_pool_idle *idle    = NULL;
+        fsys_t                  control = MACH_PORT_NULL;
+        error_t                 err;
+
+        pool->starting++;
+        pthread_mutex_unlock(&mount_pool_lock);
+        err = mount_start_translator(mount_pool_open, NULL, pool->argz,
+                                     pool->argz_len, &control);
+        if(!err)
+        {
+            idle = malloc(sizeof(*idle));
+            if(!idle)
+                err = ENOMEM;
+        }
+        pthread_mutex_lock(&mount_pool_lock);
+        pool->starting--;
+
+        if(err)
+        {
+            pool->broken = true;
+            mount_pool_counts.failed++;
+        }
+        else
+            mount_pool_counts.started++;
+
+        if(!err && (pool->nidle < pool->size))
+        {
+            idle->control = control;
+            idle->next    = pool->idle;
+            pool->idle    = idle;
+            pool->nidle++;
+            mount_pool_idle_total++;
+            control = MACH_PORT_NULL;
+            idle    = NULL;
+        }
+
+        if(control != MACH_PORT_NULL)
+        {
+            /* Shrunk while it was starting. */
+            pthread_mutex_unlock(&mount_pool_lock);
+            fsys_goaway(control, FSYS_GOAWAY_FORCE);
+            mach_port_deallocate(mach_task_self(), control);
+            pthread_mutex_lock(&mount_pool_lock);
+        }
+        free(idle);
+    }
+    /* Exit when idle; the next take or configure starts a new one. */
+    mount_pool_refilling = false;
+    pthread_mutex_unlock(&mount_pool_lock);
+    return NULL;
+}
+
+/* Start the refill thread if it is not running.  Called with
+   mount_pool_lock held. */
+static void
+mount_pool_wake(void)
+{
+    pthread_t      thread;
+    pthread_attr_t attr;
+
+    if(mount_pool_refilling || !mount_pool_wanting())
+        return;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&thread, &attr, mount_pool_refill, NULL) == 0)
+        mount_pool_refilling = true;
+    pthread_attr_destroy(&attr);
+}
+
+/* Remove the translators past POOL's size and return them.  Called with
+   mount_pool_lock held. */
+static struct mount_pool_idle *
+mount_pool_trim(struct mount_pool *pool)
+{
+    struct mount_pool_idle *extra = NULL;
+
+    while(pool->nidle > pool->size)
+    {
+        struct mount_pool_idle *idle = pool->idle;
+
+        pool->idle = idle->next;
+        pool->nidle--;
+        mount_pool_idle_total--;
+        idle->next = extra;
+        extra      = idle;
+    }
+    return extra;
+}
+
+fsys_t
+mount_pool_take(const char *argz, size_t argz_len, bool *fit)
+{
+    struct mount_pool      *pool;
+    struct mount_pool_idle *dead    = NULL;
+    fsys_t                  control = MACH_PORT_NULL;
+
+    /* Nothing configured: don't even take the lock. */
+    if(!__atomic_load_n(&mount_pools, __ATOMIC_ACQUIRE))
+        return MACH_PORT_NULL;
+
+    pthread_mutex_lock(&mount_pool_lock);
+    pool = mount_pool_find(argz, argz_len);
+    if(!pool || !pool->size)
+    {
+        pthread_mutex_unlock(&mount_pool_lock);
+        return MACH_PORT_NULL;
+    }
+
+    while(pool->idle && (control == MACH_PORT_NULL))
+    {
+        struct mount_pool_idle *idle = pool->idle;
+        mach_port_type_t        type = 0;
+
+        pool->idle = idle->next;
+        pool->nidle--;
+        mount_pool_idle_total--;
+        /* One that died while waiting is no good. */
+        if((mach_port_type(mach_task_self(), idle->control, &type) == 0)
+           && !(type & MACH_PORT_TYPE_DEAD_NAME))
+        {
+            control = idle->control;
+            free(idle);
+        }
+        else
+        {
+            idle->next = dead;
+            dead       = idle;
+        }
+    }
+
+    if(control != MACH_PORT_NULL)
+        mount_pool_counts.hits++;
+    else
+        mount_pool_counts.misses++;
+    *fit         = pool->fit;
+    pool->broken = false;
+    mount_pool_wake();
+    pthread_mutex_unlock(&mount_pool_lock);
+
+    while(dead)
+    {
+        struct mount_pool_idle *next = dead->next;
+        mach_port_deallocate(mach_task_self(), dead->control);
+        free(dead);
+        dead = next;
+    }
+    return control;
+}
+
+/* Gives the root of CONTROL the mode and owner of NODE. */
+error_t
+mount_pool_fit(fsys_t control, file_t node)
+{
+    error_t     err;
+    file_t      root = MACH_PORT_NULL;
+    retry_type  retry;
+    string_t    retry_name;
+    uid_t       uid  = geteuid();
+    gid_t       gid  = getegid();
+    struct stat st;
+
+    err = io_stat(node, &st);
+    if(!err)
+        err = fsys_getroot(control, MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND,
+                           &uid, 1, &gid, 1, 0, &retry, retry_name, &root);
+    if(!err)
+        err = file_chown(root, st.st_uid, st.st_gid);
+    if(!err)
+        err = file_chmod(root, st.st_mode & ~S_IFMT);
+
+    if(root != MACH_PORT_NULL)
+        mach_port_deallocate(mach_task_self(), root);
+    return err;
+}
+
+/* Return whether mounting SOURCE with FILESYSTEMTYPE has no backing store
+   that its translator writes to. */
+static bool
+mount_pool_storeless(const char *source, const char *filesystemtype)
+{
+    return (source[0] == '\0') || (strcmp(source, "none") == 0)
+        || (strcmp(filesystemtype, "tmpfs") == 0);
+}
+
+/* Configures a pool of translators started ahead of time. */
+int
+mount_pool_configure(const char *source, const char *filesystemtype,
+                     unsigned long mountflags, const void *data,
+                     unsigned int size)
+{
+    error_t                 err      = 0;
+    char                   *argz     = NULL;
+    size_t                  argz_len = 0;
+    struct mount_pool      *pool     = NULL;
+    struct mount_pool_idle *extra    = NULL;
+    unsigned long           flags    = 0;
+    struct mount_arena      arena;
+
+    mount_arena_init(&arena);
+    if(!source || !filesystemtype)
+    {
+        err = EINVAL;
+        goto end_configure;
+    }
+    if(size > MOUNT_POOL_MAX_SIZE)
+        size = MOUNT_POOL_MAX_SIZE;
+
+    err = mount_pool_argz(&arena, source, filesystemtype, mountflags, data,
+                          &argz, &argz_len, &flags);
+    if(err)
+        goto end_configure;
+    if(!(flags & MS_RDONLY) && !mount_pool_storeless(source, filesystemtype))
+    {
+        err = EINVAL;
+        goto end_configure;
+    }
+
+    pthread_mutex_lock(&mount_pool_lock);
+    pool = mount_pool_find(argz, argz_len);
+    if(!pool && size)
+    {
+        pool = calloc(1, sizeof(*pool));
+        if(pool)
+            pool->argz = malloc(argz_len);
+        if(!pool || !pool->argz)
+        {
+            if(pool)
+                free(pool);
+            pthread_mutex_unlock(&mount_pool_lock);
+            err = ENOMEM;
+            goto end_configure;
+        }
+        memcpy(pool->argz, argz, argz_len);
+        pool->argz_len = argz_len;
+        pool->next     = mount_pools;
+        __atomic_store_n(&mount_pools, pool, __ATOMIC_RELEASE);
+    }
+    if(pool)
+    {
+        pool->size   = size;
+        pool->fit    = mount_pool_storeless(source, filesystemtype);
+        pool->broken = false;
+        extra = mount_pool_trim(pool);
+        mount_pool_wake();
+    }
+    pthread_mutex_unlock(&mount_pool_lock);
+
+    while(extra)
+    {
+        struct mount_pool_idle *next = extra->next;
+        fsys_goaway(extra->control, FSYS_GOAWAY_FORCE);
+        mach_port_deallocate(mach_task_self(), extra->control);
+        free(extra);
+        extra = next;
+    }
+
+end_configure:
+    mount_arena_free(&arena);
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
+
+/* Copies the counters of the pools. */
+void
+mount_pool_get_stats(struct mount_pool_stats *stats)
+{
+    pthread_mutex_lock(&mount_pool_lock);
+    *stats      = mount_pool_counts;
+    stats->idle = mount_pool_idle_total;
+    pthread_mutex_unlock(&mount_pool_lock);
+}
@@ -0,0 +1,389 @@
+/* hurd/libfshelp/mount-priv.h
+   Internal interfaces shared by the mount(2) implementation.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#ifndef _FSHELP_MOUNT_PRIV_H
+#define _FSHELP_MOUNT_PRIV_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mount.h>
+#include <sys/types.h>
+#include <hurd/fshelp.h>
+#include "../sutils/fstab.h"
+
+/* XXX fix libc.  The benchmarks in bench/ move it out of /etc. */
+#undef _PATH_MOUNTED
+#ifdef MOUNT_PATH_MOUNTED
+# define _PATH_MOUNTED MOUNT_PATH_MOUNTED
+#else
+# define _PATH_MOUNTED "/etc/mtab"
+#endif
+
+/* The directory of what this library records about the translators it
+   started.  None of them outlive a boot, so neither may the records: it
+   is meant to be on a filesystem emptied at boot, and is created when
+   first written to. */
+#ifdef MOUNT_PATH_RUN
+# define _PATH_MOUNT_RUN MOUNT_PATH_RUN
+#else
+# define _PATH_MOUNT_RUN "/run/mount/"
+#endif
+
+/* Where mount_journal keeps what this library mounted. */
+#define _PATH_MOUNT_SNAPSHOT _PATH_MOUNT_RUN "mtab.snap"
+#define _PATH_MOUNT_JOURNAL  _PATH_MOUNT_RUN "mtab.log"
+/* Where mount_map_publish writes the table for `mount_map_open'. */
+#define _PATH_MOUNT_MAP      _PATH_MOUNT_RUN "mtab.map"
+
+/* Bump allocator for the transient allocations of one mount or unmount
+   call.  Allocations are served from INLINE_BUF, normally on the caller's
+   stack, and only spill to the heap once it is used up.  Nothing is freed
+   individually; mount_arena_free releases everything at once. */
+struct mount_arena
+{
+    char                     *cur;
+    char                     *end;
+    struct mount_arena_chunk *chunks;
+    max_align_t               inline_buf[1024 / sizeof(max_align_t)];
+};
+
+void mount_arena_init(struct mount_arena *arena);
+
+/* Return SIZE bytes from ARENA, suitably aligned for any type, or NULL if
+   out of memory. */
+void *mount_arena_alloc(struct mount_arena *arena, size_t size);
+
+char *mount_arena_strdup(struct mount_arena *arena, const char *str);
+
+void mount_arena_free(struct mount_arena *arena);
+
+/* A snapshot of the table of mounted filesystems.  It is never modified
+   once published, so any number of threads may read it at once. */
+struct mount_table
+{
+    struct fstab       *fstab;
+    struct mount_index *index;  /* Lookups in FSTAB. */
+    int                 refs;   /* Protected by the table lock. */
+};
+
+/* Lookup structure over the entries of an fstab, built once per mount
+   table snapshot.  The fstab must outlive it and not change. */
+struct mount_index;
+
+error_t mount_index_build(struct fstab *fstab, struct mount_index **index);
+void mount_index_free(struct mount_index *index);
+
+/* Return the first entry mounted on DIR, or NULL.  DIR must be absolute
+   but need not be in canonical form: repeated slashes, `.' and `..' are
+   resolved lexically.  The same goes for the paths below. */
+struct fs *mount_index_find_mount(const struct mount_index *index,
+                                  const char *dir);
+
+/* Return the first entry whose source is DEV, or NULL. */
+struct fs *mount_index_find_device(const struct mount_index *index,
+                                   const char *dev);
+
+/* Return the entry of the deepest mount point that contains PATH, or
+   NULL. */
+struct fs *mount_index_containing(const struct mount_index *index,
+                                  const char *path);
+
+/* Call FN, if not null, on every entry mounted on DIR or below it, parents
+   before their children, and return how many there are. */
+size_t mount_index_each_under(const struct mount_index *index,
+                              const char *dir,
+                              void (*fn)(struct fs *fs, void *cookie),
+                              void *cookie);
+
+/* Store in ABS, allocated in ARENA, PATH made absolute against the
+   current working directory, as the kernel resolves a relative target,
+   with `.' and `..' folded lexically and no repeated or trailing slash.
+   The mount table only holds mount points in this form, so one directory
+   always has one entry, one control port and one lock. */
+error_t mount_path_absolute(struct mount_arena *arena, const char *path,
+                            char **abs);
+
+/* Return in TABLE a reference to the current snapshot of the process-wide
+   table of mounted filesystems: _PATH_MOUNTED with what mount_journal
+   recorded on top.  A new snapshot is only read when the identity, size or
+   modification time of one of their files changed, or after
+   mount_table_invalidate.  Every successful call must be
+   paired with mount_table_release. */
+error_t mount_table_acquire(struct mount_table **table);
+
+/* Drop the reference to TABLE returned by mount_table_acquire. */
+void mount_table_release(struct mount_table *table);
+
+/* Make the next mount_table_acquire re-read _PATH_MOUNTED.  Called after we
+   mount or unmount something ourselves, since the mtab translator does not
+   necessarily change the file's stamp when its contents change. */
+void mount_table_invalidate(void);
+
+/* Called once we changed the table ourselves: commit the journal, make the
+   next mount_table_acquire re-read it and have it published with
+   mount_map_schedule.  Nothing is read here. */
+void mount_table_changed(void);
+
+/* Write TABLE to _PATH_MOUNT_MAP for the readers of `mount_map_read'.
+   Like the journal, failing to is not an error of the caller's. */
+void mount_map_publish(struct mount_table *table);
+
+/* Have a background thread read the table and publish it shortly, once
+   for every burst of changes.  What is still to be published when the
+   process exits is published before. */
+void mount_map_schedule(void);
+
+/* The options of a mount call, split into translator switches and the
+   options that are meant for us. */
+struct mount_opts
+{
+    char    *argz;              /* Switches, e.g. `--ro' or `-E'. */
+    size_t   argz_len;
+    /* The MS_* flags in effect, from both the mount flags and the option
+       words. */
+    unsigned long flags;
+    bool     remount;
+    bool     bind;
+    bool     noauto;
+    bool     loop;
+    uint64_t loop_offset;       /* Where the filesystem starts in the
+                                   image, in bytes. */
+    uint64_t loop_sizelimit;    /* How much of the image it takes, or 0
+                                   for the rest. */
+    unsigned int idle_timeout;  /* `idle=N': seconds after which the
+                                   translator of a noauto mount is
+                                   stopped when unused, or 0. */
+};
+
+/* Compile the options in DATA, either a comma separated string or a
+   struct mount_data, and the MS_* bits of FLAGS that map to options into
+   OPTS, in one pass and one buffer taken from ARENA.  DATA may be null. */
+error_t mount_opts_compile(struct mount_arena *arena, const void *data,
+                           unsigned long flags, struct mount_opts *opts);
+
+/* Return the MS_* flags given in DATA if it is a struct mount_data, to be
+   added to the mount flags, or 0. */
+unsigned long mount_data_flags(const void *data);
+
+/* Return in COPY a copy of DATA, a string or a struct mount_data, to be
+   released with free. */
+error_t mount_data_dup(const void *data, void **copy);
+
+/* Return in TEXT the options in DATA as a comma separated string for the
+   mount table, allocated from ARENA if it has to be formatted. */
+error_t mount_opts_text(struct mount_arena *arena, const void *data,
+                        char **text);
+
+/* Return whether the switch SW of an argz from mount_opts_compile stands
+   for one of the MS_* flags, like `--ro' or `--noatime'. */
+bool mount_opts_flag_switch(const char *sw);
+
+/* Return in CONTROL, if not null, a send right to the control port of the
+   translator running on DIR, and in NODE, if not null, one to the node it
+   sits on.  Ports remembered by mount_control_add are used without any
+   RPC; for other mount points they are looked up. */
+error_t mount_control_get(const char *dir, fsys_t *control, file_t *node);
+
+/* Remember CONTROL and NODE, whose send rights are consumed, as those of
+   the translator we started on DIR, until it dies or mount_control_forget
+   is called. */
+void mount_control_add(const char *dir, fsys_t control, file_t node);
+
+/* Forget the ports remembered for DIR, once its translator is gone. */
+void mount_control_forget(const char *dir);
+
+/* Serialize the calls that change what is mounted on DIR, so that the
+   translator one starts or stops and the journal record it appends are not
+   interleaved with another's.  Mount points that hash alike share a
+   lock, so a thread must hold no more than one but through
+   mount_point_lock_mask, which takes those of the mount points whose
+   mount_point_bit are in MASK. */
+void mount_point_lock(const char *dir);
+void mount_point_unlock(const char *dir);
+uint64_t mount_point_bit(const char *dir);
+void mount_point_lock_mask(uint64_t mask);
+void mount_point_unlock_mask(uint64_t mask);
+
+/* Start the translator whose command line is ARGZ, on the node opened by
+   OPEN_FN with COOKIE, as do_mount does, and return its control port in
+   CONTROL. */
+error_t mount_start_translator(fshelp_open_fn_t open_fn, void *cookie,
+                               char *argz, size_t argz_len, fsys_t *control);
+
+/* Return in ARGZ, allocated from ARENA, the command line do_mount would run
+   for mounting SOURCE with FILESYSTEMTYPE, MOUNTFLAGS and DATA, and in
+   FLAGS the MS_* flags it would have in effect. */
+error_t mount_pool_argz(struct mount_arena *arena, const char *source,
+                        const char *filesystemtype, unsigned long mountflags,
+                        const void *data, char **argz, size_t *argz_len,
+                        unsigned long *flags);
+
+/* Return the control port of a translator already running ARGZ from a
+   pool configured by `mount_pool_configure', or MACH_PORT_NULL.  It was
+   started on the root directory; *FIT is set if it took the mode and
+   owner of its root from there, and so must be given those of its mount
+   point by mount_pool_fit before it is attached. */
+fsys_t mount_pool_take(const char *argz, size_t argz_len, bool *fit);
+
+/* Give the root of the pooled translator CONTROL the mode and owner of
+   NODE, as if it had been started on it. */
+error_t mount_pool_fit(fsys_t control, file_t node);
+
+/* Change the options of the translator running on FS's mount point to
+   those in OPTS, sending it only what differs from its current ones.
+   Only the flags in MS_RMT_MASK and the switches that are not flags are
+   changed. */
+error_t mount_remount(struct mount_arena *arena, struct fs *fs,
+                      const struct mount_opts *opts);
+
+/* Change FSOPTS and DEVICE, the switches and the device of a mount with
+   the loop option of OPTS, so that the translator opens the image file
+   IMAGE itself, allocating from ARENA. */
+error_t mount_loop_device(struct mount_arena *arena, const char *image,
+                          const struct mount_opts *opts, char **fsopts,
+                          size_t *fsopts_len, char **device);
+
+/* Set ARGZ as the passive translator of DIR, for a noauto mount, and if
+   IDLE is not 0, make it go away whenever it is unused IDLE seconds after
+   it was last found in use. */
+error_t mount_lazy(const char *dir, char *argz, size_t argz_len,
+                   unsigned int idle);
+
+/* Return the passive flags to unmount MNTENT with: FS_TRANS_SET for a
+   noauto mount, whose passive translator goes too, or 0. */
+int mount_lazy_passive_flags(const struct mntent *mntent);
+
+/* Stop watching DIR for idleness, once it is unmounted. */
+void mount_lazy_forget(const char *dir);
+
+/* Watch TO instead of FROM for idleness, once its mount moved there. */
+void mount_lazy_move(const char *from, const char *to);
+
+/* Move the translator mounted on FROM, and the mount points of the mounts
+   below it, to TO without restarting it.  The passive translator of a
+   noauto mount moves along, whether or not it is running. */
+error_t mount_move(struct mount_arena *arena, const char *from,
+                   const char *to);
+
+/* Return in PROGRAM, allocated from ARENA, the translator that implements
+   the type of FS.  Programs found through FS's fstab are remembered, and so
+   are types without one (EFTYPE), until _HURD changes or
+   mount_fstype_flush is called. */
+error_t mount_fstype_program(struct mount_arena *arena, struct fs *fs,
+                             char **program);
+
+/* Bits of mount_probes: what is done around each phase. */
+#define MOUNT_PROBE_STATS 1     /* Statistics are collected. */
+#define MOUNT_PROBE_TRACE 2     /* Trace hooks are registered. */
+
+extern int mount_probes;
+
+uint64_t mount_stats_now(void);
+
+/* Account PHASE as having run from START until now. */
+void mount_stats_phase(enum mount_phase phase, uint64_t start);
+
+/* Count one call of OP that returned ERR. */
+void mount_stats_call(enum mount_stats_op op, error_t err);
+
+/* Called by mount_stats_begin and mount_stats_end when mount_probes is
+   not 0. */
+uint64_t mount_probe_begin(enum mount_phase phase);
+void mount_probe_end(enum mount_phase phase, uint64_t start, error_t err);
+
+/* Built with -DMOUNT_SDT, each phase is also a pair of static probes,
+   libfshelp:phase_begin and libfshelp:phase_end, for tracers that attach
+   to those. */
+#ifdef MOUNT_SDT
+# include <sys/sdt.h>
+# define MOUNT_SDT_BEGIN(phase) DTRACE_PROBE1(libfshelp, phase_begin, phase)
+# define MOUNT_SDT_END(phase, err) \
+    DTRACE_PROBE2(libfshelp, phase_end, phase, err)
+#else
+# define MOUNT_SDT_BEGIN(phase)
+# define MOUNT_SDT_END(phase, err)
+#endif
+
+/* Start PHASE and return its start time, or 0 if neither statistics nor
+   tracing are on. */
+static inline uint64_t
+mount_stats_begin(enum mount_phase phase)
+{
+    MOUNT_SDT_BEGIN(phase);
+    return __atomic_load_n(&mount_probes, __ATOMIC_RELAXED)
+        ? mount_probe_begin(phase) : 0;
+}
+
+/* End the phase started at START, which failed with ERR or not. */
+static inline void
+mount_stats_end(enum mount_phase phase, uint64_t start, error_t err)
+{
+    MOUNT_SDT_END(phase, err);
+    if(start)
+        mount_probe_end(phase, start, err);
+}
+
+/* Take the translator on MNTENT's mount point out of the namespace at once
+   and leave making it go away with GOAWAY_FLAGS to a background reaper,
+   which retries while it is busy.  The outcome is reported by
+   umount_detach_status. */
+error_t mount_detach(const struct mntent *mntent, int goaway_flags);
+
+enum mount_journal_op
+{
+    MOUNT_JOURNAL_ADD = 1,      /* MNT was mounted. */
+    MOUNT_JOURNAL_REMOUNT,      /* MNT's mount point has new options. */
+    MOUNT_JOURNAL_DEL           /* MNT's mount point was unmounted. */
+};
+
+/* Append a record of OP on MNT to the journal of mounted filesystems.  It
+   is not on disk until mount_journal_commit.  The table is only a record,
+   so failing to write it is not a failure of the mount and is ignored.
+   The watchers of the table are told as well. */
+void mount_journal_append(enum mount_journal_op op, const struct mntent *mnt);
+
+/* Serialize the changes to the table with `mount_watch_resync', so that a
+   change is either in the table it reads or posted after it, never both.
+   Held by mount_journal_append from the record to the event.  Returns
+   whether there are watchers to post to; if not, the appender is only
+   counted, and does not wait for the others.  Pass what it returned to
+   mount_watch_post_unlock. */
+bool mount_watch_post_lock(void);
+void mount_watch_post_unlock(bool post);
+
+/* Queue the event for OP on MNT for every `mount_watch_open' watcher.
+   Called by mount_journal_append, with mount_watch_post_lock held. */
+void mount_watch_post(enum mount_journal_op op, const struct mntent *mnt);
+
+/* Wait until every record appended so far is on disk.  Concurrent callers
+   share one fsync. */
+void mount_journal_commit(void);
+
+/* Add the filesystems recorded in the snapshot and the journal to
+   FSTAB. */
+error_t mount_journal_load(struct fstab *fstab);
+
+/* Open PATH under _PATH_MOUNT_RUN as open(2) does, creating the directory
+   first if FLAGS has O_CREAT and it is missing. */
+int mount_run_open(const char *path, int flags, mode_t mode);
+
+#endif /* _FSHELP_MOUNT_PRIV_H */
@@ -0,0 +1,154 @@
+/* hurd/libfshelp/mount-remount.c
+   Changing the options of a mounted filesystem.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+
+#include <hurd.h>
+#include <hurd/fsys.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* The flags of MS_RMT_MASK that Hurd translators have switches for. */
+#define REMOUNT_FLAGS (MS_RDONLY | MS_SYNCHRONOUS)
+
+/* What to ask for when synchronous writes are turned off: periodic syncs
+   at libdiskfs's default interval. */
+#define REMOUNT_ASYNC "--sync=5"
+
+/* Return the REMOUNT_FLAGS that the options ARGZ of a running translator
+   amount to.  The first entry is the program name. */
+static unsigned long
+remount_current_flags(const char *argz, size_t argz_len)
+{
+    unsigned long  flags = 0;
+    const char    *end   = argz + argz_len;
+
+    if(!argz_len)
+        return 0;
+    for(const char *sw = argz + strlen(argz) + 1; sw < end;
+        sw += strlen(sw) + 1)
+    {
+        if(!strcmp(sw, "--readonly") || !strcmp(sw, "--ro")
+           || !strcmp(sw, "-r"))
+            flags |= MS_RDONLY;
+        else if(!strcmp(sw, "--writable") || !strcmp(sw, "--rw")
+                || !strcmp(sw, "-w"))
+            flags &= ~MS_RDONLY;
+        else if(!strcmp(sw, "--sync") || !strcmp(sw, "-s"))
+            flags |= MS_SYNCHRONOUS;
+        else if(!strncmp(sw, "--sync=", 7) || !strcmp(sw, "--no-sync")
+                || !strcmp(sw, "-n") || !strncmp(sw, "-s", 2))
+            flags &= ~MS_SYNCHRONOUS;
+    }
+    return flags;
+}
+
+/* Return whether the switches of ARGZ say how often to sync, which
+   turns synchronous writes off in a way of their own. */
+static bool
+remount_has_interval(const char *argz, size_t argz_len)
+{
+    const char *end = argz + argz_len;
+
+    for(const char *p = argz; p && (p < end); p += strlen(p) + 1)
+        if(!strncmp(p, "--sync=", 7) || !strcmp(p, "--no-sync"))
+            return true;
+    return false;
+}
+
+/* Return whether the switch SW is one of the LEN bytes of ARGZ. */
+static bool
+remount_has_switch(const char *argz, size_t argz_len, const char *sw)
+{
+    const char *end = argz + argz_len;
+
+    for(const char *p = argz; p < end; p += strlen(p) + 1)
+        if(strcmp(p, sw) == 0)
+            return true;
+    return false;
+}
+
+error_t
+mount_remount(struct mount_arena *arena, struct fs *fs,
+              const struct mount_opts *opts)
+{
+    error_t        err      = 0;
+    fsys_t         control  = MACH_PORT_NULL;
+    char           buf[1024];
+    char          *cur      = buf;
+    size_t         cur_len  = sizeof(buf);
+    bool           known    = false;
+    unsigned long  have     = 0;
+    unsigned long  want     = opts->flags & REMOUNT_FLAGS;
+    char          *change   = NULL;
+    char          *out      = NULL;
+    const char    *end      = opts->argz + opts->argz_len;
+
+    err = mount_control_get(fs->mntent.mnt_dir, &control, NULL);
+    if(err)
+        return err;
+
+    /* Without the current options, every flag is sent as it is wanted,
+       except that synchronous writes are not turned off blindly. */
+    if(fsys_get_options(control, &cur, &cur_len) == 0)
+    {
+        known = true;
+        have  = remount_current_flags(cur, cur_len);
+    }
+    else
+    {
+        cur_len = 0;
+        have    = ~want & MS_RDONLY;
+    }
+
+    change = mount_arena_alloc(arena, opts->argz_len + sizeof("--writable")
+                                      + sizeof(REMOUNT_ASYNC));
+    if(!change)
+    {
+        err = ENOMEM;
+        goto end_remount;
+    }
+    out = change;
+
+    if((have ^ want) & MS_RDONLY)
+        out = stpcpy(out, (want & MS_RDONLY) ? "--readonly" : "--writable")
+            + 1;
+    if(((have ^ want) & MS_SYNCHRONOUS)
+       && ((want & MS_SYNCHRONOUS)
+           || !remount_has_interval(opts->argz, opts->argz_len)))
+        out = stpcpy(out, (want & MS_SYNCHRONOUS) ? "--sync" : REMOUNT_ASYNC)
+            + 1;
+
+    /* Switches of the filesystem's own, less those it already has. */
+    for(const char *sw = opts->argz; sw && (sw < end); sw += strlen(sw) + 1)
+        if(!mount_opts_flag_switch(sw)
+           && !(known && remount_has_switch(cur, cur_len, sw)))
+            out = stpcpy(out, sw) + 1;
+
+    /* Nothing to change; don't bother the translator. */
+    if(out != change)
+        err = fsys_set_options(control, change, out - change, 0);
+
+end_remount:
+    if(cur != buf)
+        vm_deallocate(mach_task_self(), (vm_address_t) cur, cur_len);
+    mach_port_deallocate(mach_task_self(), control);
+    return err;
+}
@@ -0,0 +1,161 @@
+/* hurd/libfshelp/mount-stats.c
+   Call counts and per-phase latencies of mount(2) and umount(2).
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <time.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* Counters are updated with relaxed atomics and never locked; a snapshot
+   taken while mounts are running may be slightly inconsistent. */
+#define STAT_ADD(var, n) __atomic_fetch_add(&(var), (n), __ATOMIC_RELAXED)
+#define STAT_GET(var)    __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define STAT_SET(var, n) __atomic_store_n(&(var), (n), __ATOMIC_RELAXED)
+
+int mount_probes = 0;
+
+static struct mount_stats stats;
+
+uint64_t
+mount_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    /* Never 0, which mount_stats_begin returns when disabled. */
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec + 1;
+}
+
+void
+mount_stats_phase(enum mount_phase phase, uint64_t start)
+{
+    struct mount_phase_stats *ps  = &stats.phases[phase];
+    unsigned long long        ns  = mount_stats_now() - start;
+    unsigned long long        us  = ns / 1000;
+    unsigned long long        max = STAT_GET(ps->max_ns);
+    size_t                    bkt = us ? 64 - __builtin_clzll(us) : 0;
+
+    if(bkt >= MOUNT_STATS_BUCKETS)
+        bkt = MOUNT_STATS_BUCKETS - 1;
+
+    STAT_ADD(ps->count, 1);
+    STAT_ADD(ps->total_ns, ns);
+    STAT_ADD(ps->hist[bkt], 1);
+    while((ns > max)
+          && !__atomic_compare_exchange_n(&ps->max_ns, &max, ns, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void
+mount_stats_call(enum mount_stats_op op, error_t err)
+{
+    if(!(STAT_GET(mount_probes) & MOUNT_PROBE_STATS))
+        return;
+
+    STAT_ADD(stats.calls[op], 1);
+    if(!err)
+        return;
+    STAT_ADD(stats.errors[op], 1);
+
+    /* Find ERR's slot, claiming a free one the first time it is seen. */
+    for(size_t i = 0; i < MOUNT_STATS_ERRNOS; i++)
+    {
+        int cur = STAT_GET(stats.errnos[i].err);
+
+        /* A failed exchange leaves the slot's new owner in CUR. */
+        if((cur == 0)
+           && __atomic_compare_exchange_n(&stats.errnos[i].err, &cur, err,
+                                          false, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED))
+            cur = err;
+        if(cur == err)
+        {
+            STAT_ADD(stats.errnos[i].count, 1);
+            return;
+        }
+    }
+    STAT_ADD(stats.errnos_other, 1);
+}
+
+/* Turn statistics collection on or off. */
+int
+mount_stats_enable(int enable)
+{
+    int old = enable
+        ? __atomic_fetch_or(&mount_probes, MOUNT_PROBE_STATS, __ATOMIC_RELAXED)
+        : __atomic_fetch_and(&mount_probes, ~MOUNT_PROBE_STATS,
+                             __ATOMIC_RELAXED);
+
+    return (old & MOUNT_PROBE_STATS) != 0;
+}
+
+/* Copy the statistics collected so far. */
+void
+mount_stats_get(struct mount_stats *out)
+{
+    for(int op = 0; op < MOUNT_STATS_OP_MAX; op++)
+    {
+        out->calls[op]  = STAT_GET(stats.calls[op]);
+        out->errors[op] = STAT_GET(stats.errors[op]);
+    }
+    for(size_t i = 0; i < MOUNT_STATS_ERRNOS; i++)
+    {
+        out->errnos[i].err   = STAT_GET(stats.errnos[i].err);
+        out->errnos[i].count = STAT_GET(stats.errnos[i].count);
+    }
+    out->errnos_other = STAT_GET(stats.errnos_other);
+    for(int p = 0; p < MOUNT_PHASE_MAX; p++)
+    {
+        struct mount_phase_stats *ps = &stats.phases[p];
+
+        out->phases[p].count    = STAT_GET(ps->count);
+        out->phases[p].total_ns = STAT_GET(ps->total_ns);
+        out->phases[p].max_ns   = STAT_GET(ps->max_ns);
+        for(size_t b = 0; b < MOUNT_STATS_BUCKETS; b++)
+            out->phases[p].hist[b] = STAT_GET(ps->hist[b]);
+    }
+}
+
+/* Clear the statistics. */
+void
+mount_stats_reset(void)
+{
+    for(int op = 0; op < MOUNT_STATS_OP_MAX; op++)
+    {
+        STAT_SET(stats.calls[op], 0);
+        STAT_SET(stats.errors[op], 0);
+    }
+    for(size_t i = 0; i < MOUNT_STATS_ERRNOS; i++)
+    {
+        STAT_SET(stats.errnos[i].count, 0);
+        STAT_SET(stats.errnos[i].err, 0);
+    }
+    STAT_SET(stats.errnos_other, 0);
+    for(int p = 0; p < MOUNT_PHASE_MAX; p++)
+    {
+        struct mount_phase_stats *ps = &stats.phases[p];
+
+        STAT_SET(ps->count, 0);
+        STAT_SET(ps->total_ns, 0);
+        STAT_SET(ps->max_ns, 0);
+        for(size_t b = 0; b < MOUNT_STATS_BUCKETS; b++)
+            STAT_SET(ps->hist[b], 0);
+    }
+}
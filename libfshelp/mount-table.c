@@ -0,0 +1,241 @@
+/* hurd/libfshelp/mount-table.c
+   Cached table of mounted filesystems for umount2(2).
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "mount-priv.h"
+
+/* Identity of a file of the table when it was last read.  If any of these
+   differ the file was rewritten by someone else and must be parsed
+   again. */
+struct mtab_stamp
+{
+    bool            present;
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    struct timespec mtime;
+};
+
+static pthread_mutex_t     mount_table_lock  = PTHREAD_MUTEX_INITIALIZER;
+static struct mount_table *mount_table      = NULL;
+/* Shared by every table we read; fstypes cannot be freed.  Only used
+   by fstab_read, with mount_table_lock held. */
+static struct fstypes     *mount_table_types = NULL;
+/* The files the table is read from: the system's, and the snapshot and
+   journal of mount_journal. */
+#define MOUNT_TABLE_FILES 3
+static const char *const   mount_table_files[MOUNT_TABLE_FILES] =
+    { _PATH_MOUNTED, _PATH_MOUNT_SNAPSHOT, _PATH_MOUNT_JOURNAL };
+static struct mtab_stamp   mount_table_stamp[MOUNT_TABLE_FILES];
+/* Set when the table must be re-read regardless of the stamp. */
+static bool                mount_table_stale = true;
+
+static void
+mtab_stamp_get(struct mtab_stamp *stamp)
+{
+    struct stat st;
+
+    memset(stamp, 0, sizeof(*stamp) * MOUNT_TABLE_FILES);
+    for(int i = 0; i < MOUNT_TABLE_FILES; i++)
+        if(stat(mount_table_files[i], &st) == 0)
+        {
+            stamp[i].present = true;
+            stamp[i].dev     = st.st_dev;
+            stamp[i].ino     = st.st_ino;
+            stamp[i].size    = st.st_size;
+            stamp[i].mtime   = st.st_mtim;
+        }
+}
+
+static bool
+mtab_stamp_equal(const struct mtab_stamp *a, const struct mtab_stamp *b)
+{
+    for(int i = 0; i < MOUNT_TABLE_FILES; i++, a++, b++)
+        if((a->present != b->present)
+           || (a->dev != b->dev)
+           || (a->ino != b->ino)
+           || (a->size != b->size)
+           || (a->mtime.tv_sec != b->mtime.tv_sec)
+           || (a->mtime.tv_nsec != b->mtime.tv_nsec))
+            return false;
+    return true;
+}
+
+/* Drop a reference to TABLE.  Called with mount_table_lock held. */
+static void
+mount_table_unref(struct mount_table *table)
+{
+    if(--table->refs)
+        return;
+    mount_index_free(table->index);
+    fstab_free(table->fstab);
+    free(table);
+}
+
+/* Read _PATH_MOUNTED and what mount_journal recorded into a new snapshot
+   and publish it.  Readers of the previous one keep it until they release
+   it.  Called with mount_table_lock held. */
+static error_t
+mount_table_reload(const struct mtab_stamp *stamp)
+{
+    error_t             err   = 0;
+    struct fstab       *fstab = NULL;
+    struct mount_table *table = NULL;
+
+    if(!mount_table_types)
+    {
+        err = fstypes_create(NULL, 0, &mount_table_types);
+        if(err)
+            return err;
+    }
+
+    err = fstab_create(mount_table_types, &fstab);
+    if(err)
+        return err;
+
+    /* A missing mtab just means nothing is mounted. */
+    err = fstab_read(fstab, _PATH_MOUNTED);
+    if(!err || (err == ENOENT))
+        err = mount_journal_load(fstab);
+    if(err)
+    {
+        fstab_free(fstab);
+        return err;
+    }
+
+    table = malloc(sizeof(*table));
+    if(!table)
+    {
+        fstab_free(fstab);
+        return ENOMEM;
+    }
+
+    err = mount_index_build(fstab, &table->index);
+    if(err)
+    {
+        free(table);
+        fstab_free(fstab);
+        return err;
+    }
+    table->fstab = fstab;
+    /* The reference held by mount_table itself. */
+    table->refs  = 1;
+
+    if(mount_table)
+        mount_table_unref(mount_table);
+    mount_table       = table;
+    memcpy(mount_table_stamp, stamp, sizeof(mount_table_stamp));
+    mount_table_stale = false;
+    return 0;
+}
+
+error_t
+mount_table_acquire(struct mount_table **table)
+{
+    error_t           err = 0;
+    struct mtab_stamp stamp[MOUNT_TABLE_FILES];
+
+    /* The stamp is taken before reading so that a change racing with the
+       read is seen again on the next call rather than lost. */
+    mtab_stamp_get(stamp);
+
+    pthread_mutex_lock(&mount_table_lock);
+    if(!mount_table || mount_table_stale
+       || !mtab_stamp_equal(stamp, mount_table_stamp))
+    {
+        err = mount_table_reload(stamp);
+        if(err)
+        {
+            pthread_mutex_unlock(&mount_table_lock);
+            return err;
+        }
+    }
+
+    mount_table->refs++;
+    *table = mount_table;
+    pthread_mutex_unlock(&mount_table_lock);
+    return 0;
+}
+
+void
+mount_table_release(struct mount_table *table)
+{
+    pthread_mutex_lock(&mount_table_lock);
+    mount_table_unref(table);
+    pthread_mutex_unlock(&mount_table_lock);
+}
+
+void
+mount_table_invalidate(void)
+{
+    pthread_mutex_lock(&mount_table_lock);
+    mount_table_stale = true;
+    pthread_mutex_unlock(&mount_table_lock);
+}
+
+void
+mount_table_changed(void)
+{
+    mount_journal_commit();
+    mount_table_invalidate();
+    mount_map_schedule();
+}
+
+/* Finds the mount point that contains a path. */
+int
+mount_point_of(const char *path, char **mountpoint)
+{
+    error_t             err   = 0;
+    struct mount_table *table = NULL;
+    struct fs          *fs    = NULL;
+    char               *abs   = NULL;
+    struct mount_arena  arena;
+
+    mount_arena_init(&arena);
+    if(!path || !mountpoint)
+    {
+        err = EINVAL;
+        goto end_mount_point_of;
+    }
+
+    err = mount_path_absolute(&arena, path, &abs);
+    if(err)
+        goto end_mount_point_of;
+
+    err = mount_table_acquire(&table);
+    if(err)
+        goto end_mount_point_of;
+
+    fs = mount_index_containing(table->index, abs);
+    if(!fs)
+        err = ENOENT;
+    else if(!(*mountpoint = strdup(fs->mntent.mnt_dir)))
+        err = ENOMEM;
+    mount_table_release(table);
+
+end_mount_point_of:
+    mount_arena_free(&arena);
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
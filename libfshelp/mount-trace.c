@@ -0,0 +1,168 @@
+/* hurd/libfshelp/mount-trace.c
+   Hooks called around the phases of mount(2) and umount(2).
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* Most sets of hooks registered at once. */
+#define MOUNT_TRACE_MAX 8
+
+struct mount_trace_slot
+{
+    struct mount_trace_hooks  hooks;
+    void                     *cookie;
+    bool                      used;
+};
+
+/* Held for reading while hooks are called, so that once
+   mount_trace_unregister returns its hooks are not running. */
+static pthread_rwlock_t        mount_trace_lock = PTHREAD_RWLOCK_INITIALIZER;
+static struct mount_trace_slot mount_trace_slots[MOUNT_TRACE_MAX];
+static size_t                  mount_trace_count = 0;
+
+static __thread void *mount_trace_context = NULL;
+
+/* Call the begin hooks of PHASE, or the end hooks if BEGIN is false. */
+static void
+mount_trace_call(enum mount_phase phase, bool begin, error_t err,
+                 unsigned long long ns)
+{
+    int saved = errno;
+
+    pthread_rwlock_rdlock(&mount_trace_lock);
+    for(size_t i = 0; i < MOUNT_TRACE_MAX; i++)
+    {
+        const struct mount_trace_slot *slot = &mount_trace_slots[i];
+
+        if(!slot->used)
+            continue;
+        if(begin && slot->hooks.begin)
+            slot->hooks.begin(phase, mount_trace_context, slot->cookie);
+        else if(!begin && slot->hooks.end)
+            slot->hooks.end(phase, err, ns, mount_trace_context,
+                            slot->cookie);
+    }
+    pthread_rwlock_unlock(&mount_trace_lock);
+    /* The hooks must not disturb what the phase left in errno. */
+    errno = saved;
+}
+
+uint64_t
+mount_probe_begin(enum mount_phase phase)
+{
+    if(__atomic_load_n(&mount_probes, __ATOMIC_RELAXED) & MOUNT_PROBE_TRACE)
+        mount_trace_call(phase, true, 0, 0);
+    return mount_stats_now();
+}
+
+void
+mount_probe_end(enum mount_phase phase, uint64_t start, error_t err)
+{
+    int probes = __atomic_load_n(&mount_probes, __ATOMIC_RELAXED);
+
+    if(probes & MOUNT_PROBE_STATS)
+        mount_stats_phase(phase, start);
+    if(probes & MOUNT_PROBE_TRACE)
+        mount_trace_call(phase, false, err, mount_stats_now() - start);
+}
+
+/* Registers hooks to be called around each phase. */
+int
+mount_trace_register(const struct mount_trace_hooks *hooks, void *cookie)
+{
+    error_t err = ENOSPC;
+
+    if(!hooks || (!hooks->begin && !hooks->end))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&mount_trace_lock);
+    for(size_t i = 0; i < MOUNT_TRACE_MAX; i++)
+        if(!mount_trace_slots[i].used)
+        {
+            mount_trace_slots[i].hooks  = *hooks;
+            mount_trace_slots[i].cookie = cookie;
+            mount_trace_slots[i].used   = true;
+            if(mount_trace_count++ == 0)
+                __atomic_fetch_or(&mount_probes, MOUNT_PROBE_TRACE,
+                                  __ATOMIC_RELAXED);
+            err = 0;
+            break;
+        }
+    pthread_rwlock_unlock(&mount_trace_lock);
+
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
+
+/* Removes hooks registered by mount_trace_register. */
+int
+mount_trace_unregister(const struct mount_trace_hooks *hooks, void *cookie)
+{
+    error_t err = ENOENT;
+
+    if(!hooks)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&mount_trace_lock);
+    for(size_t i = 0; i < MOUNT_TRACE_MAX; i++)
+    {
+        struct mount_trace_slot *slot = &mount_trace_slots[i];
+
+        if(slot->used && (slot->hooks.begin == hooks->begin)
+           && (slot->hooks.end == hooks->end) && (slot->cookie == cookie))
+        {
+            memset(slot, 0, sizeof(*slot));
+            if(--mount_trace_count == 0)
+                __atomic_fetch_and(&mount_probes, ~MOUNT_PROBE_TRACE,
+                                   __ATOMIC_RELAXED);
+            err = 0;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&mount_trace_lock);
+
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
+
+/* Sets the context passed to the hooks by this thread. */
+void *
+mount_trace_set_context(void *context)
+{
+    void *old = mount_trace_context;
+
+    mount_trace_context = context;
+    return old;
+}
+
+/* Returns the context passed to the hooks by this thread. */
+void *
+mount_trace_get_context(void)
+{
+    return mount_trace_context;
+}
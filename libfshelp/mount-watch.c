@@ -0,0 +1,370 @@
+/* hurd/libfshelp/mount-watch.c
+   Notifying watchers of the changes to the mount table.
+
+   Written by Ryan Jeffrey <ryan@ryanmj.xyz> (C) 2020.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <mntent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include "mount-priv.h"
+
+/* Events a watcher may fall behind by before it has to resync. */
+#define MOUNT_WATCH_QUEUE 256
+
+/* An event as queued, with its strings after it in the same block. */
+struct mount_watch_ev
+{
+    struct mount_event  ev;
+    struct mntent       mnt;
+};
+
+struct mount_watch
+{
+    pthread_mutex_t         lock;
+    int                     fds[2];     /* Readable while events wait. */
+    struct mount_watch_ev  *queue[MOUNT_WATCH_QUEUE];
+    size_t                  head;
+    size_t                  len;
+    bool                    overflow;
+    struct mount_watch_ev  *last;       /* Returned by the last read. */
+    struct mount_watch     *next;
+};
+
+static pthread_mutex_t     mount_watch_lock       = PTHREAD_MUTEX_INITIALIZER;
+static struct mount_watch *mount_watches          = NULL;
+/* Read locked by every mount_journal_append, so that mount_watch_open can
+   wait out those that found no watchers and post nothing. */
+static pthread_rwlock_t    mount_watch_gate       = PTHREAD_RWLOCK_INITIALIZER;
+/* Changed with mount_watch_lock held, so every watcher sees the same
+   order. */
+static unsigned long long  mount_watch_generation = 0;
+
+/* Return a copy of MNT, with EV set to TYPE and GENERATION, in one block
+   to be released with free. */
+static struct mount_watch_ev *
+mount_watch_ev_new(enum mount_event_type type, unsigned long long generation,
+                   const struct mntent *mnt)
+{
+    const char            *strs[4] =
+        { mnt->mnt_fsname ?: "", mnt->mnt_dir, mnt->mnt_type ?: "",
+          mnt->mnt_opts ?: "" };
+    size_t                 lens[4];
+    size_t                 total   = sizeof(struct mount_watch_ev);
+    struct mount_watch_ev *wev;
+    char                  *p;
+
+    for(int i = 0; i < 4; i++)
+        total += lens[i] = strlen(strs[i]) + 1;
+    wev = malloc(total);
+    if(!wev)
+        return NULL;
+
+    memset(wev, 0, sizeof(*wev));
+    p = (char *) (wev + 1);
+    wev->mnt.mnt_fsname = p;
+    p = mempcpy(p, strs[0], lens[0]);
+    wev->mnt.mnt_dir = p;
+    p = mempcpy(p, strs[1], lens[1]);
+    wev->mnt.mnt_type = p;
+    p = mempcpy(p, strs[2], lens[2]);
+    wev->mnt.mnt_opts = p;
+    memcpy(p, strs[3], lens[3]);
+
+    wev->ev.type       = type;
+    wev->ev.generation = generation;
+    wev->ev.mnt        = &wev->mnt;
+    return wev;
+}
+
+/* Make WATCH's descriptor readable.  Called with its lock held, when its
+   queue was empty. */
+static void
+mount_watch_wake(struct mount_watch *watch)
+{
+    char c = 0;
+
+    /* A full pipe is readable already, and that is all the byte is for. */
+    while((write(watch->fds[1], &c, 1) < 0) && (errno == EINTR))
+        ;
+}
+
+/* Make WATCH's descriptor unreadable again.  Called with its lock held. */
+static void
+mount_watch_drain(struct mount_watch *watch)
+{
+    char buf[16];
+
+    while(read(watch->fds[0], buf, sizeof(buf)) > 0)
+        ;
+}
+
+/* Drop what WATCH has queued.  Called with its lock held. */
+static void
+mount_watch_clear(struct mount_watch *watch)
+{
+    while(watch->len)
+    {
+        free(watch->queue[watch->head]);
+        watch->head = (watch->head + 1) % MOUNT_WATCH_QUEUE;
+        watch->len--;
+    }
+    watch->head = 0;
+}
+
+bool
+mount_watch_post_lock(void)
+{
+    pthread_rwlock_rdlock(&mount_watch_gate);
+    /* With no one to tell, appenders need not wait on each other or on a
+       resync; mount_watch_open drains them through the gate. */
+    if(!__atomic_load_n(&mount_watches, __ATOMIC_ACQUIRE))
+        return false;
+    pthread_mutex_lock(&mount_watch_lock);
+    return true;
+}
+
+void
+mount_watch_post_unlock(bool post)
+{
+    if(post)
+        pthread_mutex_unlock(&mount_watch_lock);
+    pthread_rwlock_unlock(&mount_watch_gate);
+}
+
+void
+mount_watch_post(enum mount_journal_op op, const struct mntent *mnt)
+{
+    enum mount_event_type type;
+
+    if(!mount_watches)
+        return;
+
+    switch(op)
+    {
+    case MOUNT_JOURNAL_ADD:
+        type = MOUNT_EVENT_ADD;
+        break;
+    case MOUNT_JOURNAL_REMOUNT:
+        type = MOUNT_EVENT_OPTIONS;
+        break;
+    case MOUNT_JOURNAL_DEL:
+    default:
+        type = MOUNT_EVENT_REMOVE;
+        break;
+    }
+
+    __atomic_store_n(&mount_watch_generation, mount_watch_generation + 1,
+                     __ATOMIC_RELAXED);
+    for(struct mount_watch *watch = mount_watches; watch; watch = watch->next)
+    {
+        struct mount_watch_ev *wev = NULL;
+
+        pthread_mutex_lock(&watch->lock);
+        if(!watch->overflow && (watch->len < MOUNT_WATCH_QUEUE))
+            wev = mount_watch_ev_new(type, mount_watch_generation, mnt);
+        if(wev)
+        {
+            watch->queue[(watch->head + watch->len) % MOUNT_WATCH_QUEUE] = wev;
+            if(watch->len++ == 0)
+                mount_watch_wake(watch);
+        }
+        else if(!watch->overflow)
+        {
+            /* What is queued no longer leads up to the table as it is, so
+               it only waits for the watcher to notice and resync. */
+            mount_watch_clear(watch);
+            watch->overflow = true;
+            mount_watch_wake(watch);
+        }
+        pthread_mutex_unlock(&watch->lock);
+    }
+}
+
+/* Starts watching the changes to the mount table. */
+struct mount_watch *
+mount_watch_open(void)
+{
+    struct mount_watch *watch = calloc(1, sizeof(*watch));
+
+    if(!watch)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if(pipe2(watch->fds, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+        free(watch);
+        return NULL;
+    }
+    pthread_mutex_init(&watch->lock, NULL);
+
+    pthread_mutex_lock(&mount_watch_lock);
+    watch->next = mount_watches;
+    __atomic_store_n(&mount_watches, watch, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&mount_watch_lock);
+
+    /* An append that found no watchers may still be between its record and
+       where its event would have gone.  Wait it out, so that a resync from
+       here on cannot miss its change in both the table and the events. */
+    pthread_rwlock_wrlock(&mount_watch_gate);
+    pthread_rwlock_unlock(&mount_watch_gate);
+    return watch;
+}
+
+/* Returns the descriptor to poll for WATCH's events. */
+int
+mount_watch_fd(struct mount_watch *watch)
+{
+    return watch->fds[0];
+}
+
+/* Takes the next event of WATCH. */
+int
+mount_watch_read(struct mount_watch *watch, struct mount_event *ev)
+{
+    error_t err = 0;
+
+    pthread_mutex_lock(&watch->lock);
+    free(watch->last);
+    watch->last = NULL;
+
+    if(watch->len)
+    {
+        watch->last = watch->queue[watch->head];
+        watch->head = (watch->head + 1) % MOUNT_WATCH_QUEUE;
+        watch->len--;
+        *ev = watch->last->ev;
+    }
+    else if(watch->overflow)
+    {
+        /* Reported until the watcher resyncs. */
+        memset(ev, 0, sizeof(*ev));
+        ev->type       = MOUNT_EVENT_OVERFLOW;
+        ev->generation = __atomic_load_n(&mount_watch_generation,
+                                         __ATOMIC_RELAXED);
+    }
+    else
+        err = EAGAIN;
+
+    if(!watch->len && !watch->overflow)
+        mount_watch_drain(watch);
+    pthread_mutex_unlock(&watch->lock);
+
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
+
+/* Starts WATCH over from the table as it is now. */
+int
+mount_watch_resync(struct mount_watch *watch, struct mntent **entries,
+                   size_t *n, unsigned long long *generation)
+{
+    error_t             err   = 0;
+    struct mount_table *table = NULL;
+    struct mntent      *ents  = NULL;
+    size_t              count = 0;
+    size_t              total = 0;
+
+    /* Holding mount_watch_lock keeps the table from changing between the
+       snapshot and the generation it is given: mount_journal_append holds
+       it from the record to the event.  A change is then either in the
+       snapshot, with its event posted before and dropped here, or made
+       after it and read as an event, never both. */
+    pthread_mutex_lock(&mount_watch_lock);
+    mount_table_invalidate();
+    err = mount_table_acquire(&table);
+    if(err)
+        goto end_resync;
+
+    for(struct fs *fs = table->fstab->entries; fs; fs = fs->next)
+    {
+        count++;
+        total += strlen(fs->mntent.mnt_fsname) + strlen(fs->mntent.mnt_dir)
+            + strlen(fs->mntent.mnt_type) + strlen(fs->mntent.mnt_opts ?: "")
+            + 4;
+    }
+
+    /* One block, so the caller can release it with a single free. */
+    ents = malloc(count * sizeof(*ents) + total + 1);
+    if(!ents)
+        err = ENOMEM;
+    else
+    {
+        char   *p = (char *) (ents + count);
+        size_t  i = 0;
+
+        for(struct fs *fs = table->fstab->entries; fs; fs = fs->next, i++)
+        {
+            memset(&ents[i], 0, sizeof(ents[i]));
+            ents[i].mnt_fsname = p;
+            p = stpcpy(p, fs->mntent.mnt_fsname) + 1;
+            ents[i].mnt_dir = p;
+            p = stpcpy(p, fs->mntent.mnt_dir) + 1;
+            ents[i].mnt_type = p;
+            p = stpcpy(p, fs->mntent.mnt_type) + 1;
+            ents[i].mnt_opts = p;
+            p = stpcpy(p, fs->mntent.mnt_opts ?: "") + 1;
+        }
+    }
+    mount_table_release(table);
+    if(err)
+        goto end_resync;
+
+    pthread_mutex_lock(&watch->lock);
+    mount_watch_clear(watch);
+    watch->overflow = false;
+    mount_watch_drain(watch);
+    pthread_mutex_unlock(&watch->lock);
+
+    *entries = ents;
+    *n       = count;
+    if(generation)
+        *generation = mount_watch_generation;
+
+end_resync:
+    pthread_mutex_unlock(&mount_watch_lock);
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
+
+/* Stops WATCH and releases it. */
+void
+mount_watch_close(struct mount_watch *watch)
+{
+    pthread_mutex_lock(&mount_watch_lock);
+    for(struct mount_watch **prev = &mount_watches; *prev;
+        prev = &(*prev)->next)
+        if(*prev == watch)
+        {
+            __atomic_store_n(prev, watch->next, __ATOMIC_RELEASE);
+            break;
+        }
+    pthread_mutex_unlock(&mount_watch_lock);
+
+    mount_watch_clear(watch);
+    free(watch->last);
+    close(watch->fds[0]);
+    close(watch->fds[1]);
+    pthread_mutex_destroy(&watch->lock);
+    free(watch);
+}
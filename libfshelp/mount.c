@@ -21,9 +21,8 @@
    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 
-#include <argp.h>
-#include <argz.h>
 #include "../sutils/fstab.h"
+#include "mount-priv.h"
 #include <errno.h>
 #include <error.h>
 #include <sys/mount.h>
@@ -36,173 +35,121 @@
 #include <mntent.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #define SEARCH_FMTS _HURD "%sfs\0" _HURD "%s"
 
-static error_t parse_opt(int key, char *arg, struct argp_state *state);
+/* Most threads tearing down one level of a tree in umount2_rec. */
+#define UMOUNT_REC_THREADS 8
 
-struct fstab_argp_params fstab_params;
+/* Most threads syncing or tearing down filesystems in umount_batch. */
+#define UMOUNT_BATCH_THREADS 32
 
-static const struct argp_option argp_opts[] =
+/* Return the flags of MOUNTFLAGS that are passed on to the translator as
+   options, with the defaults filled in. */
+static unsigned long
+mount_option_flags(unsigned long mountflags)
 {
-    {0, 0}
-};
-
-static const struct argp_child argp_kids[] =
-    { { &fstab_argp, 0,
-        "Filesystem selection (if no explicit filesystem arguments given):", 2 },
-      { 0 } };
-
-struct argp argp = { argp_opts, parse_opt, NULL, NULL, argp_kids };
-
+    unsigned long flags = 0;
 
-/* XXX fix libc */
-#undef _PATH_MOUNTED
-#define _PATH_MOUNTED "/etc/mtab"
-
-struct mnt_opt_map
-{
-    unsigned long intopt;
-    const char   *stropt;
-};
+    /* Default to relatime unless overriden */
+    if (!(mountflags & MS_NOATIME))
+        flags |= MS_RELATIME;
+    if(mountflags & MS_NOSUID)
+        flags |= MS_NOSUID;
+    if(mountflags & MS_NODEV)
+        flags |= MS_NODEV;
+    if(mountflags & MS_NOEXEC)
+        flags |= MS_NOEXEC;
+    if(mountflags & MS_NOATIME)
+        flags |= MS_NOATIME;
+    if(mountflags & MS_NODIRATIME)
+        flags |= MS_NODIRATIME;
+    if(mountflags & MS_STRICTATIME)
+        flags &= ~(MS_RELATIME | MS_NOATIME);
+    if(mountflags & MS_RDONLY)
+        flags |= MS_RDONLY;
+    return flags;
+}
 
-/* For converting mountflags into options for the filesystem driver.  */
-static const struct mnt_opt_map mnt_options_maps[] =
-{
-    { MS_RDONLY,        "ro" },
-    { MS_NOATIME,       "noatime" },
-    { MS_NODIRATIME,    "nodiratime" },
-    { MS_RELATIME,      "relatime" },
-    { MS_NOEXEC,        "noexec" },
-    { MS_NOSUID,        "nosuid" },
-    { MS_STRICTATIME,   "strictatime" },
-    { MS_SYNCHRONOUS,   "sync" },
-    { 0, NULL }
-};
-
-/* Add a string to an argv-like array of strings. */
+/* Return in ARGZ and ARGZ_LEN, allocated from ARENA, the command line of
+   the translator PROGRAM with the switches FSOPTS for DEVICE. */
 static error_t
-add_to_argv(char ***out_argv, size_t *out_argc, const char *str)
+mount_trans_argz(struct mount_arena *arena, const char *program,
+                 const char *fsopts, size_t fsopts_len, const char *device,
+                 char **argz, size_t *argz_len)
 {
-    char  **mnt_argv = *out_argv;
-    size_t  mnt_argc = *out_argc;
-
-    /* Fill argv[0] with "" to simulate program call in an actual argv. */
-    if(!out_argv || !mnt_argc)
-    {
-        mnt_argv = malloc(sizeof(char*));
-        if(!mnt_argv)
-            return ENOMEM;
-        mnt_argv[0] = malloc(sizeof(""));
-        if(!mnt_argv[0])
-            return ENOMEM;
-        strcpy(mnt_argv[0], "");
-        mnt_argc++;
-    }
-
-    mnt_argc++;
-    char **check = realloc(mnt_argv, mnt_argc * sizeof(char*));
-    if(!check)
-        return ENOMEM;
-    mnt_argv = check;
-    mnt_argv[mnt_argc - 1] = strdup(str);
-    if(!mnt_argv[mnt_argc - 1])
+    /* Stick the translator program name in front of the option switches
+       and the device name on the end as the last argument.  */
+    size_t prog_len = strlen(program) + 1;
+    size_t dev_len  = strlen(device) + 1;
+    char  *trans, *end;
+
+    trans = mount_arena_alloc(arena, prog_len + fsopts_len + dev_len);
+    if(!trans)
         return ENOMEM;
-
-    *out_argc = mnt_argc;
-    *out_argv = mnt_argv;
+    end = mempcpy(trans, program, prog_len);
+    end = mempcpy(end, fsopts, fsopts_len);
+    memcpy(end, device, dev_len);
+    *argz     = trans;
+    *argz_len = prog_len + fsopts_len + dev_len;
     return 0;
 }
-
-static error_t
-parse_opt(int key, char *arg, struct argp_state *state)
+
+error_t
+mount_start_translator(fshelp_open_fn_t open_fn, void *cookie,
+                       char *argz, size_t argz_len, fsys_t *control)
 {
-    struct fstab_argp_params *params = state->input;
-    switch(key)
-    {
-    case ARGP_KEY_INIT:
-        state->child_inputs[0] = params; /* Pass down fstab_argp parser. */
-        break;
-    }
-  return 0;
+    error_t     err;
+    mach_port_t ports[INIT_PORT_MAX];
+    mach_port_t fds[STDERR_FILENO + 1];
+    int ints[INIT_INT_MAX];
+    int i;
+
+    for(i = 0; i < INIT_PORT_MAX; i++)
+        ports[i] = MACH_PORT_NULL;
+    for(i = 0; i < STDERR_FILENO + 1; i++)
+        fds[i] = MACH_PORT_NULL;
+    memset(ints, 0, INIT_INT_MAX * sizeof(int));
+
+    ports[INIT_PORT_CWDIR] = getcwdir();
+    ports[INIT_PORT_CRDIR] = getcrdir();
+    ports[INIT_PORT_AUTH] = getauth();
+
+    err = fshelp_start_translator_long(open_fn, cookie,
+                                       argz, argz, argz_len,
+                                       fds, MACH_MSG_TYPE_COPY_SEND,
+                                       STDERR_FILENO + 1,
+                                       ports, MACH_MSG_TYPE_COPY_SEND,
+                                       INIT_PORT_MAX,
+                                       ints, INIT_INT_MAX,
+                                       geteuid(),
+                                       0, control);
+
+    for(i = 0; i < INIT_PORT_MAX; i++)
+        mach_port_deallocate(mach_task_self(), ports[i]);
+    for(i = 0; i <= STDERR_FILENO; i++)
+        mach_port_deallocate(mach_task_self(), fds[i]);
+    return err;
 }
-
+
 /* Perform the mount. */
 static error_t
-do_mount(struct fs *fs, bool remount, char *options,
-         size_t options_len, const char *fstype)
+do_mount(struct mount_arena *arena, struct fs *fs,
+         const struct mount_opts *opts)
 {
     error_t   err        = 0;
-    char     *fsopts     = NULL;
-    size_t    fsopts_len = 0;
-    fsys_t    mounted;
-
-    /* Check if we can determine if the filesystem is mounted. */
-    /* TODO this sets errno to EPERM? with strerror giving
-       "Operation not permitted", and if root sets it to 1073741830.
-       mount(8) has the same bug. mounted is always set to MACH_PORT_NULL. */
-    err = fs_fsys(fs, &mounted);
-    if(err)
-        goto end_domount;
+    char     *fsopts     = opts->argz;
+    size_t    fsopts_len = opts->argz_len;
+    uint64_t  start;
 
-#define ARGZ(call)              \
-    err = argz_##call;          \
-    if(err)                     \
-        goto end_domount;
-
-    /* Convert the list of options into a list of switch arguments.  */
-    for(char *tmp = options; tmp; tmp = argz_next(options, options_len, tmp))
+    if(opts->remount)
     {
-        if(*tmp == '-') /* Allow letter opts `-o -r,-E', BSD style.  */
-        {
-            ARGZ(add(&fsopts, &fsopts_len, tmp));
-        }
-        /*  Prepend `--' to the option to make a long option switch,
-            e.g. `--ro' or `--rsize=1024'.  */
-        else if((strcmp(tmp, "defaults") != 0) && (strlen(tmp) != 0)
-                && (strcmp(tmp, "loop") != 0) && (strcmp(tmp, "exec") != 0))
-
-        {
-            size_t tmparg_len = strlen(tmp) + 3;
-            char *tmparg = malloc(tmparg_len);
-            if(!tmparg)
-            {
-                err = ENOMEM;
-                goto end_domount;
-            }
-            tmparg[tmparg_len - 1] = '\0';
-
-            tmparg[0] = tmparg[1] = '-';
-            memcpy(&tmparg[2], tmp, tmparg_len - 2);
-            ARGZ(add(&fsopts, &fsopts_len, tmparg));
-            free(tmparg);
-        }
-    }
-
-    if(fs->mntent.mnt_opts)
-    {
-        ARGZ(add_sep(&options, &options_len, fs->mntent.mnt_opts, ','));
-    }
-
-    if(remount && fsopts)
-    {
-        /* TODO remounting does not work, errorstr returns
-           'operation not supported' on errno when performed on
-           `fs' file_t, `mounted' is always MACH_PORT_NULL. */
-        if(mounted == MACH_PORT_NULL)
-        {
-            err = EBUSY;
-            goto end_domount;
-        }
-
-
-        /* Check if the user is just changing the read-write settings. */
-        if(strcmp(fsopts, "--rw") == 0)
-            err = fs_set_readonly(fs, FALSE);
-        else if(strcmp(fsopts, "--ro") == 0)
-            err = fs_set_readonly(fs, TRUE);
-        else
-            err = fsys_set_options(mounted, fsopts, fsopts_len, 0);
+        /* The running translator is asked to change its options, rather
+           than being replaced by a new one. */
+        start = mount_stats_begin(MOUNT_PHASE_REMOUNT);
+        err = mount_remount(arena, fs, opts);
+        mount_stats_end(MOUNT_PHASE_REMOUNT, start, err);
     }
     else
     {
@@ -211,8 +158,11 @@ do_mount(struct fs *fs, bool remount, char *options,
         error_t open_err = 0;
         /* The control port for any active translator we start up.  */
         fsys_t active_control;
-        file_t node;
-        struct fstype *type = NULL;
+        /* Set if a pooled translator must be fitted to the mount point. */
+        bool fit = false;
+        file_t node = MACH_PORT_NULL;
+        char *program = NULL;
+        char *device = fs->mntent.mnt_fsname;
 
         /* The callback to start_translator opens NODE as a side effect.  */
         error_t open_node(int flags,
@@ -220,13 +170,15 @@ do_mount(struct fs *fs, bool remount, char *options,
                           mach_msg_type_name_t *underlying_type,
                           task_t task, void *cookie)
         {
+            uint64_t open_start = mount_stats_begin(MOUNT_PHASE_OPEN);
+
             node = file_name_lookup (fs->mntent.mnt_dir,
                                      flags | O_NOTRANS, 0666);
             if (node == MACH_PORT_NULL)
-            {
                 open_err = errno;
+            mount_stats_end(MOUNT_PHASE_OPEN, open_start, open_err);
+            if (open_err)
                 return open_err;
-            }
 
             *underlying = node;
             *underlying_type = MACH_MSG_TYPE_COPY_SEND;
@@ -234,98 +186,106 @@ do_mount(struct fs *fs, bool remount, char *options,
             return 0;
         }
 
-        if(mounted != MACH_PORT_NULL)
-        {
-            err = EBUSY;
+        start = mount_stats_begin(MOUNT_PHASE_FSTYPE);
+        err = mount_fstype_program(arena, fs, &program);
+        mount_stats_end(MOUNT_PHASE_FSTYPE, start, err);
+        if(err)
             goto end_domount;
-        }
 
-        fs->mntent.mnt_type = strdup(fstype);
-        if(!fs->mntent.mnt_type)
+        if(opts->loop)
         {
-            err = ENOMEM;
-            goto end_domount;
+            err = mount_loop_device(arena, device, opts, &fsopts,
+                                    &fsopts_len, &device);
+            if(err)
+                goto end_domount;
         }
 
-        err = fs_type(fs, &type);
+        err = mount_trans_argz(arena, program, fsopts, fsopts_len, device,
+                               &fsopts, &fsopts_len);
         if(err)
             goto end_domount;
-        if(type->program == NULL)
+
+        if(opts->noauto)
         {
-            err = EFTYPE;
+            /* Nothing is started now; the first lookup through the mount
+               point starts it. */
+            start = mount_stats_begin(MOUNT_PHASE_ATTACH);
+            err = mount_lazy(fs->mntent.mnt_dir, fsopts, fsopts_len,
+                             opts->idle_timeout);
+            mount_stats_end(MOUNT_PHASE_ATTACH, start, err);
             goto end_domount;
         }
 
-
-        /* Stick the translator program name in front of the option
-           switches.  */
-        ARGZ(insert(&fsopts, &fsopts_len, fsopts, type->program));
-        /* Now stick the device name on the end as the last argument.  */
-        ARGZ(add(&fsopts, &fsopts_len, fs->mntent.mnt_fsname));
-
-#undef ARGZ
-
+        active_control = mount_pool_take(fsopts, fsopts_len, &fit);
+        if(active_control != MACH_PORT_NULL)
         {
-            mach_port_t ports[INIT_PORT_MAX];
-            mach_port_t fds[STDERR_FILENO + 1];
-            int ints[INIT_INT_MAX];
-            int i;
-
-            for(i = 0; i < INIT_PORT_MAX; i++)
-                ports[i] = MACH_PORT_NULL;
-            for(i = 0; i < STDERR_FILENO + 1; i++)
-                fds[i] = MACH_PORT_NULL;
-            memset(ints, 0, INIT_INT_MAX * sizeof(int));
-
-            ports[INIT_PORT_CWDIR] = getcwdir();
-            ports[INIT_PORT_CRDIR] = getcrdir();
-            ports[INIT_PORT_AUTH] = getauth();
-
-            err = fshelp_start_translator_long(open_node, NULL,
-                                               fsopts, fsopts, fsopts_len,
-                                               fds, MACH_MSG_TYPE_COPY_SEND,
-                                               STDERR_FILENO + 1,
-                                               ports, MACH_MSG_TYPE_COPY_SEND,
-                                               INIT_PORT_MAX,
-                                               ints, INIT_INT_MAX,
-                                               geteuid(),
-                                               0, &active_control);
-
-            for(i = 0; i < INIT_PORT_MAX; i++)
-                mach_port_deallocate(mach_task_self(), ports[i]);
-            for(i = 0; i <= STDERR_FILENO; i++)
-                mach_port_deallocate(mach_task_self(), fds[i]);
+            /* Started ahead of time; only the node it goes on is left to
+               find. */
+            start = mount_stats_begin(MOUNT_PHASE_OPEN);
+            node = file_name_lookup(fs->mntent.mnt_dir, O_NOTRANS, 0666);
+            if(node == MACH_PORT_NULL)
+                err = errno;
+            mount_stats_end(MOUNT_PHASE_OPEN, start, err);
+            if(err || (fit && mount_pool_fit(active_control, node)))
+            {
+                fsys_goaway(active_control, FSYS_GOAWAY_FORCE);
+                mach_port_deallocate(mach_task_self(), active_control);
+                active_control = MACH_PORT_NULL;
+            }
+            if(!err && (active_control == MACH_PORT_NULL))
+            {
+                /* Its root cannot be made to look like one started on
+                   the mount point; start one there instead. */
+                mach_port_deallocate(mach_task_self(), node);
+                node = MACH_PORT_NULL;
+            }
+        }
+        if(!err && (active_control == MACH_PORT_NULL))
+        {
+            start = mount_stats_begin(MOUNT_PHASE_START);
+            err = mount_start_translator(open_node, NULL, fsopts, fsopts_len,
+                                         &active_control);
+            mount_stats_end(MOUNT_PHASE_START, start, err);
         }
 
         if(open_err)
-        {
             err = open_err;
-            goto end_domount;
-        }
-        else if(err)
-            goto end_domount;
-        else
+        if(!err)
         {
+            start = mount_stats_begin(MOUNT_PHASE_ATTACH);
             err = file_set_translator(node, 0, FS_TRANS_SET | FS_TRANS_EXCL, 0,
                                       0, 0, active_control,
                                       MACH_MSG_TYPE_COPY_SEND);
+            mount_stats_end(MOUNT_PHASE_ATTACH, start, err);
             if(err)
+            {
                 fsys_goaway(active_control, FSYS_GOAWAY_FORCE);
-            mach_port_deallocate(mach_task_self(), active_control);
+                mach_port_deallocate(mach_task_self(), active_control);
+            }
+            else
+            {
+                /* Keep both ports for remounting and unmounting it
+                   later. */
+                mount_control_add(fs->mntent.mnt_dir, active_control, node);
+                node = MACH_PORT_NULL;
+            }
         }
+
+        if(node != MACH_PORT_NULL)
+            mach_port_deallocate(mach_task_self(), node);
     }
 
 end_domount:
-    if(fsopts)
-        free(fsopts);
     return err;
 }
 
-/* Mounts a filesystem. */
-int
-mount(const char *source, const char *target,
-      const char *filesystemtype, unsigned long mountflags,
-      const void *data)
+/* Mount one filesystem, adding its entry to FSTAB.  Everything that can be
+   shared between several mounts, such as the filesystem types already
+   resolved, is kept in FSTAB. */
+static error_t
+mount_entry(struct fstab *fstab, const char *source, const char *target,
+            const char *filesystemtype, unsigned long mountflags,
+            const void *data)
 {
     /* Remount and firmlink are special because they are options for us and
        not the filesystem driver. */
@@ -339,42 +299,39 @@ mount(const char *source, const char *target,
     char                    *device      = NULL;
     char                    *mountpoint  = NULL;
     char                    *fstype      = NULL;
-    /* TODO assumes data is a string. */
-    const char              *datastr     = (data) ? data : "";
-    char                    *mnt_ops     = NULL;
-    size_t                   mnt_ops_len = 0;
-    /* For argp. */
-    struct fstab            *fstab       = NULL;
+    struct mount_opts        opts        = { 0 };
+    /* Everything allocated for this call. */
+    struct mount_arena       arena;
+    uint64_t                 start;
 
+    mount_arena_init(&arena);
+
+    /* Flags may also be given in a struct mount_data. */
+    mountflags |= mount_data_flags(data);
+
+    if(mountflags & MS_MOVE)
+    {
+        err = mount_move(&arena, source, target);
+        goto end_mount;
+    }
 
-    /* Default to relatime unless overriden */
-    if (!(mountflags & MS_NOATIME))
-        flags |= MS_RELATIME;
     /* Separate the per-mountpoint flags. */
     if(mountflags & MS_BIND)
         firmlink = true;
     if(mountflags & MS_REMOUNT)
         remount = true;
-    if(mountflags & MS_NOSUID)
-        flags |= MS_NOSUID;
-    if(mountflags & MS_NODEV)
-        flags |= MS_NODEV;
-    if(mountflags & MS_NOEXEC)
-        flags |= MS_NOEXEC;
-    if(mountflags & MS_NOATIME)
-        flags |= MS_NOATIME;
-    if(mountflags & MS_NODIRATIME)
-        flags |= MS_NODIRATIME;
-    if(mountflags & MS_STRICTATIME)
-        flags &= ~(MS_RELATIME | MS_NOATIME);
-    if(mountflags & MS_RDONLY)
-        flags |= MS_RDONLY;
+    flags = mount_option_flags(mountflags);
 
-    /* Check for mount options in data. */
-    if(strstr(datastr, "remount"))
+    start = mount_stats_begin(MOUNT_PHASE_OPTIONS);
+    err = mount_opts_compile(&arena, data, flags, &opts);
+    mount_stats_end(MOUNT_PHASE_OPTIONS, start, err);
+    if(err)
+        goto end_mount;
+    if(opts.remount)
         remount = true;
-    if(strstr(datastr, "bind"))
+    if(opts.bind)
         firmlink = true;
+    opts.remount = remount;
 
     if(!filesystemtype || (filesystemtype[0] == '\0'))
     {
@@ -385,7 +342,7 @@ mount(const char *source, const char *target,
             goto end_mount;
         }
 
-        fstype = strdup("auto");
+        fstype = mount_arena_strdup(&arena, "auto");
         if(!fstype)
         {
             err = ENOMEM;
@@ -395,7 +352,7 @@ mount(const char *source, const char *target,
     }
     else
     {
-        fstype = strdup(filesystemtype);
+        fstype = mount_arena_strdup(&arena, filesystemtype);
         if(!fstype)
         {
             err = ENOMEM;
@@ -410,14 +367,9 @@ mount(const char *source, const char *target,
     }
     else
     {
-        mountpoint = strdup(target);
-        if(!mountpoint)
-        {
-            err = ENOMEM;
-            if(fstype)
-                free(fstype);
+        err = mount_path_absolute(&arena, target, &mountpoint);
+        if(err)
             goto end_mount;
-        }
     }
 
     if(!source || (source[0] == '\0'))
@@ -432,87 +384,14 @@ mount(const char *source, const char *target,
     }
     else
     {
-        device = strdup(source);
+        device = mount_arena_strdup(&arena, source);
         if(!device)
         {
             err = ENOMEM;
-            if(fstype)
-                free(fstype);
-            free(mountpoint);
             goto end_mount;
         }
     }
 
-    {
-        char        *data_ops     = NULL;
-        size_t       data_ops_len = 0;
-        char       **mnt_argv     = NULL;
-        size_t       mnt_argc     = 0;
-
-        if(device)
-        {
-            err = add_to_argv(&mnt_argv, &mnt_argc, device);
-            if(err)
-                goto end_mount;
-        }
-        err = add_to_argv(&mnt_argv, &mnt_argc, mountpoint);
-        if(err)
-            goto end_mount;
-#define ARGZ(call)              \
-    err = argz_##call;          \
-    if(err)                     \
-        goto end_mount;
-
-
-        /* TODO this assumes that data is a string, which might not be
-           correct. */
-        ARGZ(create_sep(datastr, ',', &data_ops, &data_ops_len));
-
-        {
-            /* Remove `bind', `noauto', and `remount' options. */
-            /* Create mnt_argv array for argp.                 */
-            for(char *curstr = data_ops; curstr;
-                curstr = argz_next(data_ops, data_ops_len, curstr))
-            {
-                if((strcmp(curstr, MNTOPT_NOAUTO) != 0)
-                   && (strcmp(curstr, "bind") != 0)
-                   && (strcmp(curstr, "remount") != 0))
-                {
-                    ARGZ(add(&mnt_ops, &mnt_ops_len, curstr));
-                }
-            }
-
-        }
-        /* Add OR'd flags to option string. */
-        for(size_t i = 0;
-            mnt_options_maps[i].stropt != NULL;
-            i++)
-        {
-            if(flags & mnt_options_maps[i].intopt)
-            {
-                ARGZ(add(&mnt_ops, &mnt_ops_len, mnt_options_maps[i].stropt));
-            }
-        }
-
-#undef ARGZ
-
-        argp_parse(&argp, mnt_argc, mnt_argv, 0, 0, &fstab_params);
-
-        for(size_t i = 0; i < mnt_argc; i++)
-        {
-            free(mnt_argv[i]);
-        }
-        free(mnt_argv);
-    }
-
-    fstab = fstab_argp_create(&fstab_params, SEARCH_FMTS,
-                              sizeof(SEARCH_FMTS));
-    if(!fstab)
-    {
-        err = EINVAL;
-        goto end_mount;
-    }
-
     struct mntent m =
     {
         mnt_fsname: (device) ? device : mountpoint, /* Since we cannot
@@ -527,62 +406,230 @@ mount(const char *source, const char *target,
         mnt_passno: 0
     };
     if(firmlink)
-    {
-        m.mnt_type = strdup("firmlink");
-        if(!m.mnt_type)
-        {
-            err = ENOMEM;
-            goto end_mount;
-        }
-    }
+        m.mnt_type = (char *) "firmlink";
 
     err = fstab_add_mntent(fstab, &m, &fs);
     if(err)
         goto end_mount;
 
 
+    mount_point_lock(mountpoint);
     if(fs)
-        err = do_mount(fs, remount, mnt_ops, mnt_ops_len, fstype);
+        err = do_mount(&arena, fs, &opts);
+    if(!err && (mount_opts_text(&arena, data, &m.mnt_opts) == 0))
+        mount_journal_append(remount ? MOUNT_JOURNAL_REMOUNT
+                             : MOUNT_JOURNAL_ADD, &m);
+    mount_point_unlock(mountpoint);
 
 end_mount:
-    if(device)
-        free(device);
-    if(mountpoint)
-        free(mountpoint);
-    if(fstype)
-        free(fstype);
+    mount_arena_free(&arena);
+    mount_stats_call(MOUNT_STATS_MOUNT, err);
+    return err;
+}
+
+/* Create an empty fstab that resolves filesystem types through
+   SEARCH_FMTS, for mount_entry to add its entries to. */
+static error_t
+mount_fstab_create(struct fstab **fstab)
+{
+    error_t         err   = 0;
+    struct fstypes *types = NULL;
+
+    err = fstypes_create(SEARCH_FMTS, sizeof(SEARCH_FMTS), &types);
+    if(err)
+        return err;
 
+    return fstab_create(types, fstab);
+}
+
+/* Free FSTAB along with the fstypes created for it by mount_fstab_create.
+   sutils has no fstypes_free. */
+static void
+mount_fstab_free(struct fstab *fstab)
+{
+    struct fstypes *types = fstab->types;
+
+    fstab_free(fstab);
+    while(types->entries)
+    {
+        struct fstype *type = types->entries;
+        types->entries = type->next;
+        free(type->name);
+        free(type->program);
+        free(type);
+    }
+    free(types->program_search_fmts);
+    free(types);
+}
+
+error_t
+mount_pool_argz(struct mount_arena *arena, const char *source,
+                const char *filesystemtype, unsigned long mountflags,
+                const void *data, char **argz, size_t *argz_len,
+                unsigned long *flags)
+{
+    error_t            err   = 0;
+    struct fstab      *fstab = NULL;
+    struct fs         *fs    = NULL;
+    char              *program;
+    char              *device = (char *) source;
+    struct mount_opts  opts;
+    struct mntent      m     = { 0 };
+
+    mountflags |= mount_data_flags(data);
+    err = mount_opts_compile(arena, data, mount_option_flags(mountflags),
+                             &opts);
+    if(err)
+        return err;
+    *flags = opts.flags;
+
+    err = mount_fstab_create(&fstab);
+    if(err)
+        return err;
+    m.mnt_fsname = (char *) source;
+    m.mnt_dir    = (char *) "/";
+    m.mnt_type   = (char *) filesystemtype;
+    m.mnt_opts   = (char *) "";
+    err = fstab_add_mntent(fstab, &m, &fs);
+    if(!err)
+        err = mount_fstype_program(arena, fs, &program);
+    if(!err && opts.loop)
+        err = mount_loop_device(arena, source, &opts, &opts.argz,
+                                &opts.argz_len, &device);
+    if(!err)
+        err = mount_trans_argz(arena, program, opts.argz, opts.argz_len,
+                               device, argz, argz_len);
+    mount_fstab_free(fstab);
+    return err;
+}
+
+/* Mounts a filesystem. */
+int
+mount(const char *source, const char *target,
+      const char *filesystemtype, unsigned long mountflags,
+      const void *data)
+{
+    error_t        err   = 0;
+    struct fstab  *fstab = NULL;
+    uint64_t       start = mount_stats_begin(MOUNT_PHASE_FSTAB);
+
+    err = mount_fstab_create(&fstab);
+    mount_stats_end(MOUNT_PHASE_FSTAB, start, err);
+    if(err)
+    {
+        mount_stats_call(MOUNT_STATS_MOUNT, err);
+        goto end_mount;
+    }
+
+    err = mount_entry(fstab, source, target, filesystemtype, mountflags,
+                      data);
+    if(!err)
+        mount_table_changed();
+
+end_mount:
+    if(fstab)
+        mount_fstab_free(fstab);
     if(err) errno = err;
     return err ? -1 : 0;
 }
-
+
+/* Mounts N filesystems. */
+int
+mountv(const struct mount_req *reqs, size_t n, int *results)
+{
+    error_t        err      = 0;
+    error_t        first    = 0;
+    bool           mounted  = false;
+    struct fstab  *fstab    = NULL;
+    uint64_t       start;
+
+    if(!reqs && n)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* One fstab for the whole batch, so each filesystem type is only
+       searched for once. */
+    start = mount_stats_begin(MOUNT_PHASE_FSTAB);
+    err = mount_fstab_create(&fstab);
+    mount_stats_end(MOUNT_PHASE_FSTAB, start, err);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        error_t res = err;
+
+        if(!res)
+            res = mount_entry(fstab, reqs[i].source, reqs[i].target,
+                              reqs[i].filesystemtype, reqs[i].mountflags,
+                              reqs[i].data);
+        else
+            mount_stats_call(MOUNT_STATS_MOUNT, res);
+        if(!res)
+            mounted = true;
+        else if(!first)
+            first = res;
+        if(results)
+            results[i] = res;
+    }
+
+    if(mounted)
+        mount_table_changed();
+    if(fstab)
+        mount_fstab_free(fstab);
+
+    if(first) errno = first;
+    return first ? -1 : 0;
+}
+
 /* Perform the unmount. */
 static error_t
-do_umount(struct fs *fs, int goaway_flags)
+do_umount(const struct mntent *mntent, int goaway_flags)
 {
+    error_t  err   = 0;
+    uint64_t start;
+    file_t   node  = MACH_PORT_NULL;
+
+    mount_point_lock(mntent->mnt_dir);
 
-    error_t err  = 0;
-    file_t  node = file_name_lookup(fs->mntent.mnt_dir, O_NOTRANS, 0666);
-    if(node == MACH_PORT_NULL)
+    if(goaway_flags & MNT_DETACH)
     {
-        goto end_doumount;
+        start = mount_stats_begin(MOUNT_PHASE_GOAWAY);
+        err = mount_detach(mntent, goaway_flags & ~MNT_DETACH);
+        mount_stats_end(MOUNT_PHASE_GOAWAY, start, err);
+        if(!err)
+        {
+            mount_control_forget(mntent->mnt_dir);
+            mount_lazy_forget(mntent->mnt_dir);
+            mount_journal_append(MOUNT_JOURNAL_DEL, mntent);
+        }
+        mount_point_unlock(mntent->mnt_dir);
+        return err;
     }
 
-    err = file_set_translator(node, 0, FS_TRANS_SET, goaway_flags, NULL,
-                              0, MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
+    err = mount_control_get(mntent->mnt_dir, NULL, &node);
+    if(err)
+        goto end_doumount;
+
+    start = mount_stats_begin(MOUNT_PHASE_GOAWAY);
+    err = file_set_translator(node, mount_lazy_passive_flags(mntent),
+                              FS_TRANS_SET, goaway_flags, NULL, 0,
+                              MACH_PORT_NULL, MACH_MSG_TYPE_COPY_SEND);
+    mount_stats_end(MOUNT_PHASE_GOAWAY, start, err);
 
-    if(!err && ((fs->mntent.mnt_fsname[0] != '\0')
-                && (strcmp(fs->mntent.mnt_fsname, "none") != 0)))
+    if(!err && ((mntent->mnt_fsname[0] != '\0')
+                && (strcmp(mntent->mnt_fsname, "none") != 0)))
     {
-        file_t source = file_name_lookup(fs->mntent.mnt_fsname, O_NOTRANS,
+        file_t source = file_name_lookup(mntent->mnt_fsname, O_NOTRANS,
                                          0666);
         if(source == MACH_PORT_NULL)
             goto end_doumount;
 
+        start = mount_stats_begin(MOUNT_PHASE_GOAWAY_SOURCE);
         err = file_set_translator(source, 0, FS_TRANS_SET, goaway_flags,
                                   NULL, 0, MACH_PORT_NULL,
                                   MACH_MSG_TYPE_COPY_SEND);
-
+        mount_stats_end(MOUNT_PHASE_GOAWAY_SOURCE, start, err);
 
         mach_port_deallocate(mach_task_self(), source);
 
@@ -594,26 +641,42 @@ do_umount(struct fs *fs, int goaway_flags)
     }
 
 end_doumount:
+    if(!err)
+    {
+        mount_control_forget(mntent->mnt_dir);
+        mount_lazy_forget(mntent->mnt_dir);
+        mount_journal_append(MOUNT_JOURNAL_DEL, mntent);
+    }
+    mount_point_unlock(mntent->mnt_dir);
     mach_port_deallocate(mach_task_self(), node);
     return err;
 }
-
+
 /* Unmounts a filesystem. */
 int
 umount(const char *target)
 {
     return umount2(target, 0);
 }
-
+
 /* Unmounts a filesystem with options. */
 int
 umount2(const char *target, int flags)
 {
     error_t        err             = 0;
     struct fs     *fs              = NULL;
-    struct fstab  *fstab           = NULL;
+    struct mount_table *table      = NULL;
+    /* Private copy of the entry, so the table can be released while the
+       translator goes away. */
+    struct mntent  mnt             = { 0 };
+    char          *dir             = NULL;
+    struct mount_arena arena;
+    uint64_t       start;
 
-    memset(&fstab_params, 0, sizeof(fstab_params));
+    mount_arena_init(&arena);
+
+    if(flags & MS_REC)
+        return umount2_rec(target, flags & ~MS_REC, NULL, NULL);
 
     if(!target || (target[0] == '\0'))
     {
@@ -621,43 +684,569 @@ umount2(const char *target, int flags)
         goto end_umount;
     }
 
+    err = mount_path_absolute(&arena, target, &dir);
+    if(err)
+        goto end_umount;
+
+    start = mount_stats_begin(MOUNT_PHASE_FSTAB);
+    err = mount_table_acquire(&table);
+    mount_stats_end(MOUNT_PHASE_FSTAB, start, err);
+    if(err)
+        goto end_umount;
+
+    fs = mount_index_find_mount(table->index, dir);
+    if(!fs)
+        err = EINVAL;
+    else
     {
-        char **mnt_argv = NULL;
-        size_t mnt_argc = 0;
+        mnt.mnt_dir    = mount_arena_strdup(&arena, fs->mntent.mnt_dir);
+        mnt.mnt_fsname = mount_arena_strdup(&arena, fs->mntent.mnt_fsname);
+        mnt.mnt_opts   = mount_arena_strdup(&arena,
+                                            fs->mntent.mnt_opts ?: "");
+        if(!mnt.mnt_dir || !mnt.mnt_fsname || !mnt.mnt_opts)
+            err = ENOMEM;
+    }
+    mount_table_release(table);
+    if(err)
+        goto end_umount;
 
-        err = add_to_argv(&mnt_argv, &mnt_argc, target);
-        if(err)
-            goto end_umount;
+    err = do_umount(&mnt, flags);
+    if(!err)
+        mount_table_changed();
+end_umount:
+    mount_arena_free(&arena);
+    mount_stats_call(MOUNT_STATS_UMOUNT, err);
+    if(err) errno = err;
+    return err ? -1 : 0;
+}
 
-        err = argp_parse(&argp, mnt_argc, mnt_argv, 0, 0, &fstab_params);
-        if(err)
-            goto end_umount;
+/* Look TARGETS up in one snapshot of the mount table and copy their
+   entries to MNTS from ARENA.  ERRS[I] is set for every target that is not
+   mounted, including one that names the same filesystem as an earlier
+   target, which is gone by the time it is reached. */
+static error_t
+umount_lookup(struct mount_arena *arena, const char *const *targets,
+              size_t n, struct mntent *mnts, error_t *errs)
+{
+    error_t             err   = 0;
+    struct mount_table *table = NULL;
+    struct fs         **found = NULL;
+    uint64_t            start;
 
-        for(size_t i = 0; i < mnt_argc; i++)
+    found = mount_arena_alloc(arena, n * sizeof(*found));
+    if(!found && n)
+        return ENOMEM;
+
+    start = mount_stats_begin(MOUNT_PHASE_FSTAB);
+    err = mount_table_acquire(&table);
+    mount_stats_end(MOUNT_PHASE_FSTAB, start, err);
+    if(err)
+        return err;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        struct fs *fs  = NULL;
+        char      *dir = NULL;
+
+        found[i] = NULL;
+
+        if(!targets[i] || (targets[i][0] == '\0'))
         {
-            free(mnt_argv[i]);
+            errs[i] = EINVAL;
+            continue;
         }
-        free(mnt_argv);
+
+        errs[i] = mount_path_absolute(arena, targets[i], &dir);
+        if(errs[i])
+            continue;
+
+        fs = mount_index_find_mount(table->index, dir);
+        for(size_t j = 0; fs && (j < i); j++)
+            if(found[j] == fs)
+                fs = NULL;
+        if(!fs)
+        {
+            errs[i] = EINVAL;
+            continue;
+        }
+        found[i] = fs;
+
+        mnts[i].mnt_dir    = mount_arena_strdup(arena, fs->mntent.mnt_dir);
+        mnts[i].mnt_fsname = mount_arena_strdup(arena,
+                                                fs->mntent.mnt_fsname);
+        mnts[i].mnt_opts   = mount_arena_strdup(arena,
+                                                fs->mntent.mnt_opts ?: "");
+        if(!mnts[i].mnt_dir || !mnts[i].mnt_fsname || !mnts[i].mnt_opts)
+            errs[i] = ENOMEM;
+    }
+    mount_table_release(table);
+    return 0;
+}
+
+/* Unmounts N filesystems with options. */
+int
+umountv(const char *const *targets, size_t n, int flags, int *results)
+{
+    error_t         err       = 0;
+    error_t         first     = 0;
+    bool            unmounted = false;
+    struct mntent  *mnts      = NULL;
+    error_t        *errs      = NULL;
+    struct mount_arena arena;
+
+    mount_arena_init(&arena);
+
+    if(!targets && n)
+    {
+        errno = EINVAL;
+        return -1;
     }
-    /* Read the mtab file by default.  */
-    if (! fstab_params.fstab_path)
-        fstab_params.fstab_path = _PATH_MOUNTED;
 
-    fstab = fstab_argp_create(&fstab_params, NULL, 0);
-    if(!fstab)
+    mnts = mount_arena_alloc(&arena, n * sizeof(*mnts));
+    errs = mount_arena_alloc(&arena, n * sizeof(*errs));
+    if(!mnts || !errs)
     {
-        err = errno;
-        goto end_umount;
+        err = ENOMEM;
+        goto end_umountv;
     }
+    memset(mnts, 0, n * sizeof(*mnts));
+    memset(errs, 0, n * sizeof(*errs));
 
-    fs = fstab_find_mount(fstab, target);
-    if(!fs)
-        err = errno;
+    err = umount_lookup(&arena, targets, n, mnts, errs);
     if(err)
-        goto end_umount;
+        goto end_umountv;
 
-    err = do_umount(fs, flags);
-end_umount:
-    if(err) errno = err;
-    return err ? -1 : 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        if(!errs[i])
+            errs[i] = do_umount(&mnts[i], flags);
+        if(!errs[i])
+            unmounted = true;
+    }
+
+    if(unmounted)
+        mount_table_changed();
+
+end_umountv:
+    for(size_t i = 0; i < n; i++)
+    {
+        error_t res = (err || !errs) ? err : errs[i];
+
+        if(res && !first)
+            first = res;
+        if(results)
+            results[i] = res;
+        mount_stats_call(MOUNT_STATS_UMOUNT, res);
+    }
+    mount_arena_free(&arena);
+
+    if(first) errno = first;
+    return first ? -1 : 0;
+}
+
+/* The unmounts of one umount_batch, shared by the threads doing a phase of
+   them. */
+struct umount_batch
+{
+    struct mntent  *mnts;
+    error_t        *errs;
+    bool           *synced;
+    size_t          n;
+    size_t          next;
+    int             flags;
+    bool            teardown;   /* Making them go away, not syncing. */
+};
+
+static void
+umount_batch_one(struct umount_batch *batch, size_t i)
+{
+    fsys_t   control = MACH_PORT_NULL;
+    int      flags   = batch->flags;
+    error_t  err;
+    uint64_t start;
+
+    if(batch->teardown)
+    {
+        /* One we could not sync syncs as it goes away. */
+        if(batch->synced[i])
+            flags |= UMOUNT_NOSYNC;
+        batch->errs[i] = do_umount(&batch->mnts[i], flags);
+        return;
+    }
+
+    /* Failing to get at it here is left for the teardown to report. */
+    if(mount_control_get(batch->mnts[i].mnt_dir, &control, NULL) != 0)
+        return;
+    start = mount_stats_begin(MOUNT_PHASE_SYNC);
+    err = fsys_syncfs(control, 1, 0);
+    mount_stats_end(MOUNT_PHASE_SYNC, start, err);
+    batch->synced[i] = !err;
+    mach_port_deallocate(mach_task_self(), control);
+}
+
+static void *
+umount_batch_run(void *arg)
+{
+    struct umount_batch *batch = arg;
+
+    for(;;)
+    {
+        size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+
+        if(i >= batch->n)
+            break;
+        if(!batch->errs[i])
+            umount_batch_one(batch, i);
+    }
+    return NULL;
+}
+
+/* Do the current phase of BATCH for all of its filesystems at once and
+   return how long it took. */
+static uint64_t
+umount_batch_phase(struct umount_batch *batch)
+{
+    pthread_t threads[UMOUNT_BATCH_THREADS - 1];
+    size_t    nthreads = 0;
+    uint64_t  start    = mount_stats_now();
+
+    batch->next = 0;
+    while((nthreads < UMOUNT_BATCH_THREADS - 1)
+          && (nthreads + 1 < batch->n)
+          && (pthread_create(&threads[nthreads], NULL, umount_batch_run,
+                             batch) == 0))
+        nthreads++;
+    umount_batch_run(batch);
+    for(size_t t = 0; t < nthreads; t++)
+        pthread_join(threads[t], NULL);
+    return mount_stats_now() - start;
+}
+
+/* Unmounts N filesystems, syncing them all before any goes away. */
+int
+umount_batch(const char *const *targets, size_t n, int flags, int *results,
+             struct umount_batch_times *times)
+{
+    error_t              err       = 0;
+    error_t              first     = 0;
+    bool                 unmounted = false;
+    struct umount_batch  batch     = { 0 };
+    struct mount_arena   arena;
+
+    mount_arena_init(&arena);
+    if(times)
+        memset(times, 0, sizeof(*times));
+
+    if(!targets && n)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    batch.mnts   = mount_arena_alloc(&arena, n * sizeof(*batch.mnts));
+    batch.errs   = mount_arena_alloc(&arena, n * sizeof(*batch.errs));
+    batch.synced = mount_arena_alloc(&arena, n * sizeof(*batch.synced));
+    if(!batch.mnts || !batch.errs || !batch.synced)
+    {
+        err = ENOMEM;
+        goto end_umount_batch;
+    }
+    memset(batch.mnts, 0, n * sizeof(*batch.mnts));
+    memset(batch.errs, 0, n * sizeof(*batch.errs));
+    memset(batch.synced, 0, n * sizeof(*batch.synced));
+    batch.n     = n;
+    batch.flags = flags;
+
+    err = umount_lookup(&arena, targets, n, batch.mnts, batch.errs);
+    if(err)
+        goto end_umount_batch;
+
+    /* Every filesystem writes back at once, instead of one after the other
+       as each goes away. */
+    if(!(flags & UMOUNT_NOSYNC))
+    {
+        uint64_t ns = umount_batch_phase(&batch);
+        if(times)
+            times->sync_ns = ns;
+    }
+
+    batch.teardown = true;
+    {
+        uint64_t ns = umount_batch_phase(&batch);
+        if(times)
+            times->teardown_ns = ns;
+    }
+
+    for(size_t i = 0; i < n; i++)
+        if(!batch.errs[i])
+            unmounted = true;
+    if(unmounted)
+        mount_table_changed();
+
+end_umount_batch:
+    for(size_t i = 0; i < n; i++)
+    {
+        error_t res = (err || !batch.errs) ? err : batch.errs[i];
+
+        if(res && !first)
+            first = res;
+        if(results)
+            results[i] = res;
+        mount_stats_call(MOUNT_STATS_UMOUNT, res);
+    }
+    mount_arena_free(&arena);
+
+    if(first) errno = first;
+    return first ? -1 : 0;
+}
+
+/* A mount found under the target of umount2_rec. */
+struct umount_node
+{
+    struct mntent  mnt;
+    int            parent;      /* Index of the mount containing it, or -1. */
+    int            depth;       /* Number of mounts containing it. */
+    error_t        err;
+    bool           done;
+};
+
+/* The mounts of one depth, unmounted in parallel by umount_level_run. */
+struct umount_level
+{
+    struct umount_node  *nodes;
+    int                 *todo;
+    size_t               n;
+    size_t               next;
+    int                  flags;
+};
+
+/* Where umount_collect copies the mounts found by umount2_rec. */
+struct umount_collect
+{
+    struct mount_arena  *arena;
+    struct umount_node  *nodes;
+    size_t               n;
+    error_t              err;
+};
+
+static void
+umount_collect(struct fs *fs, void *cookie)
+{
+    struct umount_collect *c    = cookie;
+    struct umount_node    *node = &c->nodes[c->n++];
+
+    memset(node, 0, sizeof(*node));
+    node->mnt.mnt_dir    = mount_arena_strdup(c->arena, fs->mntent.mnt_dir);
+    node->mnt.mnt_fsname = mount_arena_strdup(c->arena, fs->mntent.mnt_fsname);
+    node->mnt.mnt_opts   = mount_arena_strdup(c->arena,
+                                              fs->mntent.mnt_opts ?: "");
+    if(!node->mnt.mnt_dir || !node->mnt.mnt_fsname || !node->mnt.mnt_opts)
+        c->err = ENOMEM;
+}
+
+/* Return whether directory DIR is PREFIX or below it. */
+static bool
+umount_under(const char *dir, const char *prefix, size_t prefix_len)
+{
+    if(strncmp(dir, prefix, prefix_len) != 0)
+        return false;
+    return (dir[prefix_len] == '\0') || (dir[prefix_len] == '/')
+        || ((prefix_len > 0) && (prefix[prefix_len - 1] == '/'));
+}
+
+static void *
+umount_level_run(void *arg)
+{
+    struct umount_level *level = arg;
+
+    for(;;)
+    {
+        size_t i = __atomic_fetch_add(&level->next, 1, __ATOMIC_RELAXED);
+        struct umount_node *node;
+
+        if(i >= level->n)
+            break;
+        node = &level->nodes[level->todo[i]];
+        node->err  = do_umount(&node->mnt, level->flags);
+        node->done = true;
+        mount_stats_call(MOUNT_STATS_UMOUNT, node->err);
+    }
+    return NULL;
+}
+
+/* Unmounts a filesystem and everything mounted below it. */
+int
+umount2_rec(const char *target, int flags,
+            struct umount_failure **failures, size_t *nfailures)
+{
+    error_t              err       = 0;
+    error_t              first     = 0;
+    struct mount_table  *table     = NULL;
+    struct umount_node  *nodes     = NULL;
+    int                 *todo      = NULL;
+    size_t               n         = 0;
+    size_t               nfailed   = 0;
+    size_t               names_len = 0;
+    char                *dir       = NULL;
+    int                  max_depth = 0;
+    bool                 unmounted = false;
+    struct mount_arena   arena;
+
+    mount_arena_init(&arena);
+    if(failures)
+        *failures = NULL;
+    if(nfailures)
+        *nfailures = 0;
+
+    if(!target || (target[0] == '\0'))
+    {
+        err = EINVAL;
+        goto end_umount_rec;
+    }
+
+    err = mount_path_absolute(&arena, target, &dir);
+    if(err)
+        goto end_umount_rec;
+
+    err = mount_table_acquire(&table);
+    if(err)
+        goto end_umount_rec;
+
+    n = mount_index_each_under(table->index, dir, NULL, NULL);
+    nodes = mount_arena_alloc(&arena, n * sizeof(*nodes));
+    todo  = mount_arena_alloc(&arena, n * sizeof(*todo));
+    if(!nodes || !todo)
+        err = ENOMEM;
+    else
+    {
+        struct umount_collect c =
+            { .arena = &arena, .nodes = nodes, .n = 0, .err = 0 };
+
+        mount_index_each_under(table->index, dir, umount_collect, &c);
+        err = c.err;
+    }
+    mount_table_release(table);
+    if(err)
+        goto end_umount_rec;
+    if(!n)
+    {
+        err = EINVAL;
+        goto end_umount_rec;
+    }
+
+    /* The index gives each mount after the ones containing it, depth
+       first, so the containing mount is the nearest one on a stack of
+       ancestors. */
+    {
+        int    *stack = todo;
+        size_t  depth = 0;
+
+        for(size_t i = 0; i < n; i++)
+        {
+            const char *dir = nodes[i].mnt.mnt_dir;
+
+            while(depth
+                  && !umount_under(dir, nodes[stack[depth - 1]].mnt.mnt_dir,
+                                   strlen(nodes[stack[depth - 1]].mnt.mnt_dir)))
+                depth--;
+            nodes[i].parent = depth ? stack[depth - 1] : -1;
+            nodes[i].depth  = depth;
+            if((int) depth > max_depth)
+                max_depth = depth;
+            stack[depth++] = i;
+        }
+    }
+
+    /* The mounts of one depth are in independent subtrees, so each depth
+       is unmounted in parallel once everything deeper is gone. */
+    for(int d = max_depth; d >= 0; d--)
+    {
+        struct umount_level level =
+            { .nodes = nodes, .todo = todo, .n = 0, .next = 0,
+              .flags = flags };
+        pthread_t threads[UMOUNT_REC_THREADS - 1];
+        size_t    nthreads = 0;
+
+        for(size_t i = 0; i < n; i++)
+            if((nodes[i].depth == d) && !nodes[i].err)
+                todo[level.n++] = i;
+
+        while((nthreads < UMOUNT_REC_THREADS - 1)
+              && (nthreads + 1 < level.n)
+              && (pthread_create(&threads[nthreads], NULL, umount_level_run,
+                                 &level) == 0))
+            nthreads++;
+        umount_level_run(&level);
+        for(size_t t = 0; t < nthreads; t++)
+            pthread_join(threads[t], NULL);
+
+        /* Leave whatever contains a mount that failed in place. */
+        for(size_t t = 0; t < level.n; t++)
+        {
+            struct umount_node *node = &nodes[todo[t]];
+
+            if(!node->err)
+            {
+                unmounted = true;
+                continue;
+            }
+            for(int p = node->parent; (p >= 0) && !nodes[p].err;
+                p = nodes[p].parent)
+                nodes[p].err = EBUSY;
+        }
+    }
+
+    if(unmounted)
+        mount_table_changed();
+
+    for(size_t i = 0; i < n; i++)
+    {
+        if(!nodes[i].err)
+            continue;
+        if(!first)
+            first = nodes[i].err;
+        nfailed++;
+        names_len += strlen(nodes[i].mnt.mnt_dir) + 1;
+        if(!nodes[i].done)
+            mount_stats_call(MOUNT_STATS_UMOUNT, nodes[i].err);
+    }
+
+    if(nfailed && failures)
+    {
+        /* One block, so the caller can release it with a single free. */
+        struct umount_failure *list = malloc(nfailed * sizeof(*list)
+                                             + names_len);
+        char                  *name = (char *) (list + nfailed);
+        size_t                 j    = 0;
+
+        if(!list)
+        {
+            err = ENOMEM;
+            goto end_umount_rec;
+        }
+        for(size_t i = 0; i < n; i++)
+        {
+            if(!nodes[i].err)
+                continue;
+            list[j].target = name;
+            list[j].err    = nodes[i].err;
+            name = stpcpy(name, nodes[i].mnt.mnt_dir) + 1;
+            j++;
+        }
+        *failures = list;
+        if(nfailures)
+            *nfailures = nfailed;
+    }
+    else if(nfailures)
+        *nfailures = nfailed;
+
+end_umount_rec:
+    mount_arena_free(&arena);
+    if(err)
+    {
+        mount_stats_call(MOUNT_STATS_UMOUNT, err);
+        first = err;
+    }
+    if(first) errno = first;
+    return first ? -1 : 0;
 }
@@ -22,6 +22,8 @@
 #define _SYS_MOUNT_H
 
 #include <features.h>
+#define __need_size_t
+#include <stddef.h>
 #include <hurd/fsys.h>
 
 #define MS_RDONLY       1           /* Mount readonly. */
@@ -35,8 +37,8 @@
 #define MS_NOATIME      1024        /* Do not update the access time.*/
 #define MS_NODIRATIME   2048        /* Do not update directory access times. */
 #define MS_BIND         4096        /* Bind directory to different place. */
-#define MS_MOVE         8192        /**/
-#define MS_REC          16384       /**/
+#define MS_MOVE         8192        /* Move a mount; see `mount'. */
+#define MS_REC          16384       /* Recursive; see `umount2_rec'. */
 #define MS_SILENT       32768       /**/
 #define MS_POSIXACL     (1 << 16)   /* VFS does not apply umask. */
 #define MS_UNBINDABLE   (1 << 17)   /* Change to unbindable. */
@@ -59,14 +61,151 @@
 /* Possible value for FLAGS parameter of `umount2'.  */
 /* See `hurd_types.h' for more */
 #define MNT_FORCE FSYS_GOAWAY_FORCE
-#define MNT_DETACH 2                 /* Ignored */
+#define MNT_DETACH 0x100             /* Return at once and let the
+                                        translator go away in the
+                                        background; see
+                                        `umount_detach_status'.  Not 2 as
+                                        on Linux, which is
+                                        UMOUNT_NOSYNC here. */
 #define MNT_EXPIRE 4                 /* Ignored */
 #define UMOUNT_NOFOLLOW 8            /* Ignored */
 #define UMOUNT_NOSYNC FSYS_GOAWAY_NOSYNC
 
 __BEGIN_DECLS
 
-/* Mount The filesystem to target. */
+/* All of the functions below may be called from several threads at once;
+   they keep no per-call state outside of the call. */
+
+/* One entry of a `mountv' batch; the fields are the arguments of `mount'. */
+struct mount_req
+{
+    const char    *source;
+    const char    *target;
+    const char    *filesystemtype;
+    unsigned long  mountflags;
+    const void    *data;
+};
+
+/* Options for `mount' given as a structure in its DATA argument instead of
+   a comma separated string, so that they need not be formatted and parsed
+   again.  Start from MOUNT_DATA_INIT, which fills in MAGIC, VERSION and
+   SIZE; a later version may only add fields at the end.  Each field set in
+   FIELDS is passed to the translator as the switch named in its comment,
+   and FLAGS are taken as if they were in the mount flags. */
+struct mount_data
+{
+    char           magic[4];    /* MOUNT_DATA_MAGIC, to tell it from a
+                                   string. */
+    unsigned int   version;     /* MOUNT_DATA_VERSION. */
+    unsigned int   size;        /* sizeof (struct mount_data). */
+    unsigned int   fields;      /* MOUNT_DATA_* bits of the fields set. */
+    unsigned long  flags;       /* MS_* flags. */
+    unsigned int   opts;        /* MOUNT_DATA_NOAUTO, MOUNT_DATA_LOOP. */
+    unsigned int   rsize;       /* --rsize= */
+    unsigned int   wsize;       /* --wsize= */
+    unsigned int   uid;         /* --uid= */
+    unsigned int   gid;         /* --gid= */
+    unsigned int   cache_size;  /* --cache-size= */
+    const char    *extra;       /* More options as a comma separated
+                                   string, or NULL. */
+};
+
+#define MOUNT_DATA_MAGIC      { '\177', 'M', 'N', 'T' }
+#define MOUNT_DATA_VERSION    1
+#define MOUNT_DATA_INIT \
+    { MOUNT_DATA_MAGIC, MOUNT_DATA_VERSION, sizeof(struct mount_data) }
+
+/* Bits of `mount_data.fields'. */
+#define MOUNT_DATA_RSIZE      1
+#define MOUNT_DATA_WSIZE      2
+#define MOUNT_DATA_UID        4
+#define MOUNT_DATA_GID        8
+#define MOUNT_DATA_CACHE_SIZE 16
+
+/* Bits of `mount_data.opts', the options that are meant for `mount'. */
+#define MOUNT_DATA_NOAUTO     1
+#define MOUNT_DATA_LOOP       2
+
+/* A filesystem that `umount2_rec' left mounted. */
+struct umount_failure
+{
+    const char    *target;
+    int            err;
+};
+
+/* Phases of `mount' and `umount2' timed by the statistics. */
+enum mount_phase
+{
+    MOUNT_PHASE_OPTIONS,        /* Compiling the options into switches. */
+    MOUNT_PHASE_FSTAB,          /* Creating or loading the mount table. */
+    MOUNT_PHASE_FSTYPE,         /* Finding the translator program. */
+    MOUNT_PHASE_START,          /* Starting the translator. */
+    MOUNT_PHASE_OPEN,           /* Looking up the mount point's node. */
+    MOUNT_PHASE_ATTACH,         /* Setting it on the mount point. */
+    MOUNT_PHASE_REMOUNT,        /* Changing a running translator's options. */
+    MOUNT_PHASE_SYNC,           /* Syncing a filesystem for `umount_batch'. */
+    MOUNT_PHASE_GOAWAY,         /* Making a translator go away. */
+    MOUNT_PHASE_GOAWAY_SOURCE,  /* Clearing the translator on its source. */
+    MOUNT_PHASE_MAX
+};
+
+/* Operations counted by the statistics. */
+enum mount_stats_op
+{
+    MOUNT_STATS_MOUNT,
+    MOUNT_STATS_UMOUNT,
+    MOUNT_STATS_OP_MAX
+};
+
+#define MOUNT_STATS_BUCKETS 32
+#define MOUNT_STATS_ERRNOS  16
+
+struct mount_phase_stats
+{
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    /* HIST[0] counts phases under a microsecond, HIST[I] those that took
+       from 2^(I-1) up to 2^I microseconds; the last bucket has the rest. */
+    unsigned long long hist[MOUNT_STATS_BUCKETS];
+};
+
+struct mount_errno_stats
+{
+    int                err;     /* 0 if the slot is unused. */
+    unsigned long long count;
+};
+
+struct mount_stats
+{
+    unsigned long long       calls[MOUNT_STATS_OP_MAX];
+    unsigned long long       errors[MOUNT_STATS_OP_MAX];
+    /* Failures by error number, for the first MOUNT_STATS_ERRNOS different
+       ones seen; ERRNOS_OTHER counts the others. */
+    struct mount_errno_stats errnos[MOUNT_STATS_ERRNOS];
+    unsigned long long       errnos_other;
+    struct mount_phase_stats phases[MOUNT_PHASE_MAX];
+};
+
+/* A request started by `mount_async' or `umount2_async'. */
+struct mount_async;
+
+/* Called from a worker thread with the result of REQ, as an error number,
+   once it is done.  COOKIE is the one given when REQ was started.  It may
+   ask for the result of REQ, which is done by then, but waiting from it
+   for a request yet to run can deadlock, since it holds up one of the few
+   workers. */
+typedef void (*mount_async_fn)(struct mount_async *__req, int __err,
+                               void *__cookie);
+
+/* Mount The filesystem to target.  DATA is either a comma separated
+   string of options or a struct mount_data.  With MS_MOVE, the translator
+   mounted on SOURCE, along with whatever is mounted below it, is moved to
+   TARGET while it keeps running; FILESYSTEMTYPE and DATA are ignored.
+   With the noauto option, the translator is only set as TARGET's passive
+   translator, to be started by the first lookup through it; with idle=N
+   as well, it is asked to go away whenever it is found unused, every N
+   seconds for as long as this process runs. */
 extern int mount(const char *__source, const char *__target,
                  const char *__filesystemtype, unsigned long __mountflags,
                  const void *__data) __THROW;
@@ -77,5 +216,263 @@ extern int umount(const char *__target) __THROW;
 /* Unmount the filesystem with flags. */
 extern int umount2(const char *__target, int __flags) __THROW;
 
+/* Mount the N filesystems described by REQS, sharing the filesystem table
+   and type lookups between them.  If RESULTS is not null, RESULTS[I] is set
+   to 0 or the error number of REQS[I].  Returns -1 if any entry failed,
+   with errno set to the first failure. */
+extern int mountv(const struct mount_req *__reqs, size_t __n,
+                  int *__results) __THROW;
+
+/* Unmount the N filesystems in TARGETS with FLAGS as for `umount2'.
+   RESULTS and the return value are as for `mountv'.  A target naming the
+   filesystem of an earlier one fails with EINVAL, as it is gone by then. */
+extern int umountv(const char *const *__targets, size_t __n, int __flags,
+                   int *__results) __THROW;
+
+/* How long the phases of one `umount_batch' took. */
+struct umount_batch_times
+{
+    unsigned long long sync_ns;     /* Syncing all the filesystems. */
+    unsigned long long teardown_ns; /* Making their translators go away. */
+};
+
+/* Unmount the N filesystems in TARGETS with FLAGS like `umountv', but
+   sync all of them at once first, and then make them go away at once with
+   UMOUNT_NOSYNC, so that they do not each sync in turn.  One that could not
+   be synced still syncs as it goes away; with UMOUNT_NOSYNC in FLAGS none
+   is.  If TIMES is not null it is set to how long each phase took. */
+extern int umount_batch(const char *const *__targets, size_t __n,
+                        int __flags, int *__results,
+                        struct umount_batch_times *__times) __THROW;
+
+/* Forget the translator programs `mount' found for filesystem types,
+   including the types it found none for.  The cache is also dropped
+   whenever /hurd changes. */
+extern void mount_fstype_flush(void) __THROW;
+
+/* Unmount TARGET and every filesystem mounted below it with FLAGS as for
+   `umount2', deepest first.  Filesystems in independent subtrees are
+   unmounted in parallel.  A filesystem with a submount that could not be
+   unmounted is left in place and fails with EBUSY.  If FAILURES is not
+   null it is set to an array of the *NFAILURES filesystems that failed,
+   to be released with `free'.  Returns -1 with errno set to the first
+   failure if any.  `umount2' does the same when MS_REC is in its flags. */
+extern int umount2_rec(const char *__target, int __flags,
+                       struct umount_failure **__failures,
+                       size_t *__nfailures) __THROW;
+
+/* Set *MOUNTPOINT to the mount point of the filesystem that contains PATH,
+   the deepest one in the mount table that PATH is at or below, in a string
+   to be released with `free'.  PATH is taken as it is, without following
+   symbolic links, and a relative PATH against the working directory, as
+   are the targets of `mount' and `umount2'.  Returns -1 with errno set to
+   ENOENT if there is none. */
+extern int mount_point_of(const char *__path, char **__mountpoint) __THROW;
+
+/* Hooks called in the thread doing each phase of `mount' and `umount2',
+   as it begins and as it ends, NS nanoseconds later, with ERR set to the
+   error number it failed with or 0.  CONTEXT is the one the thread set with
+   `mount_trace_set_context', and COOKIE the one registered with them.
+   Phases may nest: MOUNT_PHASE_OPEN runs within MOUNT_PHASE_START.  Either
+   hook may be null.  They may be called at once from several threads. */
+struct mount_trace_hooks
+{
+    void (*begin)(enum mount_phase __phase, void *__context,
+                  void *__cookie);
+    void (*end)(enum mount_phase __phase, int __err, unsigned long long __ns,
+                void *__context, void *__cookie);
+};
+
+/* Call HOOKS, which are copied, with COOKIE around each phase from now on.
+   A phase that is already running may end without its begin hook having
+   been called.  Up to 8 sets of hooks may be registered; returns -1 with
+   errno set to ENOSPC past that.  Without any, tracing costs nothing. */
+extern int mount_trace_register(const struct mount_trace_hooks *__hooks,
+                                void *__cookie) __THROW;
+
+/* Stop calling HOOKS with COOKIE.  Once this returns they are no longer
+   running in any thread.  Returns -1 with errno set to EINVAL if HOOKS is
+   null, or ENOENT if they were not registered.  Not to be called from a
+   hook. */
+extern int mount_trace_unregister(const struct mount_trace_hooks *__hooks,
+                                  void *__cookie) __THROW;
+
+/* Set the context passed to the hooks for what the calling thread does,
+   such as the identifier of the request it serves, and return the one it
+   replaces.  Requests of `mount_async' and `umount2_async' keep the
+   context of the thread that started them. */
+extern void *mount_trace_set_context(void *__context) __THROW;
+
+/* Return the context set by `mount_trace_set_context' in this thread. */
+extern void *mount_trace_get_context(void) __THROW;
+
+/* Return the state of the last filesystem on TARGET unmounted by this
+   process with MNT_DETACH: EINPROGRESS while its translator is still going
+   away, 0 once it has, or the error number it failed with.  A translator
+   that refuses with EBUSY is asked again, less and less often, until it
+   goes away or dies.  TARGET is resolved as umount2 resolves it, so any
+   spelling of the mount point will do.  Returns ENOENT if no such unmount
+   is remembered. */
+extern int umount_detach_status(const char *__target) __THROW;
+
+/* The mount table as published by this library in binary form. */
+struct mount_map;
+struct mntent;
+
+/* Map the binary mount table that this library keeps up to date whenever
+   it mounts or unmounts something.  It is brought up to date in the
+   background, within a few milliseconds of each burst of changes, and
+   before the process that made them exits.  Returns NULL with errno set to
+   ENOENT if nothing was published yet. */
+extern struct mount_map *mount_map_open(void) __THROW;
+
+/* Set *ENTRIES to a consistent copy of the *N entries of the table in MAP,
+   valid until the next call on MAP.  Reading takes no lock and, unless the
+   table grew, no system call; if it did not change since the last call,
+   the previous copy is returned at once.  Returns -1 with errno set to
+   EAGAIN if a writer kept the table busy for too long, or to EINVAL if
+   the file holds a table of another version or one whose entries or
+   strings lie outside of it. */
+extern int mount_map_read(struct mount_map *__map,
+                          const struct mntent **__entries,
+                          size_t *__n) __THROW;
+
+/* Return a number that changes whenever the table in MAP does. */
+extern unsigned long long mount_map_generation(struct mount_map *__map)
+    __THROW;
+
+/* Unmap MAP and release what it holds. */
+extern void mount_map_close(struct mount_map *__map) __THROW;
+
+/* Changes to the mount table made by this process, as told to the
+   watchers of `mount_watch_open'.  The events are queued in memory by the
+   calls that make the changes, so a watcher only hears of those made in
+   its own process: an agent that mounts through this library watches its
+   own changes here at no cost beyond the queue.  Changes made by other
+   processes reach the published map instead; poll `mount_map_generation'
+   of a `mount_map_open' map to learn of them, and read the map to catch
+   up. */
+struct mount_watch;
+
+enum mount_event_type
+{
+    MOUNT_EVENT_ADD = 1,        /* MNT was mounted. */
+    MOUNT_EVENT_REMOVE,         /* MNT's mount point was unmounted. */
+    MOUNT_EVENT_OPTIONS,        /* MNT's mount point has new options. */
+    MOUNT_EVENT_OVERFLOW        /* Events were lost; see
+                                   `mount_watch_resync'. */
+};
+
+struct mount_event
+{
+    enum mount_event_type  type;
+    /* One more for each change, in the order they were made. */
+    unsigned long long     generation;
+    /* Valid until the next `mount_watch_read' on the same watcher. */
+    const struct mntent   *mnt;
+};
+
+/* Start watching the changes this process makes to the mount table.  The
+   first event is that of the first change made after this call.  Returns
+   NULL with errno set on failure. */
+extern struct mount_watch *mount_watch_open(void) __THROW;
+
+/* Return a descriptor that polls readable while WATCH has events to read,
+   for `poll' or `select'.  It is not to be read or closed. */
+extern int mount_watch_fd(struct mount_watch *__watch) __THROW;
+
+/* Take the next event of WATCH into EV, or return -1 with errno set to
+   EAGAIN if there is none.  A watcher that falls 256 events behind loses
+   them and gets MOUNT_EVENT_OVERFLOW, again and again, until it calls
+   `mount_watch_resync'. */
+extern int mount_watch_read(struct mount_watch *__watch,
+                            struct mount_event *__ev) __THROW;
+
+/* Drop the events WATCH has yet to read, and set *ENTRIES to the *N
+   entries of the mount table as it is now, in one block to be released
+   with `free'.  The next event read is that of the change made after it,
+   and *GENERATION, if not null, is set to the generation before that. */
+extern int mount_watch_resync(struct mount_watch *__watch,
+                              struct mntent **__entries, size_t *__n,
+                              unsigned long long *__generation) __THROW;
+
+/* Stop watching and release WATCH. */
+extern void mount_watch_close(struct mount_watch *__watch) __THROW;
+
+/* Counters of the translator pools of `mount_pool_configure'. */
+struct mount_pool_stats
+{
+    unsigned long long hits;    /* Mounts that took a waiting translator. */
+    unsigned long long misses;  /* Mounts that found their pool empty. */
+    unsigned long long started; /* Translators started for the pools. */
+    unsigned long long failed;  /* Translators that failed to start. */
+    unsigned long      idle;    /* Translators waiting now. */
+};
+
+/* Keep SIZE translators started ahead of time for mounting SOURCE with
+   FILESYSTEMTYPE, MOUNTFLAGS and DATA, so that such a `mount' only has to
+   attach one.  They are started in the background, and another replaces
+   each one that is taken.  SIZE 0 stops the pool; SIZE is capped at 32,
+   and all pools together at 64 waiting translators.  Since they all get
+   the same SOURCE, only filesystems without a backing store (`tmpfs', or
+   SOURCE empty or "none") and read-only ones may be pooled; others fail
+   with EINVAL.  The mount point is not known when they start, so they are
+   started on the root directory, and that stays the node under them.  The
+   root of a filesystem without a backing store, which `tmpfs' gives the
+   mode and owner of the node under it, is given those of the mount point
+   when one is taken; if that fails, the mount starts a translator of its
+   own.  A translator that uses the node under it for more than that
+   should not be pooled. */
+extern int mount_pool_configure(const char *__source,
+                                const char *__filesystemtype,
+                                unsigned long __mountflags,
+                                const void *__data,
+                                unsigned int __size) __THROW;
+
+/* Copy the counters of the translator pools to STATS. */
+extern void mount_pool_get_stats(struct mount_pool_stats *__stats) __THROW;
+
+/* Start (ENABLE nonzero) or stop collecting `mount_stats'.  Collection is
+   off by default.  Returns whether it was on. */
+extern int mount_stats_enable(int __enable) __THROW;
+
+/* Copy the statistics collected so far to STATS. */
+extern void mount_stats_get(struct mount_stats *__stats) __THROW;
+
+/* Clear the statistics. */
+extern void mount_stats_reset(void) __THROW;
+
+/* Start mounting as `mount' would, on a worker thread, and return the
+   request at once.  FN, if not null, is called when it is done.  The
+   request must be released with `mount_async_free'.  Returns NULL with
+   errno set if the request could not be started. */
+extern struct mount_async *mount_async(const char *__source,
+                                       const char *__target,
+                                       const char *__filesystemtype,
+                                       unsigned long __mountflags,
+                                       const void *__data,
+                                       mount_async_fn __fn,
+                                       void *__cookie) __THROW;
+
+/* Start unmounting as `umount2' would, like `mount_async'. */
+extern struct mount_async *umount2_async(const char *__target, int __flags,
+                                         mount_async_fn __fn,
+                                         void *__cookie) __THROW;
+
+/* Return the error number REQ finished with, or EINPROGRESS if it has not
+   finished yet. */
+extern int mount_async_status(struct mount_async *__req) __THROW;
+
+/* Wait for REQ to finish and return its error number.  Unless called from
+   REQ's callback, it also waits for the callback to return. */
+extern int mount_async_wait(struct mount_async *__req) __THROW;
+
+/* Cancel REQ, finishing it with ECANCELED.  Returns EBUSY if a worker has
+   already started on it. */
+extern int mount_async_cancel(struct mount_async *__req) __THROW;
+
+/* Release REQ.  If it is still running it completes in the background. */
+extern void mount_async_free(struct mount_async *__req) __THROW;
+
 __END_DECLS
 #endif /* _SYS_MOUNT_H */